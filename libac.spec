@@ -1,5 +1,5 @@
 Name:		libac
-Version:	1.99.0
+Version:	2.0.0
 Release:	1%{?dist}
 Summary:	Library of miscellaneous utility functions
 
@@ -26,9 +26,10 @@ make -C src/ %{?_smp_mflags}
 %install
 rm -rf $RPM_BUILD_ROOT
 install -Dp -m644 src/include/libac.h $RPM_BUILD_ROOT/%{_includedir}/libac.h
+install -Dp -m644 src/include/libac_inline.h $RPM_BUILD_ROOT/%{_includedir}/libac_inline.h
 install -Dp -m0755 src/libac.so.%{version} $RPM_BUILD_ROOT/%{_libdir}/libac.so.%{version}
 cd $RPM_BUILD_ROOT/%{_libdir}
-ln -s libac.so.1 libac.so
+ln -s libac.so.2 libac.so
 cd -
 
 %post -p /sbin/ldconfig
@@ -42,6 +43,7 @@ rm -rf $RPM_BUILD_ROOT
 %doc README.md COPYING CodingStyle.md Contributing.md
 %{_libdir}/libac.*
 %{_includedir}/libac.h
+%{_includedir}/libac_inline.h
 
 
 %changelog
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_alloc.h - Helpers for calling through an ac_allocator_t
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#ifndef _AC_ALLOC_H_
+#define _AC_ALLOC_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/libac.h"
+
+/*
+ * A NULL allocator or one without an alloc function means use libc.
+ *
+ * An allocator without a realloc function gets alloc + copy + free and
+ * one without a free function never frees, which is all an arena needs.
+ */
+static inline void mem_set_allocator(ac_allocator_t *dst,
+				     const ac_allocator_t *src)
+{
+	if (src)
+		*dst = *src;
+	else
+		memset(dst, 0, sizeof(ac_allocator_t));
+}
+
+static inline void *mem_alloc(const ac_allocator_t *a, size_t size)
+{
+	if (a && a->alloc)
+		return a->alloc(size, a->ctx);
+
+	return malloc(size);
+}
+
+static inline void *mem_zalloc(const ac_allocator_t *a, size_t size)
+{
+	void *ptr;
+
+	if (!a || !a->alloc)
+		return calloc(1, size);
+
+	ptr = a->alloc(size, a->ctx);
+	if (ptr)
+		memset(ptr, 0, size);
+
+	return ptr;
+}
+
+static inline void mem_free(const ac_allocator_t *a, void *ptr, size_t size)
+{
+	if (!ptr)
+		return;
+
+	if (!a || !a->alloc)
+		free(ptr);
+	else if (a->free)
+		a->free(ptr, size, a->ctx);
+}
+
+static inline void *mem_realloc(const ac_allocator_t *a, void *ptr,
+				size_t old_size, size_t size)
+{
+	void *new;
+
+	if (!a || !a->alloc)
+		return realloc(ptr, size);
+	if (a->realloc)
+		return a->realloc(ptr, old_size, size, a->ctx);
+
+	new = a->alloc(size, a->ctx);
+	if (!new)
+		return NULL;
+	if (ptr) {
+		memcpy(new, ptr, old_size < size ? old_size : size);
+		mem_free(a, ptr, old_size);
+	}
+
+	return new;
+}
+
+static inline char *mem_strdup(const ac_allocator_t *a, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *new = mem_alloc(a, len);
+
+	if (new)
+		memcpy(new, str, len);
+
+	return new;
+}
+
+#endif /* _AC_ALLOC_H_ */
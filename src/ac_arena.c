@@ -0,0 +1,398 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_arena.c - Region based (bump pointer) memory allocator
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "include/libac.h"
+
+#define ARENA_ALIGN		16
+#define ARENA_CHUNK_SZ		(64 * 1024)
+
+struct ac_arena_chunk {
+	struct ac_arena_chunk *next;
+	size_t size;
+	size_t used;
+
+	/* Where the last allocation started, for realloc/free */
+	size_t last;
+
+	char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+static struct ac_arena_chunk *arena_new_chunk(size_t size)
+{
+	struct ac_arena_chunk *chunk;
+
+	if (size > SIZE_MAX - sizeof(struct ac_arena_chunk)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	chunk = malloc(sizeof(struct ac_arena_chunk) + size);
+	if (!chunk)
+		return NULL;
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->last = 0;
+
+	return chunk;
+}
+
+static inline size_t arena_align_up(size_t n, size_t align)
+{
+	return (n + align - 1) & ~(align - 1);
+}
+
+/* The offset of the next allocation in a chunk with the given alignment */
+static inline size_t arena_offset(const struct ac_arena_chunk *chunk,
+				  size_t used, size_t align)
+{
+	uintptr_t base = (uintptr_t)chunk->data;
+
+	return arena_align_up(base + used, align) - base;
+}
+
+/*
+ * Whether size bytes at the given alignment fit in a chunk after used,
+ * written so as not to overflow.
+ */
+static inline bool arena_fits(const struct ac_arena_chunk *chunk,
+			      size_t used, size_t size, size_t align)
+{
+	size_t offset = arena_offset(chunk, used, align);
+
+	return offset <= chunk->size && size <= chunk->size - offset;
+}
+
+/*
+ * Anything bigger than this would overflow when working out the size of
+ * the chunk for it.
+ */
+static inline bool arena_size_ok(size_t size, size_t align)
+{
+	return size <= SIZE_MAX - align - sizeof(struct ac_arena_chunk);
+}
+
+/*
+ * Find a chunk with room for size bytes at the given alignment, moving on
+ * to (and reusing) a chunk left over from a reset or rewind or adding a
+ * new one after the current chunk.
+ */
+static struct ac_arena_chunk *arena_chunk_for(ac_arena_t *arena, size_t size,
+					      size_t align)
+{
+	struct ac_arena_chunk *chunk = arena->cur;
+	struct ac_arena_chunk **pp;
+	struct ac_arena_chunk *new;
+
+	if (chunk && arena_fits(chunk, chunk->used, size, align))
+		return chunk;
+
+	/*
+	 * The chunks after the current one are all free, look for the first
+	 * one big enough and move it up to be next.
+	 */
+	for (pp = chunk ? &chunk->next : &arena->head; *pp; pp = &(*pp)->next) {
+		if (arena_fits(*pp, 0, size, align))
+			break;
+	}
+
+	if (*pp) {
+		new = *pp;
+		*pp = new->next;
+	} else {
+		new = arena_new_chunk(AC_MAX(arena->chunk_sz, size + align));
+		if (!new)
+			return NULL;
+		if (!arena_fits(new, 0, size, align)) {
+			free(new);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+	new->used = 0;
+	new->last = 0;
+
+	if (chunk) {
+		new->next = chunk->next;
+		chunk->next = new;
+	} else {
+		new->next = arena->head;
+		arena->head = new;
+	}
+	arena->cur = new;
+
+	return new;
+}
+
+/**
+ * ac_arena_new - create a new memory arena
+ *
+ * @chunk_sz: The size of the chunks memory is allocated from, 0 for the
+ *            default (64KiB). Allocations larger than this get a chunk
+ *            of their own
+ *
+ * Returns:
+ *
+ * A pointer to the new arena or NULL on failure
+ */
+ac_arena_t *ac_arena_new(size_t chunk_sz)
+{
+	ac_arena_t *arena = malloc(sizeof(ac_arena_t));
+
+	if (!arena)
+		return NULL;
+
+	arena->head = NULL;
+	arena->cur = NULL;
+	arena->chunk_sz = chunk_sz ? chunk_sz : ARENA_CHUNK_SZ;
+
+	return arena;
+}
+
+/**
+ * ac_arena_alloc_aligned - allocate memory from an arena with an alignment
+ *
+ * @arena: The arena to allocate from
+ * @size: The number of bytes to allocate
+ * @align: The alignment, must be a power of two
+ *
+ * Returns:
+ *
+ * A pointer to the memory or NULL on failure, check errno (EINVAL for a
+ * bad alignment, ENOMEM if it couldn't be allocated or is too big)
+ */
+void *ac_arena_alloc_aligned(ac_arena_t *arena, size_t size, size_t align)
+{
+	struct ac_arena_chunk *chunk;
+	size_t offset;
+
+	if (align == 0 || (align & (align - 1))) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!arena_size_ok(size, align)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	chunk = arena_chunk_for(arena, size, align);
+	if (!chunk)
+		return NULL;
+
+	offset = arena_offset(chunk, chunk->used, align);
+	chunk->last = offset;
+	chunk->used = offset + size;
+
+	return chunk->data + offset;
+}
+
+/**
+ * ac_arena_alloc - allocate memory from an arena
+ *
+ * @arena: The arena to allocate from
+ * @size: The number of bytes to allocate
+ *
+ * The memory is aligned to 16 bytes, suitable for any type.
+ *
+ * Returns:
+ *
+ * A pointer to the memory or NULL on failure
+ */
+void *ac_arena_alloc(ac_arena_t *arena, size_t size)
+{
+	return ac_arena_alloc_aligned(arena, size, ARENA_ALIGN);
+}
+
+/**
+ * ac_arena_strdup - duplicate a string into an arena
+ *
+ * @arena: The arena to allocate from
+ * @str: The string to duplicate
+ *
+ * Returns:
+ *
+ * A pointer to the new string or NULL on failure
+ */
+char *ac_arena_strdup(ac_arena_t *arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *new = ac_arena_alloc_aligned(arena, len, 1);
+
+	if (new)
+		memcpy(new, str, len);
+
+	return new;
+}
+
+static inline bool arena_is_last(const ac_arena_t *arena, const void *ptr)
+{
+	return arena->cur && ptr == arena->cur->data + arena->cur->last;
+}
+
+static void *arena_alloc_hook(size_t size, void *ctx)
+{
+	return ac_arena_alloc(ctx, size);
+}
+
+/* Grow (or shrink) the last allocation in place when there's room */
+static void *arena_realloc_hook(void *ptr, size_t old_size, size_t size,
+				void *ctx)
+{
+	ac_arena_t *arena = ctx;
+	void *new;
+
+	if (!arena_size_ok(size, ARENA_ALIGN)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (ptr && arena_is_last(arena, ptr) &&
+	    size <= arena->cur->size - arena->cur->last) {
+		arena->cur->used = arena->cur->last + size;
+		return ptr;
+	}
+
+	new = ac_arena_alloc(arena, size);
+	if (new && ptr)
+		memcpy(new, ptr, AC_MIN(old_size, size));
+
+	return new;
+}
+
+/* Only the last allocation can actually be given back */
+static void arena_free_hook(void *ptr, size_t size __always_unused, void *ctx)
+{
+	ac_arena_t *arena = ctx;
+
+	if (arena_is_last(arena, ptr))
+		arena->cur->used = arena->cur->last;
+}
+
+/**
+ * ac_arena_allocator - get an allocator that allocates from an arena
+ *
+ * @arena: The arena to allocate from
+ * @alloc: The allocator to fill in
+ *
+ * The allocator can be passed to any of the *_with_allocator() functions.
+ * Freeing memory is a no-op other than for the most recent allocation, the
+ * arena should be reset or destroyed instead.
+ */
+void ac_arena_allocator(ac_arena_t *arena, ac_allocator_t *alloc)
+{
+	alloc->alloc = arena_alloc_hook;
+	alloc->realloc = arena_realloc_hook;
+	alloc->free = arena_free_hook;
+	alloc->ctx = arena;
+}
+
+/**
+ * ac_arena_mark - get the current position in an arena
+ *
+ * @arena: The arena
+ *
+ * Returns:
+ *
+ * A mark that can be passed to ac_arena_rewind()
+ */
+ac_arena_mark_t ac_arena_mark(const ac_arena_t *arena)
+{
+	ac_arena_mark_t mark;
+
+	mark.chunk = arena->cur;
+	mark.used = arena->cur ? arena->cur->used : 0;
+
+	return mark;
+}
+
+/**
+ * ac_arena_rewind - free everything allocated since a mark
+ *
+ * @arena: The arena
+ * @mark: A mark from ac_arena_mark()
+ *
+ * Any chunks allocated since the mark are kept for reuse.
+ */
+void ac_arena_rewind(ac_arena_t *arena, ac_arena_mark_t mark)
+{
+	if (!mark.chunk) {
+		ac_arena_reset(arena);
+		return;
+	}
+
+	arena->cur = mark.chunk;
+	arena->cur->used = mark.used;
+	arena->cur->last = mark.used;
+}
+
+/**
+ * ac_arena_reset - free everything allocated from an arena
+ *
+ * @arena: The arena to reset
+ *
+ * The chunks are kept for reuse.
+ */
+void ac_arena_reset(ac_arena_t *arena)
+{
+	arena->cur = arena->head;
+	if (arena->cur) {
+		arena->cur->used = 0;
+		arena->cur->last = 0;
+	}
+}
+
+/**
+ * ac_arena_size - get the amount of memory held by an arena
+ *
+ * @arena: The arena
+ *
+ * Returns:
+ *
+ * The total size of the arena's chunks in bytes
+ */
+size_t ac_arena_size(const ac_arena_t *arena)
+{
+	const struct ac_arena_chunk *chunk;
+	size_t size = 0;
+
+	for (chunk = arena->head; chunk; chunk = chunk->next)
+		size += chunk->size;
+
+	return size;
+}
+
+/**
+ * ac_arena_destroy - destroy an arena freeing all its memory
+ *
+ * @arena: The arena to destroy
+ */
+void ac_arena_destroy(ac_arena_t *arena)
+{
+	struct ac_arena_chunk *chunk;
+
+	if (!arena)
+		return;
+
+	chunk = arena->head;
+	while (chunk) {
+		struct ac_arena_chunk *next = chunk->next;
+
+		free(chunk);
+		chunk = next;
+	}
+	free(arena);
+}
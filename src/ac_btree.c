@@ -13,6 +13,8 @@
 #include <search.h>
 
 #include "include/libac.h"
+#include "ac_alloc.h"
+#include "ac_lock.h"
 #include "platform.h"
 
 static void null_free_node(void *data __always_unused)
@@ -31,25 +33,34 @@ void ac_btree_destroy(const ac_btree_t *tree)
 
 	tdestroy(tree->rootp, tree->free_node);
 
-	free((void *)tree);
+	rwlock_destroy(&tree->alloc, tree->lock);
+	mem_free(&tree->alloc, (void *)tree, sizeof(ac_btree_t));
 }
 
 /**
- * ac_btree_new - create a new binary tree
+ * ac_btree_new_with_allocator - create a new binary tree
  *
  * @compar: A comparison function. Function should return an integer less
  *          than, equal to or greater than zero if the first argument is
  *          considered to be respectively less than, equal to or greater
  *          than the second
  * @free_node: Pointer to function called to free a nodes memory. Can be NULL
+ * @alloc: The allocator to use for the tree itself, it is copied.
+ *         NULL for the default
+ *
+ * The tree nodes are allocated by tsearch(3) and so always come from
+ * malloc(3).
  */
-void *ac_btree_new(int (*compar)(const void *, const void *),
-		   void (*free_node)(void *nodep))
+void *ac_btree_new_with_allocator(int (*compar)(const void *, const void *),
+				  void (*free_node)(void *nodep),
+				  const ac_allocator_t *alloc)
 {
-	ac_btree_t *tree = malloc(sizeof(ac_btree_t));
+	ac_btree_t *tree = mem_alloc(alloc, sizeof(ac_btree_t));
 
 	tree->rootp = NULL;
 	tree->compar = compar;
+	tree->lock = NULL;
+	mem_set_allocator(&tree->alloc, alloc);
 
 	if (!free_node)
 		tree->free_node = null_free_node;
@@ -59,17 +70,65 @@ void *ac_btree_new(int (*compar)(const void *, const void *),
 	return tree;
 }
 
+/**
+ * ac_btree_new - create a new binary tree
+ *
+ * @compar: A comparison function. Function should return an integer less
+ *          than, equal to or greater than zero if the first argument is
+ *          considered to be respectively less than, equal to or greater
+ *          than the second
+ * @free_node: Pointer to function called to free a nodes memory. Can be NULL
+ */
+void *ac_btree_new(int (*compar)(const void *, const void *),
+		   void (*free_node)(void *nodep))
+{
+	return ac_btree_new_with_allocator(compar, free_node, NULL);
+}
+
+/**
+ * ac_btree_set_thread_safe - make a tree safe to share between threads
+ *
+ * @tree: The binary tree
+ *
+ * After this the tree is protected by a read/write lock, so lookups and
+ * walks can happen concurrently with each other but not with changes. It
+ * must be called before the tree is shared and lasts for its lifetime.
+ *
+ * free_node() and the foreach actions are called with the lock held and
+ * must not call back into the tree to change it.
+ *
+ * The allocator is only used for the tree and its lock, the nodes come
+ * from tsearch(3), so it doesn't need to be thread-safe.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno (ENOMEM)
+ */
+int ac_btree_set_thread_safe(ac_btree_t *tree)
+{
+	if (!tree->lock)
+		tree->lock = rwlock_new(&tree->alloc);
+
+	return tree->lock ? 0 : -1;
+}
+
 /**
  * ac_btree_foreach - iterate over the tree
  *
  * @tree: The binary tree to operate on
  * @action: Function to be called for each node
+ *
+ * twalk(3) itself keeps no state between calls, but action() gets no user
+ * data so has to use globals for any of its own. ac_btree_foreach_data()
+ * should be used instead when action() may run in more than one thread.
  */
 void ac_btree_foreach(const ac_btree_t *tree,
 		      void (*action)(const void *nodep, VISIT which,
 				     int depth))
 {
+	rwlock_rdlock(tree->lock);
 	twalk(tree->rootp, action);
+	rwlock_unlock(tree->lock);
 }
 
 /**
@@ -84,7 +143,19 @@ void ac_btree_foreach_data(const ac_btree_t *tree,
 					  void *data),
 			   void *user_data)
 {
+	rwlock_rdlock(tree->lock);
 	twalk_r(tree->rootp, action, user_data);
+	rwlock_unlock(tree->lock);
+}
+
+static void *btree_lookup(const ac_btree_t *tree, const void *key)
+{
+	void *node = tfind(key, &tree->rootp, tree->compar);
+
+	if (!node)
+		return NULL;
+
+	return *(void **)node;
 }
 
 /**
@@ -99,12 +170,13 @@ void ac_btree_foreach_data(const ac_btree_t *tree,
  */
 void *ac_btree_lookup(const ac_btree_t *tree, const void *key)
 {
-	void *node = tfind(key, &tree->rootp, tree->compar);
+	void *node;
 
-	if (!node)
-		return NULL;
+	rwlock_rdlock(tree->lock);
+	node = btree_lookup(tree, key);
+	rwlock_unlock(tree->lock);
 
-	return *(void **)node;
+	return node;
 }
 
 /**
@@ -120,7 +192,13 @@ void *ac_btree_lookup(const ac_btree_t *tree, const void *key)
  */
 void *ac_btree_add(ac_btree_t *tree, const void *key)
 {
-	return *(void **)tsearch(key, &tree->rootp, tree->compar);
+	void *node;
+
+	rwlock_wrlock(tree->lock);
+	node = *(void **)tsearch(key, &tree->rootp, tree->compar);
+	rwlock_unlock(tree->lock);
+
+	return node;
 }
 
 /**
@@ -139,18 +217,27 @@ void *ac_btree_add(ac_btree_t *tree, const void *key)
  */
 void *ac_btree_remove(ac_btree_t *tree, const void *key)
 {
-	void *node = ac_btree_lookup(tree, key);
+	void *node;
 	void *pnode;
 
-	if (!node)
-		return NULL;
+	rwlock_wrlock(tree->lock);
+	node = btree_lookup(tree, key);
+	if (!node) {
+		pnode = NULL;
+		goto out_unlock;
+	}
 
 	pnode = tdelete(key, &tree->rootp, tree->compar);
 	tree->free_node(node);
 	if (!pnode || !tree->rootp)
-		return NULL;
+		pnode = NULL;
+	else
+		pnode = *(void **)pnode;
 
-	return *(void **)pnode;
+out_unlock:
+	rwlock_unlock(tree->lock);
+
+	return pnode;
 }
 
 /**
@@ -164,5 +251,11 @@ void *ac_btree_remove(ac_btree_t *tree, const void *key)
  */
 bool ac_btree_is_empty(const ac_btree_t *tree)
 {
-	return !tree->rootp;
+	bool empty;
+
+	rwlock_rdlock(tree->lock);
+	empty = __ac_btree_is_empty(tree);
+	rwlock_unlock(tree->lock);
+
+	return empty;
 }
@@ -18,6 +18,9 @@
 #include <string.h>
 
 #include "include/libac.h"
+#include "ac_alloc.h"
+#include "ac_sdt.h"
+#include "ac_lock.h"
 
 /* Buffer type; storing pointers or copying data */
 enum { PTR_BUF = 0, CPY_BUF };
@@ -29,7 +32,7 @@ enum { PTR_BUF = 0, CPY_BUF };
  */
 static inline u32 circ_count(const ac_circ_buf_t *cbuf)
 {
-	return ((cbuf->head - cbuf->tail) / cbuf->elem_sz) & (cbuf->size - 1);
+	return __ac_circ_buf_count(cbuf);
 }
 
 /*
@@ -77,41 +80,94 @@ static bool is_pow2(u32 val)
 }
 
 /**
- * ac_circ_buf_new - create a new circular buffer
+ * ac_circ_buf_new_with_allocator - create a new circular buffer
  *
  * @size: The required size of the buffer, must be a power of two
  * @elem_sz: The size of the individual elements being placed into
  *           the buffer. Set to 0 for the storing of pointers rather
  *           than copying the data.
+ * @alloc: The allocator to use for the buffer's memory, it is copied.
+ *         NULL for the default
  *
  * Returns:
  *
  * A pointer to a newly allocated buffer or NULL on failure
  */
-ac_circ_buf_t *ac_circ_buf_new(u32 size, u32 elem_sz)
+ac_circ_buf_t *ac_circ_buf_new_with_allocator(u32 size, u32 elem_sz,
+					      const ac_allocator_t *alloc)
 {
 	ac_circ_buf_t *cbuf;
 
 	if (!is_pow2(size))
 		return NULL;
 
-	cbuf = malloc(sizeof(ac_circ_buf_t));
+	cbuf = mem_alloc(alloc, sizeof(ac_circ_buf_t));
 	cbuf->head = cbuf->tail = 0;
 	cbuf->size = size;
+	cbuf->lock = NULL;
+	mem_set_allocator(&cbuf->alloc, alloc);
 
 	if (elem_sz == 0) {
 		cbuf->elem_sz = 1;
 		cbuf->type = PTR_BUF;
-		cbuf->buf.ptr_buf = malloc(size * sizeof(void *));
+		cbuf->buf.ptr_buf = mem_alloc(alloc, size * sizeof(void *));
 	} else {
 		cbuf->elem_sz = elem_sz;
 		cbuf->type = CPY_BUF;
-		cbuf->buf.cpy_buf = malloc((size_t)size * elem_sz);
+		cbuf->buf.cpy_buf = mem_alloc(alloc, (size_t)size * elem_sz);
 	}
 
 	return cbuf;
 }
 
+/**
+ * ac_circ_buf_new - create a new circular buffer
+ *
+ * @size: The required size of the buffer, must be a power of two
+ * @elem_sz: The size of the individual elements being placed into
+ *           the buffer. Set to 0 for the storing of pointers rather
+ *           than copying the data.
+ *
+ * Returns:
+ *
+ * A pointer to a newly allocated buffer or NULL on failure
+ */
+ac_circ_buf_t *ac_circ_buf_new(u32 size, u32 elem_sz)
+{
+	return ac_circ_buf_new_with_allocator(size, elem_sz, NULL);
+}
+
+/**
+ * ac_circ_buf_set_thread_safe - make a buffer safe to share between threads
+ *
+ * @cbuf: The circular buffer to work on
+ *
+ * After this the buffer is protected by a mutex, items can be pushed and
+ * popped from any number of threads. It must be called before the buffer
+ * is shared and lasts for its lifetime.
+ *
+ * With a buffer that copies data, the pointer returned by ac_circ_buf_pop()
+ * is into the buffer and can be overwritten by a push from another thread,
+ * use ac_circ_buf_popm() to copy the item out instead.
+ *
+ * ac_circ_buf_foreach()'s action is called with the mutex held and must not
+ * call back into the buffer.
+ *
+ * The allocator isn't called again until ac_circ_buf_destroy(), so it
+ * doesn't need to be thread-safe.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno (ENOMEM)
+ */
+int ac_circ_buf_set_thread_safe(ac_circ_buf_t *cbuf)
+{
+	if (!cbuf->lock)
+		cbuf->lock = mutex_new(&cbuf->alloc);
+
+	return cbuf->lock ? 0 : -1;
+}
+
 /**
  * ac_circ_buf_count - how many items are in the buffer
  *
@@ -123,7 +179,13 @@ ac_circ_buf_t *ac_circ_buf_new(u32 size, u32 elem_sz)
  */
 u32 ac_circ_buf_count(const ac_circ_buf_t *cbuf)
 {
-	return circ_count(cbuf);
+	u32 count;
+
+	mutex_lock(cbuf->lock);
+	count = circ_count(cbuf);
+	mutex_unlock(cbuf->lock);
+
+	return count;
 }
 
 /**
@@ -139,11 +201,15 @@ u32 ac_circ_buf_count(const ac_circ_buf_t *cbuf)
  */
 int ac_circ_buf_pushm(ac_circ_buf_t *cbuf, const void *buf, u32 count)
 {
+	mutex_lock(cbuf->lock);
 	if (circ_space_to_end(cbuf) < count) {
-		if (circ_count(cbuf) == 0 && count <= cbuf->size)
+		if (circ_count(cbuf) == 0 && count <= cbuf->size) {
 			cbuf->head = cbuf->tail = 0;
-		else
+		} else {
+			mutex_unlock(cbuf->lock);
+			AC_PROBE2(circ_buf_full, cbuf, count);
 			return -1;
+		}
 	}
 
 	if (cbuf->type == PTR_BUF)
@@ -155,6 +221,7 @@ int ac_circ_buf_pushm(ac_circ_buf_t *cbuf, const void *buf, u32 count)
 
 	cbuf->head = (cbuf->head + (count * cbuf->elem_sz)) &
 		     ((cbuf->size - 1) * cbuf->elem_sz);
+	mutex_unlock(cbuf->lock);
 
 	return 0;
 }
@@ -171,8 +238,12 @@ int ac_circ_buf_pushm(ac_circ_buf_t *cbuf, const void *buf, u32 count)
  */
 int ac_circ_buf_push(ac_circ_buf_t *cbuf, const void *buf)
 {
-	if (circ_space(cbuf) == 0)
+	mutex_lock(cbuf->lock);
+	if (circ_space(cbuf) == 0) {
+		mutex_unlock(cbuf->lock);
+		AC_PROBE2(circ_buf_full, cbuf, 1);
 		return -1;
+	}
 
 	if (cbuf->type == PTR_BUF)
 		cbuf->buf.ptr_buf[cbuf->head] = (void *)buf;
@@ -181,6 +252,7 @@ int ac_circ_buf_push(ac_circ_buf_t *cbuf, const void *buf)
 
 	cbuf->head = (cbuf->head + cbuf->elem_sz) &
 		     ((cbuf->size - 1) * cbuf->elem_sz);
+	mutex_unlock(cbuf->lock);
 
 	return 0;
 }
@@ -198,8 +270,12 @@ int ac_circ_buf_push(ac_circ_buf_t *cbuf, const void *buf)
  */
 int ac_circ_buf_popm(ac_circ_buf_t *cbuf, void *buf, u32 count)
 {
-	if (circ_count_to_end(cbuf) < count)
+	mutex_lock(cbuf->lock);
+	if (circ_count_to_end(cbuf) < count) {
+		mutex_unlock(cbuf->lock);
+		AC_PROBE2(circ_buf_empty, cbuf, count);
 		return -1;
+	}
 
 	if (cbuf->type == PTR_BUF)
 		memcpy(buf, cbuf->buf.ptr_buf + cbuf->tail,
@@ -210,6 +286,7 @@ int ac_circ_buf_popm(ac_circ_buf_t *cbuf, void *buf, u32 count)
 
 	cbuf->tail = (cbuf->tail + (count * cbuf->elem_sz)) &
 		     ((cbuf->size - 1) * cbuf->elem_sz);
+	mutex_unlock(cbuf->lock);
 
 	return 0;
 }
@@ -227,8 +304,12 @@ void *ac_circ_buf_pop(ac_circ_buf_t *cbuf)
 {
 	void *item;
 
-	if (circ_count(cbuf) == 0)
+	mutex_lock(cbuf->lock);
+	if (circ_count(cbuf) == 0) {
+		mutex_unlock(cbuf->lock);
+		AC_PROBE2(circ_buf_empty, cbuf, 1);
 		return NULL;
+	}
 
 	if (cbuf->type == PTR_BUF)
 		item = cbuf->buf.ptr_buf[cbuf->tail];
@@ -237,6 +318,7 @@ void *ac_circ_buf_pop(ac_circ_buf_t *cbuf)
 
 	cbuf->tail = (cbuf->tail + cbuf->elem_sz) &
 		     ((cbuf->size - 1) * cbuf->elem_sz);
+	mutex_unlock(cbuf->lock);
 
 	return item;
 }
@@ -253,11 +335,10 @@ void ac_circ_buf_foreach(const ac_circ_buf_t *cbuf,
 			 void *user_data)
 {
 	u32 i;
-	u32 count = circ_count(cbuf);
-
-	if (count == 0)
-		return;
+	u32 count;
 
+	mutex_lock(cbuf->lock);
+	count = circ_count(cbuf);
 	for (i = 0; i < count; i++) {
 		u32 k;
 
@@ -269,6 +350,7 @@ void ac_circ_buf_foreach(const ac_circ_buf_t *cbuf,
 		else
 			action(cbuf->buf.cpy_buf + k, user_data);
 	}
+	mutex_unlock(cbuf->lock);
 }
 
 /**
@@ -278,7 +360,9 @@ void ac_circ_buf_foreach(const ac_circ_buf_t *cbuf,
  */
 void ac_circ_buf_reset(ac_circ_buf_t *cbuf)
 {
+	mutex_lock(cbuf->lock);
 	cbuf->head = cbuf->tail = 0;
+	mutex_unlock(cbuf->lock);
 }
 
 /**
@@ -289,8 +373,11 @@ void ac_circ_buf_reset(ac_circ_buf_t *cbuf)
 void ac_circ_buf_destroy(const ac_circ_buf_t *cbuf)
 {
 	if (cbuf->type == PTR_BUF)
-		free(cbuf->buf.ptr_buf);
+		mem_free(&cbuf->alloc, cbuf->buf.ptr_buf,
+			 cbuf->size * sizeof(void *));
 	else
-		free(cbuf->buf.cpy_buf);
-	free((void *)cbuf);
+		mem_free(&cbuf->alloc, cbuf->buf.cpy_buf,
+			 (size_t)cbuf->size * cbuf->elem_sz);
+	mutex_destroy(&cbuf->alloc, cbuf->lock);
+	mem_free(&cbuf->alloc, (void *)cbuf, sizeof(ac_circ_buf_t));
 }
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_cpu.c - Runtime CPU feature dispatch
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ac_cpu.h"
+
+struct cpu_kernels cpu_kernels = {
+	.json_escape_span = json_escape_span_generic,
+};
+
+static const char *cpu_level_names[] = {
+	[CPU_GENERIC]	= "generic",
+	[CPU_SSE2]	= "sse2",
+	[CPU_AVX2]	= "avx2",
+	[CPU_AVX512]	= "avx512",
+};
+
+size_t json_escape_span_generic(const char *str, size_t len)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (s[i] < 0x20 || s[i] == '"' || s[i] == '\\')
+			break;
+	}
+
+	return i;
+}
+
+/* The best level the CPU (and compiler) supports */
+enum cpu_level cpu_detect(void)
+{
+#ifdef __x86_64__
+	__builtin_cpu_init();
+#ifdef AC_HAVE_AVX512
+	if (__builtin_cpu_supports("avx512f") &&
+	    __builtin_cpu_supports("avx512bw"))
+		return CPU_AVX512;
+#endif
+	if (__builtin_cpu_supports("avx2"))
+		return CPU_AVX2;
+
+	/* Part of the x86_64 baseline */
+	return CPU_SSE2;
+#else
+	return CPU_GENERIC;
+#endif
+}
+
+/* Use the given level's kernels, it must be <= cpu_detect() */
+void cpu_set_level(enum cpu_level level)
+{
+	switch (level) {
+#ifdef __x86_64__
+#ifdef AC_HAVE_AVX512
+	case CPU_AVX512:
+		cpu_kernels.json_escape_span = json_escape_span_avx512;
+		break;
+#endif
+	case CPU_AVX2:
+		cpu_kernels.json_escape_span = json_escape_span_avx2;
+		break;
+	case CPU_SSE2:
+		cpu_kernels.json_escape_span = json_escape_span_sse2;
+		break;
+#endif
+	default:
+		cpu_kernels.json_escape_span = json_escape_span_generic;
+	}
+}
+
+const char *cpu_level_name(enum cpu_level level)
+{
+	return cpu_level_names[level];
+}
+
+/*
+ * LIBAC_CPU can be set to one of the cpu_level_names to use that level's
+ * kernels instead, for testing them. Only a level at or below what the
+ * CPU supports is honoured.
+ */
+static void __attribute__((constructor)) cpu_dispatch_init(void)
+{
+	enum cpu_level level = cpu_detect();
+	const char *env = getenv("LIBAC_CPU");
+
+	if (env) {
+		int i;
+
+		for (i = CPU_GENERIC; i < (int)level; i++) {
+			if (strcmp(env, cpu_level_names[i]) == 0) {
+				level = i;
+				break;
+			}
+		}
+	}
+
+	cpu_set_level(level);
+}
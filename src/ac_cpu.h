@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_cpu.h - Runtime CPU feature dispatch
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#ifndef _AC_CPU_H_
+#define _AC_CPU_H_
+
+#include <stddef.h>
+
+/*
+ * Kernels that have SIMD variants are called through cpu_kernels. It
+ * starts out pointing at the generic versions and is switched to the best
+ * ones the CPU supports by a constructor in ac_cpu.c.
+ *
+ * The variants live in arch/<machine>/cpu_<level>.c and are built with the
+ * matching -m flags (see src/Makefile), so must only be called via here.
+ */
+enum cpu_level {
+	CPU_GENERIC,
+	CPU_SSE2,
+	CPU_AVX2,
+	CPU_AVX512,
+};
+
+struct cpu_kernels {
+	/* Length of the leading run of str that needs no JSON escaping */
+	size_t (*json_escape_span)(const char *str, size_t len);
+};
+
+extern struct cpu_kernels cpu_kernels;
+
+/* For testing each level's kernels */
+extern enum cpu_level cpu_detect(void);
+extern void cpu_set_level(enum cpu_level level);
+extern const char *cpu_level_name(enum cpu_level level);
+
+extern size_t json_escape_span_generic(const char *str, size_t len);
+#ifdef __x86_64__
+extern size_t json_escape_span_sse2(const char *str, size_t len);
+extern size_t json_escape_span_avx2(const char *str, size_t len);
+#ifdef AC_HAVE_AVX512
+extern size_t json_escape_span_avx512(const char *str, size_t len);
+#endif
+#endif
+
+#endif /* _AC_CPU_H_ */
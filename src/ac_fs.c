@@ -20,6 +20,7 @@
 
 #include "include/libac.h"
 #include "platform.h"
+#include "ac_sdt.h"
 
 /**
  * ac_fs_is_posix_name - checks if a filename follows POSIX guidelines
@@ -158,11 +159,14 @@ ssize_t ac_fs_copy(const char *from, const char *to, int flags)
 		 */
 		goto cleanup;
 
+	AC_PROBE3(fs_copy_start, from, to, sb.st_size);
 	bytes_wrote = file_copy(ifd, ofd);
 
 cleanup:
 	close(ifd);
 	close(ofd);
 
+	AC_PROBE3(fs_copy_done, from, to, bytes_wrote);
+
 	return bytes_wrote;
 }
@@ -10,13 +10,25 @@
 #define _GNU_SOURCE
 
 #include <stdlib.h>		/* abs(3) */
+#include <string.h>
+#include <errno.h>
 #include <math.h>
+#include <pthread.h>
+#ifdef __BMI2__
+#include <immintrin.h>		/* _pdep_u64(), _pext_u64() */
+#endif
 
 #include "include/libac.h"
 
 #define DEG_TO_RAD		(M_PI/180)
 #define RAD_TO_DEG		(180/M_PI)
 
+/* Eccentricity squared */
+#define ECC2(a, b)		(1 - ((b)*(b)) / ((a)*(a)))
+
+#define AIRY1830_A		6377563.396
+#define AIRY1830_B		6356256.909
+
 struct ellipsoid {
 	const char *shape;
 	/* Equatorial radius in meters */
@@ -25,13 +37,18 @@ struct ellipsoid {
 	const double b;
 	/* Inverse flattening */
 	const double f;
+	/* Eccentricity squared */
+	const double e2;
 };
 
 static const struct ellipsoid ellipsoids[] = {
-	{ "WGS84", 6378137.0, 6356752.314245, 298.257223563 },
-	{ "GRS80", 6378137.0, 6356752.314140, 298.257222100882711 },
-	{ "AIRY1830", 6377563.396, 6356256.909, 299.3249646 },
-	{ NULL, 0.0, 0.0, 0.0 }
+	{ "WGS84", 6378137.0, 6356752.314245, 298.257223563,
+	  ECC2(6378137.0, 6356752.314245) },
+	{ "GRS80", 6378137.0, 6356752.314140, 298.257222100882711,
+	  ECC2(6378137.0, 6356752.314140) },
+	{ "AIRY1830", AIRY1830_A, AIRY1830_B, 299.3249646,
+	  ECC2(AIRY1830_A, AIRY1830_B) },
+	{ NULL, 0.0, 0.0, 0.0, 0.0 }
 };
 
 /**
@@ -68,6 +85,261 @@ double ac_geo_dms_to_dd(const ac_geo_dms_t *dms)
 	return dms->degrees + (dms->minutes/60.0) + (dms->seconds/3600.0);
 }
 
+/*
+ * Latitude & longitude are quantised to 32 bits each, with the two then
+ * being bit interleaved (longitude taking the higher bit of each pair)
+ * into a 64 bit Morton code.
+ *
+ * This is the same bit ordering used by geohash, so a geohash is simply
+ * the base32 encoding of the top 5 * precision bits of the Morton code.
+ */
+#define GEO_Q_SCALE		4294967296.0	/* 2^32 */
+#define GEOHASH_BITS_PER_CHAR	5
+
+static const char geohash_base32[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+static inline u64 bits_spread(u32 x)
+{
+#ifdef __BMI2__
+	return _pdep_u64(x, 0x5555555555555555ULL);
+#else
+	u64 v = x;
+
+	v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+	v = (v | (v << 8))  & 0x00ff00ff00ff00ffULL;
+	v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0fULL;
+	v = (v | (v << 2))  & 0x3333333333333333ULL;
+	v = (v | (v << 1))  & 0x5555555555555555ULL;
+
+	return v;
+#endif
+}
+
+static inline u32 bits_compact(u64 v)
+{
+#ifdef __BMI2__
+	return _pext_u64(v, 0x5555555555555555ULL);
+#else
+	v &= 0x5555555555555555ULL;
+	v = (v | (v >> 1))  & 0x3333333333333333ULL;
+	v = (v | (v >> 2))  & 0x0f0f0f0f0f0f0f0fULL;
+	v = (v | (v >> 4))  & 0x00ff00ff00ff00ffULL;
+	v = (v | (v >> 8))  & 0x0000ffff0000ffffULL;
+	v = (v | (v >> 16)) & 0x00000000ffffffffULL;
+
+	return v;
+#endif
+}
+
+static u32 geo_quantise(double val, double min, double range)
+{
+	double q = (val - min) * (GEO_Q_SCALE / range);
+
+	/* Written this way round so NaN also ends up as 0 */
+	if (!(q > 0.0))
+		return 0;
+	if (q >= GEO_Q_SCALE)
+		return 0xffffffff;
+
+	return q;
+}
+
+static inline u64 morton_from_q(u32 lat_q, u32 lon_q)
+{
+	return (bits_spread(lon_q) << 1) | bits_spread(lat_q);
+}
+
+static char *geohash_from_morton(u64 code, int precision, char *dst)
+{
+	int i;
+
+	for (i = 0; i < precision; i++)
+		dst[i] = geohash_base32[(code >> (59 - i*GEOHASH_BITS_PER_CHAR)) &
+					0x1f];
+	dst[i] = '\0';
+
+	return dst;
+}
+
+static int geohash_to_morton(const char *hash, u64 *code)
+{
+	int i;
+
+	*code = 0;
+	for (i = 0; hash[i] != '\0'; i++) {
+		const char *p;
+
+		if (i == AC_GEO_GEOHASH_MAX_LEN)
+			return -1;
+
+		p = memchr(geohash_base32, hash[i], sizeof(geohash_base32) - 1);
+		if (!p)
+			return -1;
+
+		*code |= (u64)(p - geohash_base32) <<
+			 (59 - i*GEOHASH_BITS_PER_CHAR);
+	}
+
+	return i > 0 ? i : -1;
+}
+
+/**
+ * ac_geo_morton_encode - encode a latitude & longitude as a Morton code
+ *
+ * @geo: Contains the latitude & longitude to encode
+ *
+ * The latitude & longitude are each quantised to 32 bits and then bit
+ * interleaved. Points that are close together generally have codes that
+ * are close together, so sorting on the code gives a good spatial
+ * locality and the code (or a prefix of it) makes a good hash key for
+ * spatial bucketing.
+ *
+ * The top bits of the code are the same as those of the geohash of the
+ * point.
+ *
+ * Out of range coordinates are clamped to the nearest edge and a NaN is
+ * treated as the minimum (-90° / -180°).
+ *
+ * Returns:
+ *
+ * A u64 containing the Morton code
+ */
+u64 ac_geo_morton_encode(const ac_geo_t *geo)
+{
+	return morton_from_q(geo_quantise(geo->lat, -90.0, 180.0),
+			     geo_quantise(geo->lon, -180.0, 360.0));
+}
+
+/**
+ * ac_geo_morton_decode - decode a Morton code to a latitude & longitude
+ *
+ * @code: The Morton code to decode
+ * @geo: Filled out with the latitude & longitude of the centre of the cell
+ */
+void ac_geo_morton_decode(u64 code, ac_geo_t *geo)
+{
+	geo->lat = ((double)bits_compact(code) + 0.5) * (180.0/GEO_Q_SCALE) -
+		90.0;
+	geo->lon = ((double)bits_compact(code >> 1) + 0.5) *
+		(360.0/GEO_Q_SCALE) - 180.0;
+}
+
+/**
+ * ac_geo_geohash_encode - encode a latitude & longitude as a geohash
+ *
+ * @geo: Contains the latitude & longitude to encode
+ * @precision: The length of the geohash, 1 - AC_GEO_GEOHASH_MAX_LEN
+ * @dst: A buffer of at least precision + 1 bytes to store the geohash
+ *
+ * https://en.wikipedia.org/wiki/Geohash
+ *
+ * Out of range & NaN coordinates are handled as per ac_geo_morton_encode()
+ *
+ * Returns:
+ *
+ * A pointer to the nul terminated geohash in dst or NULL if precision is
+ * out of range
+ */
+char *ac_geo_geohash_encode(const ac_geo_t *geo, int precision, char *dst)
+{
+	if (precision < 1 || precision > AC_GEO_GEOHASH_MAX_LEN) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return geohash_from_morton(ac_geo_morton_encode(geo), precision, dst);
+}
+
+/**
+ * ac_geo_geohash_decode - decode a geohash to a latitude & longitude
+ *
+ * @hash: The geohash to decode
+ * @geo: Filled out with the latitude & longitude of the centre of the cell
+ *
+ * Returns:
+ *
+ * 0 on success or -1 if the geohash is invalid
+ */
+int ac_geo_geohash_decode(const char *hash, ac_geo_t *geo)
+{
+	u64 code;
+	int bits;
+	int lat_bits;
+	int lon_bits;
+
+	bits = geohash_to_morton(hash, &code);
+	if (bits == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+	bits *= GEOHASH_BITS_PER_CHAR;
+	lat_bits = bits / 2;
+	lon_bits = bits - lat_bits;
+
+	geo->lat = (double)bits_compact(code) * (180.0/GEO_Q_SCALE) - 90.0 +
+		ldexp(180.0, -lat_bits) / 2;
+	geo->lon = (double)bits_compact(code >> 1) * (360.0/GEO_Q_SCALE) -
+		180.0 + ldexp(360.0, -lon_bits) / 2;
+
+	return 0;
+}
+
+/**
+ * ac_geo_geohash_neighbours - get the eight cells surrounding a geohash
+ *
+ * @hash: The geohash to find the neighbours of
+ * @neighbours: Filled out with the neighbouring geohashes in the order;
+ *		N, NE, E, SE, S, SW, W, NW
+ *
+ * Longitude wraps around at the anti-meridian. Cells beyond the poles
+ * don't exist and are returned as empty strings.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 if the geohash is invalid
+ */
+int ac_geo_geohash_neighbours(const char *hash,
+			      char neighbours[8][AC_GEO_GEOHASH_MAX_LEN + 1])
+{
+	static const int offsets[8][2] = {
+		{ 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 },
+		{ -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 }
+	};
+	u64 code;
+	s64 lat_idx;
+	s64 lon_idx;
+	int precision;
+	int lat_bits;
+	int lon_bits;
+	int i;
+
+	precision = geohash_to_morton(hash, &code);
+	if (precision == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+	lat_bits = precision * GEOHASH_BITS_PER_CHAR / 2;
+	lon_bits = precision * GEOHASH_BITS_PER_CHAR - lat_bits;
+	lat_idx = bits_compact(code) >> (32 - lat_bits);
+	lon_idx = bits_compact(code >> 1) >> (32 - lon_bits);
+
+	for (i = 0; i < 8; i++) {
+		s64 lat = lat_idx + offsets[i][0];
+		s64 lon = (lon_idx + offsets[i][1]) & ((1LL << lon_bits) - 1);
+
+		if (lat < 0 || lat >= (1LL << lat_bits)) {
+			neighbours[i][0] = '\0';
+			continue;
+		}
+
+		geohash_from_morton(morton_from_q(lat << (32 - lat_bits),
+						  lon << (32 - lon_bits)),
+				    precision, neighbours[i]);
+	}
+
+	return 0;
+}
+
 /**
  * ac_geo_haversine - calculate the distance between two points on Earth
  *
@@ -103,6 +375,413 @@ double ac_geo_haversine(const ac_geo_t *from, const ac_geo_t *to)
 		ellipsoids[from->ref].a;
 }
 
+/*
+ * The k-d tree stores each point as a unit vector in 3D space. The
+ * straight line (chord) distance between two such vectors increases
+ * monotonically with the great circle distance between the points, so
+ * we can prune & compare on squared chord distance (no trigonometry) and
+ * only convert to meters for the points we actually return.
+ *
+ * The tree is implicit; points are ordered such that for the range
+ * [lo, hi) the median element at (lo + hi) / 2 splits the range on the
+ * axis for that depth (x, y, z in turn). Ranges of KDTREE_LEAF_SZ or
+ * fewer points are left unsorted and scanned linearly.
+ */
+#define KDTREE_LEAF_SZ		16
+
+struct kdtree_heap_elem {
+	double d2;
+	size_t idx;
+};
+
+struct kdtree_query {
+	const ac_geo_kdtree_t *tree;
+	double q[3];
+
+	/* Radius search */
+	double r2;
+	double radius;
+	void (*action)(size_t idx, double distance, void *user_data);
+	void *user_data;
+	size_t found;
+
+	/* k-nearest search; a max-heap on d2 */
+	struct kdtree_heap_elem *heap;
+	size_t k;
+	size_t nr;
+};
+
+static inline void geo_to_unit_vec(const ac_geo_t *geo, double *v)
+{
+	double lat = geo->lat * DEG_TO_RAD;
+	double lon = geo->lon * DEG_TO_RAD;
+
+	v[0] = cos(lat) * cos(lon);
+	v[1] = cos(lat) * sin(lon);
+	v[2] = sin(lat);
+}
+
+static inline double unit_vec_dist2(const double *a, const double *b)
+{
+	double dx = a[0] - b[0];
+	double dy = a[1] - b[1];
+	double dz = a[2] - b[2];
+
+	return dx*dx + dy*dy + dz*dz;
+}
+
+static inline double chord2_to_meters(double d2, double radius)
+{
+	return 2.0 * asin(AC_MIN(sqrt(d2) / 2.0, 1.0)) * radius;
+}
+
+static inline void kdtree_swap(ac_geo_kdtree_t *tree, size_t i, size_t j)
+{
+	double tmp[3];
+	size_t idx = tree->idx[i];
+
+	memcpy(tmp, tree->coords + i*3, sizeof(tmp));
+	memcpy(tree->coords + i*3, tree->coords + j*3, sizeof(tmp));
+	memcpy(tree->coords + j*3, tmp, sizeof(tmp));
+	tree->idx[i] = tree->idx[j];
+	tree->idx[j] = idx;
+}
+
+static inline double median3(double a, double b, double c)
+{
+	if (a > b)
+		return (b > c) ? b : (a > c) ? c : a;
+
+	return (a > c) ? a : (b > c) ? c : b;
+}
+
+/*
+ * Partially sort [lo, hi] such that the k'th element is in its sorted
+ * position for the given axis, with everything before it <= and
+ * everything after it >=
+ *
+ * This uses a three-way partition so that runs of duplicate points don't
+ * send it quadratic.
+ */
+static void kdtree_select(ac_geo_kdtree_t *tree, size_t lo, size_t hi,
+			  size_t k, int axis)
+{
+	const double *c = tree->coords;
+
+	while (hi > lo) {
+		size_t lt = lo;
+		size_t gt = hi;
+		size_t i = lo;
+		double pivot = median3(c[lo*3 + axis],
+				       c[(lo + (hi - lo) / 2)*3 + axis],
+				       c[hi*3 + axis]);
+
+		while (i <= gt) {
+			double v = c[i*3 + axis];
+
+			if (v < pivot)
+				kdtree_swap(tree, lt++, i++);
+			else if (v > pivot)
+				kdtree_swap(tree, i, gt--);
+			else
+				i++;
+		}
+
+		if (k < lt)
+			hi = lt - 1;
+		else if (k > gt)
+			lo = gt + 1;
+		else
+			return;
+	}
+}
+
+static void kdtree_build(ac_geo_kdtree_t *tree, size_t lo, size_t hi,
+			 int axis)
+{
+	size_t mid;
+
+	if (hi - lo <= KDTREE_LEAF_SZ)
+		return;
+
+	mid = lo + (hi - lo) / 2;
+	kdtree_select(tree, lo, hi - 1, mid, axis);
+
+	axis = (axis + 1) % 3;
+	kdtree_build(tree, lo, mid, axis);
+	kdtree_build(tree, mid + 1, hi, axis);
+}
+
+static void kdtree_heap_sift_down(struct kdtree_heap_elem *heap, size_t nr,
+				  size_t i)
+{
+	for ( ; ; ) {
+		size_t l = 2*i + 1;
+		size_t r = l + 1;
+		size_t largest = i;
+		struct kdtree_heap_elem tmp;
+
+		if (l < nr && heap[l].d2 > heap[largest].d2)
+			largest = l;
+		if (r < nr && heap[r].d2 > heap[largest].d2)
+			largest = r;
+		if (largest == i)
+			return;
+
+		tmp = heap[i];
+		heap[i] = heap[largest];
+		heap[largest] = tmp;
+		i = largest;
+	}
+}
+
+static void kdtree_heap_push(struct kdtree_query *kq, double d2, size_t idx)
+{
+	struct kdtree_heap_elem *heap = kq->heap;
+	size_t i;
+
+	if (kq->nr == kq->k) {
+		if (d2 >= heap[0].d2)
+			return;
+		heap[0].d2 = d2;
+		heap[0].idx = idx;
+		kdtree_heap_sift_down(heap, kq->nr, 0);
+		return;
+	}
+
+	i = kq->nr++;
+	heap[i].d2 = d2;
+	heap[i].idx = idx;
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		struct kdtree_heap_elem tmp;
+
+		if (heap[parent].d2 >= heap[i].d2)
+			break;
+		tmp = heap[i];
+		heap[i] = heap[parent];
+		heap[parent] = tmp;
+		i = parent;
+	}
+}
+
+static void kdtree_visit(struct kdtree_query *kq, size_t i)
+{
+	const double *c = kq->tree->coords + i*3;
+	double d2 = unit_vec_dist2(kq->q, c);
+
+	if (kq->heap) {
+		kdtree_heap_push(kq, d2, kq->tree->idx[i]);
+		return;
+	}
+
+	if (d2 > kq->r2)
+		return;
+	if (kq->action)
+		kq->action(kq->tree->idx[i], chord2_to_meters(d2, kq->radius),
+			   kq->user_data);
+	kq->found++;
+}
+
+static void kdtree_search(struct kdtree_query *kq, size_t lo, size_t hi,
+			  int axis)
+{
+	size_t mid;
+	double d;
+	double bound;
+
+	if (hi - lo <= KDTREE_LEAF_SZ) {
+		for ( ; lo < hi; lo++)
+			kdtree_visit(kq, lo);
+		return;
+	}
+
+	mid = lo + (hi - lo) / 2;
+	kdtree_visit(kq, mid);
+
+	d = kq->q[axis] - kq->tree->coords[mid*3 + axis];
+	axis = (axis + 1) % 3;
+
+	/* Search the side the query point is on first */
+	if (d < 0.0)
+		kdtree_search(kq, lo, mid, axis);
+	else
+		kdtree_search(kq, mid + 1, hi, axis);
+
+	if (kq->heap)
+		bound = (kq->nr < kq->k) ? INFINITY : kq->heap[0].d2;
+	else
+		bound = kq->r2;
+	/* Only cross the splitting plane if it's within range */
+	if (d*d > bound)
+		return;
+
+	if (d < 0.0)
+		kdtree_search(kq, mid + 1, hi, axis);
+	else
+		kdtree_search(kq, lo, mid, axis);
+}
+
+/**
+ * ac_geo_kdtree_new - create a static k-d tree spatial index of points
+ *
+ * @points: An array of points (latitude & longitude) to index
+ * @nmemb: The number of points in the array
+ *
+ * The tree is bulk loaded from the given points and can't be modified
+ * afterwards. Query results are given as indexes into @points, which
+ * isn't referenced by the tree after this function returns.
+ *
+ * Returns:
+ *
+ * A pointer to the newly created tree or NULL on failure. Should be free'd
+ * with ac_geo_kdtree_destroy()
+ */
+ac_geo_kdtree_t *ac_geo_kdtree_new(const ac_geo_t *points, size_t nmemb)
+{
+	ac_geo_kdtree_t *tree;
+	size_t i;
+
+	tree = malloc(sizeof(ac_geo_kdtree_t));
+	if (!tree)
+		return NULL;
+
+	tree->coords = malloc(nmemb * 3 * sizeof(double));
+	tree->idx = malloc(nmemb * sizeof(size_t));
+	if (!tree->coords || !tree->idx) {
+		ac_geo_kdtree_destroy(tree);
+		return NULL;
+	}
+	tree->nmemb = nmemb;
+
+	for (i = 0; i < nmemb; i++) {
+		geo_to_unit_vec(points + i, tree->coords + i*3);
+		tree->idx[i] = i;
+	}
+
+	kdtree_build(tree, 0, nmemb, 0);
+
+	return tree;
+}
+
+/**
+ * ac_geo_kdtree_radius - find all points within a given distance
+ *
+ * @tree: The tree to search
+ * @centre: The latitude & longitude to search around. Its ellipsoid is
+ *          used to convert between angles and meters
+ * @radius: The search radius in meters
+ * @action: Called for each point found with the index of the point in the
+ *          original array, its distance in meters from @centre and the
+ *          optional user data. Points are found in no particular order.
+ *          Can be NULL to just count the points
+ * @user_data: Optional pointer to data to pass to @action
+ *
+ * Distances are calculated as per ac_geo_haversine()
+ *
+ * Returns:
+ *
+ * The number of points found
+ */
+size_t ac_geo_kdtree_radius(const ac_geo_kdtree_t *tree,
+			    const ac_geo_t *centre, double radius,
+			    void (*action)(size_t idx, double distance,
+					   void *user_data),
+			    void *user_data)
+{
+	struct kdtree_query kq = {
+		.tree = tree,
+		.radius = ellipsoids[centre->ref].a,
+		.action = action,
+		.user_data = user_data
+	};
+	double angle = radius / kq.radius;
+
+	if (radius < 0.0 || tree->nmemb == 0)
+		return 0;
+
+	/* Convert the radius into a squared chord length */
+	if (angle >= M_PI) {
+		kq.r2 = INFINITY;
+	} else {
+		kq.r2 = 2.0 * sin(angle / 2.0);
+		kq.r2 *= kq.r2;
+	}
+	geo_to_unit_vec(centre, kq.q);
+
+	kdtree_search(&kq, 0, tree->nmemb, 0);
+
+	return kq.found;
+}
+
+/**
+ * ac_geo_kdtree_nearest - find the k nearest points
+ *
+ * @tree: The tree to search
+ * @centre: The latitude & longitude to search around. Its ellipsoid is
+ *          used to convert between angles and meters
+ * @k: The number of points to find
+ * @idx: An array of at least @k elements, filled out with the indexes of
+ *       the found points in the original array, nearest first
+ * @distance: Optional array of at least @k elements, filled out with the
+ *            distance in meters of each found point from @centre. Can be
+ *            NULL
+ *
+ * Distances are calculated as per ac_geo_haversine()
+ *
+ * Returns:
+ *
+ * The number of points found; the lesser of @k and the number of points in
+ * the tree, or -1 on failure
+ */
+ssize_t ac_geo_kdtree_nearest(const ac_geo_kdtree_t *tree,
+			      const ac_geo_t *centre, size_t k, size_t *idx,
+			      double *distance)
+{
+	struct kdtree_query kq = { .tree = tree };
+	size_t i;
+
+	k = AC_MIN(k, tree->nmemb);
+	if (k == 0)
+		return 0;
+
+	kq.heap = malloc(k * sizeof(struct kdtree_heap_elem));
+	if (!kq.heap)
+		return -1;
+	kq.k = k;
+	geo_to_unit_vec(centre, kq.q);
+
+	kdtree_search(&kq, 0, tree->nmemb, 0);
+
+	/* Pop the max-heap from the back to get nearest first */
+	for (i = kq.nr; i > 0; i--) {
+		idx[i - 1] = kq.heap[0].idx;
+		if (distance)
+			distance[i - 1] = chord2_to_meters(kq.heap[0].d2,
+						ellipsoids[centre->ref].a);
+		kq.heap[0] = kq.heap[i - 1];
+		kdtree_heap_sift_down(kq.heap, i - 1, 0);
+	}
+	free(kq.heap);
+
+	return k;
+}
+
+/**
+ * ac_geo_kdtree_destroy - destroy a k-d tree
+ *
+ * @tree: The tree to destroy
+ */
+void ac_geo_kdtree_destroy(const ac_geo_kdtree_t *tree)
+{
+	if (!tree)
+		return;
+
+	free(tree->coords);
+	free(tree->idx);
+	free((void *)tree);
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeclaration-after-statement"
 /**
@@ -238,50 +917,134 @@ void ac_geo_vincenty_direct(const ac_geo_t *from, ac_geo_t *to,
 #define E0		400000
 #define N0		(-100000)
 #define F0		0.9996012717
+
+/*
+ * Constants for the British National Grid transforms. These are all
+ * constant expressions and so are computed at compile time rather than
+ * on each conversion.
+ */
+#define AIRY1830_N	((AIRY1830_A - AIRY1830_B) / (AIRY1830_A + AIRY1830_B))
+#define AIRY1830_N2	(AIRY1830_N * AIRY1830_N)
+#define AIRY1830_N3	(AIRY1830_N2 * AIRY1830_N)
+
+static const struct {
+	double a;
+	double b;
+	double e2;
+	/* Meridional arc series coefficients */
+	double ma;
+	double mb;
+	double mc;
+	double md;
+} airy1830 = {
+	.a = AIRY1830_A,
+	.b = AIRY1830_B,
+	.e2 = ECC2(AIRY1830_A, AIRY1830_B),
+	.ma = 1.0 + AIRY1830_N + (5.0/4)*AIRY1830_N2 + (5.0/4)*AIRY1830_N3,
+	.mb = 3.0*AIRY1830_N + 3.0*AIRY1830_N2 + (21.0/8)*AIRY1830_N3,
+	.mc = (15.0/8)*AIRY1830_N2 + (15.0/8)*AIRY1830_N3,
+	.md = (35.0/24)*AIRY1830_N3
+};
+
+/* Seconds of arc to radians */
+#define ARCSEC_TO_RAD(s)	((s)*M_PI / (180*3600.0))
+
+/*
+ * Helmert transform parameters between Airy 1830 (OSGB36) and
+ * WGS84/GRS80. The reverse transform simply negates them.
+ */
+struct helmert {
+	double s;
+	double tx, ty, tz;
+	double rx, ry, rz;
+};
+
+static const struct helmert helmert_airy_to_wgs84 = {
+	.s = -20.4894e-6,
+	.tx = 446.448, .ty = -125.157, .tz = 542.060,
+	.rx = ARCSEC_TO_RAD(0.1502),
+	.ry = ARCSEC_TO_RAD(0.2470),
+	.rz = ARCSEC_TO_RAD(0.8421)
+};
+
+static const struct helmert helmert_wgs84_to_airy = {
+	.s = 20.4894e-6,
+	.tx = -446.448, .ty = 125.157, .tz = -542.060,
+	.rx = ARCSEC_TO_RAD(-0.1502),
+	.ry = ARCSEC_TO_RAD(-0.2470),
+	.rz = ARCSEC_TO_RAD(-0.8421)
+};
+
+/* Below this many points per thread it's not worth spawning threads */
+#define BNG_MIN_PER_THREAD	4096
+
+static inline void helmert_transform(const struct helmert *h, double x_1,
+				     double y_1, double z_1, double *x_2,
+				     double *y_2, double *z_2)
+{
+	*x_2 = h->tx + (1+h->s)*x_1 + (-h->rz)*y_1 + (h->ry)*z_1;
+	*y_2 = h->ty + (h->rz)*x_1 + (1+h->s)*y_1 + (-h->rx)*z_1;
+	*z_2 = h->tz + (-h->ry)*x_1 + (h->rx)*y_1 + (1+h->s)*z_1;
+}
+
+/* Meridional arc */
+static inline double bng_meridional_arc(double phi)
+{
+	double Ma = airy1830.ma * (phi-PHI0);
+	double Mb = airy1830.mb * sin(phi-PHI0) * cos(phi+PHI0);
+	double Mc = airy1830.mc * sin(2*(phi-PHI0)) * cos(2*(phi+PHI0));
+	double Md = airy1830.md * sin(3*(phi-PHI0)) * cos(3*(phi+PHI0));
+
+	return airy1830.b * F0 * (Ma-Mb + Mc-Md);
+}
+
+/*
+ * Back to spherical polar coordinates from Cartesian. Returns phi and
+ * sets lam, nu & the altitude.
+ */
+static inline double cartesian_to_polar(double a, double e2, double x,
+					double y, double z, double *lam,
+					double *nu, double *alt)
+{
+	double p = sqrt(x*x + y*y);
+	double phi = atan2(z, p*(1-e2));
+	double phiold = 2 * M_PI;
+
+	*nu = 0.0;
+	while (fabs(phi-phiold) > 1e-16) {
+		double sp = sin(phi);
+
+		phiold = phi;
+		*nu = a / sqrt(1-e2*sp*sp);
+		phi = atan2(z + e2*(*nu)*sp, p);
+	}
+	*lam = atan2(y, x);
+	*alt = p/cos(phi) - *nu;
+
+	return phi;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeclaration-after-statement"
-/**
- * ac_geo_bng_to_lat_lon - convert British National Grid Eastings & Northings
- * 			   to latitude & longitude decimal degrees
- *
- * @geo:  Contains the Eastings & Northings (in meters) and an optional
- * 	  altitude to be converted. It should also specify the target
- * 	  ellipsoid to map the converted co-ordinates onto.
- *
- * 	  It is then filled out with the latitude & longitude decimal degrees
- * 	  and the new altitude
- *
- * This function is largely based on Python code from Dr Hannah Fry.
- * http://www.hannahfry.co.uk/blog/2012/02/01/converting-british-national-grid-to-latitude-and-longitude-ii
- */
-void ac_geo_bng_to_lat_lon(ac_geo_t *geo)
+static void bng_to_lat_lon(ac_geo_t *geo)
 {
+	const double a = airy1830.a;
+	const double e2 = airy1830.e2;
 	const double E = geo->easting;
 	const double N = geo->northing;
-	double a = ellipsoids[AC_GEO_EREF_AIRY1830].a;
-	double b = ellipsoids[AC_GEO_EREF_AIRY1830].b;
-	double e2 = 1 - (b*b) / (a*a);
-	double n = (a-b) / (a+b);
 	double dN = N - N0;
 	double phi = PHI0;
 	double M = 0;
 
 	while (dN-M >= 0.00001) {
 		phi += (dN-M) / (a*F0);
-		double Ma = (1.0 + n + (5.0/4)*pow(n, 2.0) + (5.0/4) *
-			     pow(n, 3.0)) *(phi-PHI0);
-		double Mb = (3.0*n + 3.0*pow(n, 2.0) + (21.0/8)*pow(n, 3.0)) *
-			sin(phi-PHI0) * cos(phi+PHI0);
-		double Mc = ((15.0/8)*pow(n, 2.0) + (15.0/8)*pow(n, 3.0)) *
-			sin(2*(phi-PHI0)) * cos(2*(phi+PHI0));
-		double Md = (35.0/24)*pow(n, 3.0) * sin(3*(phi-PHI0)) *
-			cos(3*(phi+PHI0));
-
-		M = b * F0 * (Ma-Mb + Mc-Md);
+		M = bng_meridional_arc(phi);
 	}
 
-	double nu = a * F0 / sqrt(1-e2*pow(sin(phi), 2.0));
-	double rho = a * F0 * (1.0-e2) * pow((1-e2*pow(sin(phi), 2.0)), -1.5);
+	double sphi = sin(phi);
+	double t = 1 - e2*sphi*sphi;
+	double nu = a * F0 / sqrt(t);
+	double rho = a * F0 * (1.0-e2) / (t * sqrt(t));
 	double eta2 = nu / rho - 1.0;
 
 	double tp = tan(phi);
@@ -289,21 +1052,27 @@ void ac_geo_bng_to_lat_lon(ac_geo_t *geo)
 	double tp4 = tp2*tp2;
 	double tp6 = tp4*tp2;
 	double sp = 1.0 / cos(phi);
+	double nu3 = nu*nu*nu;
+	double nu5 = nu3*nu*nu;
+	double nu7 = nu5*nu*nu;
 
 	double VII = tp / (2 * rho*nu);
-	double VIII = tp / (24*rho * pow(nu, 3.0)) *
-		(5+3*tp2+eta2 - 9*tp2*eta2);
-	double IX = tp / (720*rho * pow(nu, 5.0)) * (61 + 90*tp2 + 45*tp4);
+	double VIII = tp / (24*rho * nu3) * (5+3*tp2+eta2 - 9*tp2*eta2);
+	double IX = tp / (720*rho * nu5) * (61 + 90*tp2 + 45*tp4);
 	double X = sp / nu;
-	double XI = sp / (6 * pow(nu, 3.0)) * (nu/rho + 2*tp2);
-	double XII = sp / (120 * pow(nu, 5.0)) * (5 + 28*tp2 + 24*tp4);
-	double XIIA = sp / (5040 * pow(nu, 7.0)) *
-		(61 + 662*tp2 + 1320*tp4 + 720*tp6);
+	double XI = sp / (6 * nu3) * (nu/rho + 2*tp2);
+	double XII = sp / (120 * nu5) * (5 + 28*tp2 + 24*tp4);
+	double XIIA = sp / (5040 * nu7) * (61 + 662*tp2 + 1320*tp4 + 720*tp6);
 	double dE = E - E0;
+	double dE2 = dE*dE;
+	double dE3 = dE2*dE;
+	double dE4 = dE2*dE2;
+	double dE5 = dE4*dE;
+	double dE6 = dE4*dE2;
+	double dE7 = dE6*dE;
 
-	phi = phi - VII*pow(dE, 2.0) + VIII*pow(dE, 4.0) - IX*pow(dE, 6.0);
-	double lam = LAM0 + X*dE - XI*pow(dE, 3.0) + XII*pow(dE, 5.0) -
-		XIIA*pow(dE, 7.0);
+	phi = phi - VII*dE2 + VIII*dE4 - IX*dE6;
+	double lam = LAM0 + X*dE - XI*dE3 + XII*dE5 - XIIA*dE7;
 
 	/* That gives us co-ordinates on the Airy 1830 ellipsoid */
 
@@ -312,34 +1081,19 @@ void ac_geo_bng_to_lat_lon(ac_geo_t *geo)
 	double x_1 = (nu/F0 + H)*cos(phi)*cos(lam);
 	double y_1 = (nu/F0 + H)*cos(phi)*sin(lam);
 	double z_1 = ((1-e2)*nu/F0 + H)*sin(phi);
+	double x_2;
+	double y_2;
+	double z_2;
 
 	/* Perform Helmut transform to go between Airy 1830 and geo->ref */
-	double s = -20.4894*pow(10, -6.0);
-	double tx = 446.448, ty = -125.157, tz = 542.060;
-	double rxs = 0.1502, rys = 0.2470, rzs = 0.8421;
-	double rx = rxs*M_PI / (180*3600.0);
-	double ry = rys*M_PI / (180*3600.0);
-	double rz = rzs*M_PI / (180*3600.0);
-	double x_2 = tx + (1+s)*x_1 + (-rz)*y_1 + (ry)*z_1;
-	double y_2 = ty + (rz)*x_1 + (1+s)*y_1 + (-rx)*z_1;
-	double z_2 = tz + (-ry)*x_1 + (rx)*y_1 + (1+s)*z_1;
+	helmert_transform(&helmert_airy_to_wgs84, x_1, y_1, z_1,
+			  &x_2, &y_2, &z_2);
 
 	/* Back to spherical polar coordinates from Cartesian */
-	a = ellipsoids[geo->ref].a;
-	b = ellipsoids[geo->ref].b;
-	e2 = 1 - (b*b) / (a*a);
-	double p = sqrt(pow(x_2, 2.0) + pow(y_2, 2.0));
-
-	phi = atan2(z_2, p*(1-e2));
-	double phiold = 2 * M_PI;
-	while (fabs(phi-phiold) > pow(10, -16.0)) {
-		phiold = phi;
-		nu = a/sqrt(1-e2*pow(sin(phi), 2.0));
-		phi = atan2(z_2+e2*nu*sin(phi), p);
-	}
-	lam = atan2(y_2, x_2);
+	phi = cartesian_to_polar(ellipsoids[geo->ref].a,
+				 ellipsoids[geo->ref].e2, x_2, y_2, z_2,
+				 &lam, &nu, &geo->alt);
 
-	geo->alt = p/cos(phi) - nu;
 	geo->lat = phi * RAD_TO_DEG;
 	geo->lon = lam * RAD_TO_DEG;
 }
@@ -347,78 +1101,41 @@ void ac_geo_bng_to_lat_lon(ac_geo_t *geo)
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeclaration-after-statement"
-/**
- * ac_geo_lat_lon_to_bng - convert latitude & longitude decimal degrees to
- *			   British National Grid Eastings & Northings
- *
- * @geo:  Contains the latitude & longitude and an optional altitude to be
- *	  converted. It should also specify the ellipsoid of the source
- *	  co-ordinates.
- *
- * 	  It is then filled out with the Eastings & Northings in meters and
- * 	  the new altitude
- *
- * This function is largely based on Python code from Dr Hannah Fry.
- * http://www.hannahfry.co.uk/blog/2012/02/01/converting-latitude-and-longitude-to-british-national-grid
- */
-void ac_geo_lat_lon_to_bng(ac_geo_t *geo)
+static void lat_lon_to_bng(ac_geo_t *geo)
 {
 	double a = ellipsoids[geo->ref].a;
-	double b = ellipsoids[geo->ref].b;
+	double e2 = ellipsoids[geo->ref].e2;
 	double phi = geo->lat * DEG_TO_RAD;
 	double lam = geo->lon * DEG_TO_RAD;
-	double e2 = 1 - (b*b) / (a*a);
-	double nu = a / sqrt(1-e2*pow(sin(phi), 2.0));
+	double sphi = sin(phi);
+	double nu = a / sqrt(1-e2*sphi*sphi);
 
 	/* First convert to Cartesian from spherical polar coordinates */
 	double H = geo->alt;
 	double x_1 = (nu+H)*cos(phi)*cos(lam);
 	double y_1 = (nu+H)*cos(phi)*sin(lam);
-	double z_1 = ((1-e2)*nu+H)*sin(phi);
+	double z_1 = ((1-e2)*nu+H)*sphi;
+	double x_2;
+	double y_2;
+	double z_2;
 
 	/* Perform Helmut transform to go between Airy 1830 and geo->ref */
-	double s = 20.4894*pow(10, -6.0);
-	double tx = -446.448, ty = 125.157, tz = -542.060;
-	double rxs = -0.1502, rys = -0.2470, rzs = -0.8421;
-	double rx = rxs*M_PI / (180*3600.0);
-	double ry = rys*M_PI / (180*3600.0);
-	double rz = rzs*M_PI / (180*3600.0);
-	double x_2 = tx + (1+s)*x_1 + (-rz)*y_1 + (ry)*z_1;
-	double y_2 = ty + (rz)*x_1 + (1+s)*y_1 + (-rx)*z_1;
-	double z_2 = tz + (-ry)*x_1 + (rx)*y_1 + (1+s)*z_1;
+	helmert_transform(&helmert_wgs84_to_airy, x_1, y_1, z_1,
+			  &x_2, &y_2, &z_2);
 
 	/* Back to spherical polar coordinates from Cartesian */
-	a = ellipsoids[AC_GEO_EREF_AIRY1830].a;
-	b = ellipsoids[AC_GEO_EREF_AIRY1830].b;
-	e2 = 1 - (b*b) / (a*a);
-	double p = sqrt(pow(x_2, 2.0) + pow(y_2, 2.0));
-
-	phi = atan2(z_2, p*(1-e2));
-	double phiold = 2 * M_PI;
-	while (fabs(phi-phiold) > pow(10, -16.0)) {
-		phiold = phi;
-		nu = a/sqrt(1-e2*pow(sin(phi), 2.0));
-		phi = atan2(z_2+e2*nu*sin(phi), p);
-	}
-	lam = atan2(y_2, x_2);
-	geo->alt = p/cos(phi) - nu;
+	e2 = airy1830.e2;
+	phi = cartesian_to_polar(airy1830.a, e2, x_2, y_2, z_2, &lam, &nu,
+				 &geo->alt);
 
-	double n = (a-b) / (a+b);
+	sphi = sin(phi);
+	double t = 1 - e2*sphi*sphi;
 	/* Meridional radius of curvature */
-	double rho = a * F0 * (1-e2) * pow((1-e2*pow(sin(phi), 2.0)), -1.5);
+	double rho = airy1830.a * F0 * (1-e2) / (t * sqrt(t));
 	double eta2 = nu*F0 / rho-1.0;
 
-	double Ma = (1.0 + n + (5.0/4)*pow(n, 2.0) + (5.0/4) * pow(n, 3.0)) *
-		(phi-PHI0);
-	double Mb = (3.0*n + 3.0*pow(n, 2.0) + (21.0/8)*pow(n, 3.0)) *
-		sin(phi-PHI0) * cos(phi+PHI0);
-	double Mc = ((15.0/8)*pow(n, 2.0) + (15.0/8)*pow(n, 3.0)) *
-		sin(2*(phi-PHI0)) * cos(2*(phi+PHI0));
-	double Md = (35.0/24)*pow(n, 3.0) * sin(3*(phi-PHI0)) *
-		cos(3*(phi+PHI0));
-
 	/* Meridional arc */
-	double M = b * F0 * (Ma-Mb + Mc-Md);
+	double M = bng_meridional_arc(phi);
 
 	double tp = tan(phi);
 	double tp2 = tp*tp;
@@ -428,16 +1145,173 @@ void ac_geo_lat_lon_to_bng(ac_geo_t *geo)
 	double cp5 = cp3*cp*cp;
 
 	double I = M + N0;
-	double II = nu*F0*sin(phi)*cp/2;
-	double III = nu*F0*sin(phi)*cp3*(5-tp2 + 9*eta2)/24;
-	double IIIA = nu*F0*sin(phi)*cp5*(61 - 58*tp2 + tp4)/720;
+	double II = nu*F0*sphi*cp/2;
+	double III = nu*F0*sphi*cp3*(5-tp2 + 9*eta2)/24;
+	double IIIA = nu*F0*sphi*cp5*(61 - 58*tp2 + tp4)/720;
 	double IV = nu*F0*cp;
 	double V = nu*F0*cp3*(nu/rho - tp2)/6;
 	double VI = nu*F0*cp5*(5 - 18*tp2 + tp4 + 14*eta2 - 58*eta2*tp2)/120;
 
-	geo->northing = I + II*pow(lam-LAM0, 2.0) + III*pow(lam-LAM0, 4.0) +
-		IIIA*pow(lam-LAM0, 6.0);
-	geo->easting = E0 + IV*(lam-LAM0) + V*pow(lam-LAM0, 3) +
-		VI*pow(lam-LAM0, 5);
+	double dl = lam-LAM0;
+	double dl2 = dl*dl;
+	double dl3 = dl2*dl;
+	double dl4 = dl2*dl2;
+	double dl5 = dl4*dl;
+	double dl6 = dl4*dl2;
+
+	geo->northing = I + II*dl2 + III*dl4 + IIIA*dl6;
+	geo->easting = E0 + IV*dl + V*dl3 + VI*dl5;
 }
 #pragma GCC diagnostic pop
+
+struct bng_chunk {
+	ac_geo_t *geo;
+	size_t nmemb;
+	void (*convert)(ac_geo_t *geo);
+};
+
+static void *bng_convert_chunk(void *arg)
+{
+	const struct bng_chunk *chunk = arg;
+	size_t i;
+
+	for (i = 0; i < chunk->nmemb; i++)
+		chunk->convert(chunk->geo + i);
+
+	return NULL;
+}
+
+static void bng_convert_m(ac_geo_t *geo, size_t nmemb,
+			  unsigned int nr_threads,
+			  void (*convert)(ac_geo_t *geo))
+{
+	pthread_t *tids;
+	struct bng_chunk *chunks;
+	size_t per_thread;
+	unsigned int started = 0;
+	unsigned int i;
+	size_t n;
+
+	nr_threads = AC_MIN(nr_threads, nmemb / BNG_MIN_PER_THREAD);
+	if (nr_threads < 2)
+		goto convert_rest;
+
+	tids = malloc(nr_threads * sizeof(pthread_t));
+	chunks = malloc(nr_threads * sizeof(struct bng_chunk));
+	if (!tids || !chunks) {
+		free(tids);
+		free(chunks);
+		goto convert_rest;
+	}
+
+	/*
+	 * Hand out the first nr_threads - 1 chunks to new threads, the
+	 * calling thread does whatever is left.
+	 */
+	per_thread = nmemb / nr_threads;
+	for (i = 0; i < nr_threads - 1; i++) {
+		chunks[i].geo = geo;
+		chunks[i].nmemb = per_thread;
+		chunks[i].convert = convert;
+		if (pthread_create(&tids[i], NULL, bng_convert_chunk,
+				   &chunks[i]) != 0)
+			break;
+
+		geo += per_thread;
+		nmemb -= per_thread;
+		started++;
+	}
+
+	chunks[started].geo = geo;
+	chunks[started].nmemb = nmemb;
+	chunks[started].convert = convert;
+	bng_convert_chunk(&chunks[started]);
+
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	free(tids);
+	free(chunks);
+
+	return;
+
+convert_rest:
+	for (n = 0; n < nmemb; n++)
+		convert(geo + n);
+}
+
+/**
+ * ac_geo_bng_to_lat_lon - convert British National Grid Eastings & Northings
+ * 			   to latitude & longitude decimal degrees
+ *
+ * @geo:  Contains the Eastings & Northings (in meters) and an optional
+ * 	  altitude to be converted. It should also specify the target
+ * 	  ellipsoid to map the converted co-ordinates onto.
+ *
+ * 	  It is then filled out with the latitude & longitude decimal degrees
+ * 	  and the new altitude
+ *
+ * This function is largely based on Python code from Dr Hannah Fry.
+ * http://www.hannahfry.co.uk/blog/2012/02/01/converting-british-national-grid-to-latitude-and-longitude-ii
+ */
+void ac_geo_bng_to_lat_lon(ac_geo_t *geo)
+{
+	bng_to_lat_lon(geo);
+}
+
+/**
+ * ac_geo_bng_to_lat_lon_m - convert an array of British National Grid
+ *			     Eastings & Northings to latitude & longitude
+ *			     decimal degrees
+ *
+ * @geo: An array of points to convert, as per ac_geo_bng_to_lat_lon()
+ * @nmemb: The number of points in the array
+ * @nr_threads: The maximum number of threads to use (including the calling
+ *		thread), 0 or 1 to do all the work in the calling thread
+ *
+ * The array is split into contiguous chunks, one per thread. Threads are
+ * only used when there are enough points to make it worthwhile.
+ */
+void ac_geo_bng_to_lat_lon_m(ac_geo_t *geo, size_t nmemb,
+			     unsigned int nr_threads)
+{
+	bng_convert_m(geo, nmemb, nr_threads, bng_to_lat_lon);
+}
+
+/**
+ * ac_geo_lat_lon_to_bng - convert latitude & longitude decimal degrees to
+ *			   British National Grid Eastings & Northings
+ *
+ * @geo:  Contains the latitude & longitude and an optional altitude to be
+ *	  converted. It should also specify the ellipsoid of the source
+ *	  co-ordinates.
+ *
+ * 	  It is then filled out with the Eastings & Northings in meters and
+ * 	  the new altitude
+ *
+ * This function is largely based on Python code from Dr Hannah Fry.
+ * http://www.hannahfry.co.uk/blog/2012/02/01/converting-latitude-and-longitude-to-british-national-grid
+ */
+void ac_geo_lat_lon_to_bng(ac_geo_t *geo)
+{
+	lat_lon_to_bng(geo);
+}
+
+/**
+ * ac_geo_lat_lon_to_bng_m - convert an array of latitude & longitude decimal
+ *			     degrees to British National Grid Eastings &
+ *			     Northings
+ *
+ * @geo: An array of points to convert, as per ac_geo_lat_lon_to_bng()
+ * @nmemb: The number of points in the array
+ * @nr_threads: The maximum number of threads to use (including the calling
+ *		thread), 0 or 1 to do all the work in the calling thread
+ *
+ * The array is split into contiguous chunks, one per thread. Threads are
+ * only used when there are enough points to make it worthwhile.
+ */
+void ac_geo_lat_lon_to_bng_m(ac_geo_t *geo, size_t nmemb,
+			     unsigned int nr_threads)
+{
+	bng_convert_m(geo, nmemb, nr_threads, lat_lon_to_bng);
+}
@@ -0,0 +1,410 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_histogram.c - Log-linear (HDR style) histograms
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "include/libac.h"
+
+/*
+ * Values are bucketed by their power of two and then linearly into
+ * 2^sub_bits sub-buckets within that, so every bucket is within
+ * 1 / 2^sub_bits of the values it holds. Values below 2^sub_bits each get
+ * their own bucket.
+ */
+static inline u32 hist_index(const ac_histogram_t *hist, u64 value)
+{
+	int e;
+
+	if (value < (1ULL << hist->sub_bits))
+		return value;
+
+	e = 63 - __builtin_clzll(value);
+
+	return ((u32)(e - hist->sub_bits + 1) << hist->sub_bits) +
+	       ((value >> (e - hist->sub_bits)) &
+		((1ULL << hist->sub_bits) - 1));
+}
+
+/* The lowest and highest values that map to a bucket */
+static inline void hist_bucket_range(const ac_histogram_t *hist, u32 idx,
+				     u64 *low, u64 *high)
+{
+	u32 sub_count = 1U << hist->sub_bits;
+	int shift;
+
+	if (idx < sub_count) {
+		*low = *high = idx;
+		return;
+	}
+
+	shift = (idx >> hist->sub_bits) - 1;
+	*low = (u64)(sub_count + (idx & (sub_count - 1))) << shift;
+	*high = *low + ((1ULL << shift) - 1);
+}
+
+/**
+ * ac_histogram_new - create a new histogram
+ *
+ * @max_value: The largest value to be recorded, larger values are
+ *             recorded as max_value
+ * @sub_bits: The precision, values are recorded to within 1 / 2^sub_bits,
+ *            between 1 and 16. 7 (< 1%) is a good default
+ *
+ * The histogram uses a fixed amount of memory, roughly
+ * (log2(max_value) - sub_bits + 2) * 2^sub_bits * 8 bytes.
+ *
+ * Returns:
+ *
+ * A pointer to the newly created histogram or NULL on failure, check
+ * errno
+ */
+ac_histogram_t *ac_histogram_new(u64 max_value, int sub_bits)
+{
+	ac_histogram_t *hist;
+
+	if (sub_bits < 1 || sub_bits > 16 || max_value == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	hist = malloc(sizeof(ac_histogram_t));
+	if (!hist)
+		return NULL;
+
+	hist->sub_bits = sub_bits;
+	hist->max_value = max_value;
+	hist->nr_buckets = hist_index(hist, max_value) + 1;
+	hist->counts = calloc(hist->nr_buckets, sizeof(u64));
+	if (!hist->counts) {
+		free(hist);
+		return NULL;
+	}
+	hist->total = 0;
+	hist->sum = 0;
+	hist->min = UINT64_MAX;
+	hist->max = 0;
+
+	return hist;
+}
+
+/**
+ * ac_histogram_record_n - record a value a number of times
+ *
+ * @hist: The histogram to record the value in
+ * @value: The value to record
+ * @count: The number of times to record it
+ *
+ * This does no locking, each thread should record into its own histogram
+ * which can then be merged with ac_histogram_merge().
+ */
+void ac_histogram_record_n(ac_histogram_t *hist, u64 value, u64 count)
+{
+	if (value > hist->max_value)
+		value = hist->max_value;
+
+	hist->counts[hist_index(hist, value)] += count;
+	hist->total += count;
+	hist->sum += value * count;
+	if (value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+}
+
+/**
+ * ac_histogram_record - record a value
+ *
+ * @hist: The histogram to record the value in
+ * @value: The value to record
+ *
+ * This does no locking, each thread should record into its own histogram
+ * which can then be merged with ac_histogram_merge().
+ */
+void ac_histogram_record(ac_histogram_t *hist, u64 value)
+{
+	ac_histogram_record_n(hist, value, 1);
+}
+
+static inline void atomic_min(u64 *ptr, u64 value)
+{
+	u64 cur = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+	while (value < cur &&
+	       !__atomic_compare_exchange_n(ptr, &cur, value, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static inline void atomic_max(u64 *ptr, u64 value)
+{
+	u64 cur = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+	while (value > cur &&
+	       !__atomic_compare_exchange_n(ptr, &cur, value, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * ac_histogram_merge - add the counts from one histogram into another
+ *
+ * @dst: The histogram to merge into
+ * @src: The histogram to merge from
+ *
+ * @dst is updated with atomic operations so any number of threads can
+ * merge into the same histogram at once without locking. Both histograms
+ * must have been created with the same max_value & sub_bits.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 if the histograms aren't compatible
+ */
+int ac_histogram_merge(ac_histogram_t *dst, const ac_histogram_t *src)
+{
+	u32 i;
+
+	if (dst->sub_bits != src->sub_bits ||
+	    dst->nr_buckets != src->nr_buckets) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (src->total == 0)
+		return 0;
+
+	for (i = 0; i < src->nr_buckets; i++) {
+		if (src->counts[i])
+			__atomic_fetch_add(&dst->counts[i], src->counts[i],
+					   __ATOMIC_RELAXED);
+	}
+	__atomic_fetch_add(&dst->sum, src->sum, __ATOMIC_RELAXED);
+	atomic_min(&dst->min, src->min);
+	atomic_max(&dst->max, src->max);
+	/* Last so a reader seeing the total sees the counts */
+	__atomic_fetch_add(&dst->total, src->total, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**
+ * ac_histogram_percentile - get the value at a given percentile
+ *
+ * @hist: The histogram
+ * @percentile: The percentile, 0.0 - 100.0
+ *
+ * Returns:
+ *
+ * The highest value that falls in the same bucket as the value at the
+ * given percentile, or 0 if the histogram is empty
+ */
+u64 ac_histogram_percentile(const ac_histogram_t *hist, double percentile)
+{
+	u64 total = __atomic_load_n(&hist->total, __ATOMIC_ACQUIRE);
+	u64 target;
+	u64 seen = 0;
+	u32 i;
+
+	if (total == 0)
+		return 0;
+	if (percentile <= 0.0)
+		return hist->min;
+	if (percentile >= 100.0)
+		return hist->max;
+
+	target = (u64)(percentile / 100.0 * total + 0.5);
+	if (target == 0)
+		target = 1;
+
+	for (i = 0; i < hist->nr_buckets; i++) {
+		seen += hist->counts[i];
+		if (seen >= target) {
+			u64 low;
+			u64 high;
+
+			hist_bucket_range(hist, i, &low, &high);
+
+			return AC_MIN(high, hist->max);
+		}
+	}
+
+	return hist->max;
+}
+
+/**
+ * ac_histogram_foreach - iterate over the non-empty buckets
+ *
+ * @hist: The histogram to iterate over
+ * @action: The function to call on each bucket with the lowest & highest
+ *          values it covers and its count
+ * @user_data: Optional user data to pass to action. Can be NULL
+ */
+void ac_histogram_foreach(const ac_histogram_t *hist,
+			  void (*action)(u64 low, u64 high, u64 count,
+					 void *data),
+			  void *user_data)
+{
+	u32 i;
+
+	for (i = 0; i < hist->nr_buckets; i++) {
+		u64 low;
+		u64 high;
+
+		if (!hist->counts[i])
+			continue;
+
+		hist_bucket_range(hist, i, &low, &high);
+		action(low, high, hist->counts[i], user_data);
+	}
+}
+
+/**
+ * ac_histogram_count - get the number of recorded values
+ *
+ * @hist: The histogram
+ *
+ * Returns:
+ *
+ * The number of recorded values
+ */
+u64 ac_histogram_count(const ac_histogram_t *hist)
+{
+	return __atomic_load_n(&hist->total, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * ac_histogram_min - get the smallest recorded value
+ *
+ * @hist: The histogram
+ *
+ * Returns:
+ *
+ * The smallest recorded value, or 0 if the histogram is empty
+ */
+u64 ac_histogram_min(const ac_histogram_t *hist)
+{
+	return ac_histogram_count(hist) ? hist->min : 0;
+}
+
+/**
+ * ac_histogram_max - get the largest recorded value
+ *
+ * @hist: The histogram
+ *
+ * Returns:
+ *
+ * The largest recorded value, or 0 if the histogram is empty
+ */
+u64 ac_histogram_max(const ac_histogram_t *hist)
+{
+	return hist->max;
+}
+
+/**
+ * ac_histogram_mean - get the mean of the recorded values
+ *
+ * @hist: The histogram
+ *
+ * Returns:
+ *
+ * The mean of the recorded values, or 0.0 if the histogram is empty
+ */
+double ac_histogram_mean(const ac_histogram_t *hist)
+{
+	u64 total = ac_histogram_count(hist);
+
+	if (total == 0)
+		return 0.0;
+
+	return (double)hist->sum / total;
+}
+
+static void hist_json_bucket(u64 low, u64 high, u64 count, void *data)
+{
+	ac_jsonw_t *json = data;
+
+	ac_jsonw_add_object(json, NULL);
+	ac_jsonw_add_int(json, "low", low);
+	ac_jsonw_add_int(json, "high", high);
+	ac_jsonw_add_int(json, "count", count);
+	ac_jsonw_end_object(json);
+}
+
+/**
+ * ac_histogram_to_json - add a histogram to a JSON object
+ *
+ * @hist: The histogram
+ * @json: The JSON writer to add it to
+ * @name: The name of the object, or NULL when adding to an array
+ *
+ * Adds an object containing the count, min, max, mean, a set of common
+ * percentiles and the non-empty buckets.
+ */
+void ac_histogram_to_json(const ac_histogram_t *hist, ac_jsonw_t *json,
+			  const char *name)
+{
+	static const struct {
+		const char *name;
+		double percentile;
+	} percentiles[] = {
+		{ "p50", 50.0 },
+		{ "p90", 90.0 },
+		{ "p99", 99.0 },
+		{ "p99.9", 99.9 },
+		{ "p99.99", 99.99 }
+	};
+	size_t i;
+
+	ac_jsonw_add_object(json, name);
+	ac_jsonw_add_int(json, "count", ac_histogram_count(hist));
+	ac_jsonw_add_int(json, "min", ac_histogram_min(hist));
+	ac_jsonw_add_int(json, "max", ac_histogram_max(hist));
+	ac_jsonw_add_real(json, "mean", ac_histogram_mean(hist), 3);
+	ac_jsonw_add_object(json, "percentiles");
+	for (i = 0; i < AC_ARRAY_SIZE(percentiles); i++)
+		ac_jsonw_add_int(json, percentiles[i].name,
+				 ac_histogram_percentile(hist,
+						percentiles[i].percentile));
+	ac_jsonw_end_object(json);
+	ac_jsonw_add_array(json, "buckets");
+	ac_histogram_foreach(hist, hist_json_bucket, json);
+	ac_jsonw_end_array(json);
+	ac_jsonw_end_object(json);
+}
+
+/**
+ * ac_histogram_reset - clear all the recorded values
+ *
+ * @hist: The histogram to reset
+ */
+void ac_histogram_reset(ac_histogram_t *hist)
+{
+	memset(hist->counts, 0, hist->nr_buckets * sizeof(u64));
+	hist->total = 0;
+	hist->sum = 0;
+	hist->min = UINT64_MAX;
+	hist->max = 0;
+}
+
+/**
+ * ac_histogram_destroy - destroy a histogram freeing all its memory
+ *
+ * @hist: The histogram to destroy
+ */
+void ac_histogram_destroy(ac_histogram_t *hist)
+{
+	if (!hist)
+		return;
+
+	free(hist->counts);
+	free(hist);
+}
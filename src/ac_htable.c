@@ -11,6 +11,9 @@
 #include <stdlib.h>
 
 #include "include/libac.h"
+#include "ac_alloc.h"
+#include "ac_sdt.h"
+#include "ac_lock.h"
 
 #define HTABLE_SZ	2048
 
@@ -19,13 +22,21 @@ struct bucket_list_elem {
 	void *data;
 };
 
+/*
+ * depth is set to the number of entries compared, which for a miss is the
+ * length of the chain. It's only used by the probes.
+ */
 static ac_slist_t *bucket_list_lookup(const ac_htable_t *htable,
-				      ac_slist_t *list, const void *key)
+				      ac_slist_t *list, const void *key,
+				      u32 *depth)
 {
+	*depth = 0;
 	while (list) {
 		const struct bucket_list_elem *elem = list->data;
-		bool again = htable->key_cmp(elem->key, key);
+		bool again;
 
+		(*depth)++;
+		again = htable->key_cmp(elem->key, key);
 		if (!again)
 			return list;
 		list = list->next;
@@ -52,8 +63,9 @@ static bool bucket_list_remove(const ac_htable_t *htable, ac_slist_t **list,
 				htable->free_key_func(elem->key);
 			if (htable->free_data_func)
 				htable->free_data_func(elem->data);
-			free(elem);
-			free(p);
+			mem_free(&htable->alloc, elem,
+				 sizeof(struct bucket_list_elem));
+			mem_free(&htable->alloc, p, sizeof(ac_slist_t));
 
 			ret = true;
 			break;
@@ -65,36 +77,92 @@ static bool bucket_list_remove(const ac_htable_t *htable, ac_slist_t **list,
 }
 
 /**
- * ac_htable_new - create a new hash table
+ * ac_htable_new_with_allocator - create a new hash table
  *
  * @hash_func: Pointer to a hashing function
  * @key_cmp: Pointer to a key comparison function
  * @free_key_func: Optional pointer to a key free'ing function
  * @free_data_func: Optional pointer to a data free'ing function
+ * @alloc: The allocator to use for the hash table's memory, it is copied.
+ *         NULL for the default
  *
  * Returns:
  *
  * A pointer to a newly created hash table. Should be free'd with
  * ac_htable_destroy()
  */
-ac_htable_t *ac_htable_new(u32 (*hash_func)(const void *key),
-			   int (*key_cmp)(const void *a, const void *b),
-			   void (*free_key_func)(void *key),
-			   void (*free_data_func)(void *data))
+ac_htable_t *ac_htable_new_with_allocator(
+				u32 (*hash_func)(const void *key),
+				int (*key_cmp)(const void *a, const void *b),
+				void (*free_key_func)(void *key),
+				void (*free_data_func)(void *data),
+				const ac_allocator_t *alloc)
 {
 	ac_htable_t *htable;
 
-	htable = malloc(sizeof(ac_htable_t));
-	htable->buckets = calloc(HTABLE_SZ, sizeof(ac_slist_t *));
+	htable = mem_alloc(alloc, sizeof(ac_htable_t));
+	htable->buckets = mem_zalloc(alloc, HTABLE_SZ * sizeof(ac_slist_t *));
 	htable->hash_func = hash_func;
 	htable->key_cmp = key_cmp;
 	htable->free_key_func = free_key_func;
 	htable->free_data_func = free_data_func;
 	htable->count = 0;
+	htable->lock = NULL;
+	mem_set_allocator(&htable->alloc, alloc);
 
 	return htable;
 }
 
+/**
+ * ac_htable_new - create a new hash table
+ *
+ * @hash_func: Pointer to a hashing function
+ * @key_cmp: Pointer to a key comparison function
+ * @free_key_func: Optional pointer to a key free'ing function
+ * @free_data_func: Optional pointer to a data free'ing function
+ *
+ * Returns:
+ *
+ * A pointer to a newly created hash table. Should be free'd with
+ * ac_htable_destroy()
+ */
+ac_htable_t *ac_htable_new(u32 (*hash_func)(const void *key),
+			   int (*key_cmp)(const void *a, const void *b),
+			   void (*free_key_func)(void *key),
+			   void (*free_data_func)(void *data))
+{
+	return ac_htable_new_with_allocator(hash_func, key_cmp, free_key_func,
+					    free_data_func, NULL);
+}
+
+/**
+ * ac_htable_set_thread_safe - make a hash table safe to share between threads
+ *
+ * @htable: The hash table
+ *
+ * After this the hash table is protected by a read/write lock, so lookups
+ * can happen concurrently with each other but not with changes. It must be
+ * called before the hash table is shared and lasts for its lifetime.
+ *
+ * The key & data free functions and ac_htable_foreach()'s action are called
+ * with the lock held and must not call back into the hash table.
+ *
+ * The allocator is only called with the write lock held. It need only be
+ * thread-safe if it's also used outside of this hash table, e.g. an
+ * ac_arena_t shared with another container must not be used.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno (ENOMEM)
+ */
+int ac_htable_set_thread_safe(ac_htable_t *htable)
+{
+	if (!htable->lock)
+		htable->lock = rwlock_new(&htable->alloc);
+
+	return htable->lock ? 0 : -1;
+}
+
 /**
  * ac_htable_insert - inserts a new entry into a hash table
  *
@@ -107,21 +175,30 @@ ac_htable_t *ac_htable_new(u32 (*hash_func)(const void *key),
  */
 void ac_htable_insert(ac_htable_t *htable, void *key, void *data)
 {
-	struct bucket_list_elem *ble = malloc(sizeof(struct bucket_list_elem));
+	struct bucket_list_elem *ble;
 	u32 bucket = htable->hash_func(key) % HTABLE_SZ;
 	ac_slist_t *item;
+	u32 depth;
 
+	/* The allocator is only ever called with the lock held */
+	rwlock_wrlock(htable->lock);
+	ble = mem_alloc(&htable->alloc, sizeof(struct bucket_list_elem));
 	ble->key = key;
 	ble->data = data;
 
-	item = bucket_list_lookup(htable, htable->buckets[bucket], key);
+	item = bucket_list_lookup(htable, htable->buckets[bucket], key,
+				  &depth);
 	if (item) {
 		bucket_list_remove(htable, &htable->buckets[bucket], key);
 		htable->count--;
 	}
 
-	ac_slist_preadd(&htable->buckets[bucket], ble);
+	ac_slist_preadd_with_allocator(&htable->buckets[bucket], ble,
+				       &htable->alloc);
 	htable->count++;
+	rwlock_unlock(htable->lock);
+
+	AC_PROBE4(htable_insert, htable, key, depth, item != NULL);
 }
 
 /**
@@ -139,9 +216,13 @@ bool ac_htable_remove(ac_htable_t *htable, const void *key)
 	u32 bucket = htable->hash_func(key) % HTABLE_SZ;
 	bool ret;
 
+	rwlock_wrlock(htable->lock);
 	ret = bucket_list_remove(htable, &htable->buckets[bucket], key);
 	if (ret)
 		htable->count--;
+	rwlock_unlock(htable->lock);
+
+	AC_PROBE3(htable_remove, htable, key, ret);
 
 	return ret;
 }
@@ -159,13 +240,20 @@ bool ac_htable_remove(ac_htable_t *htable, const void *key)
 void *ac_htable_lookup(const ac_htable_t *htable, const void *key)
 {
 	u32 bucket = htable->hash_func(key) % HTABLE_SZ;
-	ac_slist_t *item = bucket_list_lookup(htable, htable->buckets[bucket],
-					      key);
+	ac_slist_t *item;
+	void *data = NULL;
+	u32 depth;
+
+	rwlock_rdlock(htable->lock);
+	item = bucket_list_lookup(htable, htable->buckets[bucket], key,
+				  &depth);
+	if (item)
+		data = ((struct bucket_list_elem *)item->data)->data;
+	rwlock_unlock(htable->lock);
 
-	if (!item)
-		return NULL;
+	AC_PROBE4(htable_lookup, htable, key, depth, item != NULL);
 
-	return ((struct bucket_list_elem *)item->data)->data;
+	return data;
 }
 
 /**
@@ -182,6 +270,7 @@ void ac_htable_foreach(const ac_htable_t *htable,
 {
 	u32 bucket;
 
+	rwlock_rdlock(htable->lock);
 	for (bucket = 0; bucket < HTABLE_SZ; bucket++) {
 		ac_slist_t *list = htable->buckets[bucket];
 
@@ -192,6 +281,7 @@ void ac_htable_foreach(const ac_htable_t *htable,
 			list = list->next;
 		}
 	}
+	rwlock_unlock(htable->lock);
 }
 
 /**
@@ -214,12 +304,15 @@ void ac_htable_destroy(const ac_htable_t *htable)
 				htable->free_key_func(elem->key);
 			if (htable->free_data_func)
 				htable->free_data_func(elem->data);
-			free(elem);
-			free(list);
+			mem_free(&htable->alloc, elem,
+				 sizeof(struct bucket_list_elem));
+			mem_free(&htable->alloc, list, sizeof(ac_slist_t));
 			list = p;
 		}
 	}
 
-	free(htable->buckets);
-	free((void *)htable);
+	mem_free(&htable->alloc, htable->buckets,
+		 HTABLE_SZ * sizeof(ac_slist_t *));
+	rwlock_destroy(&htable->alloc, htable->lock);
+	mem_free(&htable->alloc, (void *)htable, sizeof(ac_htable_t));
 }
@@ -17,10 +17,28 @@
 #include <stdarg.h>
 
 #include "include/libac.h"
+#include "ac_alloc.h"
+#include "ac_sdt.h"
+#include "ac_cpu.h"
 
 static const size_t ALLOC_SZ = 4096;
 static const char *JSON_INDENT = "    ";
 
+/* Make room for another need bytes plus the '\0', doubling the buffer */
+static void json_reserve(ac_jsonw_t *json, size_t need)
+{
+	size_t size = json->allocated;
+
+	if (json->len + need < size)
+		return;
+
+	while (json->len + need >= size)
+		size *= 2;
+	AC_PROBE3(jsonw_grow, json, json->allocated, size);
+	json->str = mem_realloc(&json->alloc, json->str, json->allocated, size);
+	json->allocated = size;
+}
+
 static void json_build_str(ac_jsonw_t *json, const char *fmt, ...)
 {
 	va_list ap;
@@ -29,13 +47,10 @@ static void json_build_str(ac_jsonw_t *json, const char *fmt, ...)
 	char *buf;
 	const char *indenter = !json->indenter ? JSON_INDENT : json->indenter;
 
-	if (json->skip_tabs) {
+	if (json->skip_tabs)
 		i = json->depth;
-	} else if (json->len + (json->depth * strlen(indenter)) >=
-		   json->allocated) {
-		json->str = realloc(json->str, json->allocated + ALLOC_SZ);
-		json->allocated += ALLOC_SZ;
-	}
+	else
+		json_reserve(json, json->depth * strlen(indenter));
 	for ( ; i < json->depth; i++)
 		json->len += snprintf(json->str + json->len,
 				      json->allocated - json->len, "%s",
@@ -45,10 +60,7 @@ static void json_build_str(ac_jsonw_t *json, const char *fmt, ...)
 	len = vasprintf(&buf, fmt, ap);
 	va_end(ap);
 
-	while (json->len + len >= json->allocated) {
-		json->str = realloc(json->str, json->allocated + ALLOC_SZ);
-		json->allocated += ALLOC_SZ;
-	}
+	json_reserve(json, len);
 
 	memcpy(json->str + json->len, buf, len + 1);
 	json->len += len;
@@ -56,18 +68,27 @@ static void json_build_str(ac_jsonw_t *json, const char *fmt, ...)
 	free(buf);
 }
 
+static inline size_t indenter_sz(const ac_jsonw_t *json)
+{
+	return json->indenter ? strlen(json->indenter) + 1 : 0;
+}
+
 /**
- * ac_jsonw_init - initialises a new ac_jsonw_t object
+ * ac_jsonw_init_with_allocator - initialises a new ac_jsonw_t object
+ *
+ * @alloc: The allocator to use for the object's memory, it is copied.
+ *         NULL for the default
  *
  * Returns:
  *
  * A newly initialised ac_jsonw_t object.
  */
-ac_jsonw_t *ac_jsonw_init(void)
+ac_jsonw_t *ac_jsonw_init_with_allocator(const ac_allocator_t *alloc)
 {
-	ac_jsonw_t *json = malloc(sizeof(ac_jsonw_t));
+	ac_jsonw_t *json = mem_alloc(alloc, sizeof(ac_jsonw_t));
 
-	json->str = malloc(ALLOC_SZ);
+	mem_set_allocator(&json->alloc, alloc);
+	json->str = mem_alloc(alloc, ALLOC_SZ);
 	json->allocated = ALLOC_SZ;
 	json->depth = 1;
 	json->skip_tabs = false;
@@ -79,6 +100,39 @@ ac_jsonw_t *ac_jsonw_init(void)
 	return json;
 }
 
+/**
+ * ac_jsonw_init - initialises a new ac_jsonw_t object
+ *
+ * Returns:
+ *
+ * A newly initialised ac_jsonw_t object.
+ */
+ac_jsonw_t *ac_jsonw_init(void)
+{
+	return ac_jsonw_init_with_allocator(NULL);
+}
+
+/**
+ * ac_jsonw_init_arena - initialises a new ac_jsonw_t object in an arena
+ *
+ * @arena: The arena to allocate from
+ *
+ * The object is free'd by resetting or destroying the arena, calling
+ * ac_jsonw_free() is not required.
+ *
+ * Returns:
+ *
+ * A newly initialised ac_jsonw_t object.
+ */
+ac_jsonw_t *ac_jsonw_init_arena(ac_arena_t *arena)
+{
+	ac_allocator_t alloc;
+
+	ac_arena_allocator(arena, &alloc);
+
+	return ac_jsonw_init_with_allocator(&alloc);
+}
+
 /**
  * ac_jsonw_indent_sz - set the number of spaces to use for indentation
  *
@@ -90,7 +144,8 @@ void ac_jsonw_indent_sz(ac_jsonw_t *json, int size)
 	if (size < 1 || size > 16)
 		return;
 
-	json->indenter = malloc(size + 1);
+	mem_free(&json->alloc, json->indenter, indenter_sz(json));
+	json->indenter = mem_alloc(&json->alloc, size + 1);
 	memset(json->indenter, ' ', size);
 	json->indenter[size] = '\0';
 }
@@ -103,13 +158,16 @@ void ac_jsonw_indent_sz(ac_jsonw_t *json, int size)
  */
 void ac_jsonw_set_indenter(ac_jsonw_t *json, const char *indenter)
 {
-	json->indenter = strdup(indenter);
+	mem_free(&json->alloc, json->indenter, indenter_sz(json));
+	json->indenter = mem_strdup(&json->alloc, indenter);
 }
 
-static inline void add_char(char *string, char c, size_t *offset)
+/* Control characters without a short escape, as \u00XX */
+static inline void add_uescaped_char(char *string, unsigned char c,
+				     size_t *offset)
 {
-	memset(string + *offset, c, 1);
-	(*offset)++;
+	snprintf(string + *offset, 7, "\\u%04x", c);
+	*offset += 6;
 }
 
 static inline void add_escaped_str(char *string, const char *escaped,
@@ -119,24 +177,28 @@ static inline void add_escaped_str(char *string, const char *escaped,
 	*offset += len;
 }
 
-static char *make_escaped_string(const char *str)
+static char *make_escaped_string(ac_jsonw_t *json, const char *str,
+				 size_t len, size_t size)
 {
 	char *estring;
-	char c;
 	size_t offset = 0;
 
-	/* strlen(str) * 6 for worst case scenario; all \uXXXX */
-	estring = malloc((strlen(str) * 6) + 1);
+	estring = mem_alloc(&json->alloc, size);
+
+	for (;;) {
+		/* Copy the run of characters not needing escaping in one go */
+		size_t span = cpu_kernels.json_escape_span(str, len);
+		unsigned char c;
 
-	while ((c = *str++) != '\0') {
-		if (c < 0x20 &&
-		    (c != '\b' && c != '\f' && c != '\t' && c != '\n' &&
-		     c != '\r')) {
-			snprintf(estring + offset, 7, "\\u%04x", c);
-			offset += 6;
-			continue;
-		}
+		memcpy(estring + offset, str, span);
+		offset += span;
+		str += span;
+		len -= span;
+		if (len == 0)
+			break;
 
+		c = *str++;
+		len--;
 		if (c == '"')
 			add_escaped_str(estring, "\\\"", &offset, 2);
 		else if (c == '\\')
@@ -152,7 +214,7 @@ static char *make_escaped_string(const char *str)
 		else if (c == '\t')
 			add_escaped_str(estring, "\\t", &offset, 2);
 		else
-			add_char(estring, c, &offset);
+			add_uescaped_char(estring, c, &offset);
 	}
 	estring[offset] = '\0';
 
@@ -171,7 +233,10 @@ static char *make_escaped_string(const char *str)
  */
 void ac_jsonw_add_str(ac_jsonw_t *json, const char *name, const char *value)
 {
-	char *escaped_string = make_escaped_string(value);
+	size_t len = strlen(value);
+	/* len * 6 for worst case scenario; all \uXXXX */
+	size_t size = (len * 6) + 1;
+	char *escaped_string = make_escaped_string(json, value, len, size);
 
 	if (name)
 		json_build_str(json, "\"%s\": \"%s\",\n", name,
@@ -179,7 +244,7 @@ void ac_jsonw_add_str(ac_jsonw_t *json, const char *name, const char *value)
 	else
 		json_build_str(json, "\"%s\",\n", escaped_string);
 
-	free(escaped_string);
+	mem_free(&json->alloc, escaped_string, size);
 }
 
 /**
@@ -384,9 +449,9 @@ void ac_jsonw_free(const ac_jsonw_t *json)
 	if (!json)
 		return;
 
-	free(json->str);
-	free(json->indenter);
-	free((void *)json);
+	mem_free(&json->alloc, json->str, json->allocated);
+	mem_free(&json->alloc, json->indenter, indenter_sz(json));
+	mem_free(&json->alloc, (void *)json, sizeof(ac_jsonw_t));
 }
 
 /**
@@ -400,7 +465,7 @@ void ac_jsonw_free(const ac_jsonw_t *json)
  */
 size_t ac_jsonw_len(const ac_jsonw_t *json)
 {
-	return json->len;
+	return __ac_jsonw_len(json);
 }
 
 /**
@@ -414,5 +479,5 @@ size_t ac_jsonw_len(const ac_jsonw_t *json)
  */
 const char *ac_jsonw_get(const ac_jsonw_t *json)
 {
-	return json->str;
+	return __ac_jsonw_get(json);
 }
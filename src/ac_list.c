@@ -12,6 +12,7 @@
 #include <stdbool.h>
 
 #include "include/libac.h"
+#include "ac_alloc.h"
 
 /**
  * ac_list_last - find the last item in the list
@@ -52,14 +53,16 @@ long ac_list_len(const ac_list_t *list)
 }
 
 /**
- * ac_list_add - add an item to the end of the list
+ * ac_list_add_with_allocator - add an item to the end of the list
  *
  * @list: The list to add the item to
  * @data: The data to add
+ * @alloc: The allocator for the list nodes, NULL for the default
  */
-void ac_list_add(ac_list_t **list, void *data)
+void ac_list_add_with_allocator(ac_list_t **list, void *data,
+				const ac_allocator_t *alloc)
 {
-	ac_list_t *new = malloc(sizeof(ac_list_t));
+	ac_list_t *new = mem_alloc(alloc, sizeof(ac_list_t));
 
 	new->data = data;
 	new->next = NULL;
@@ -76,17 +79,30 @@ void ac_list_add(ac_list_t **list, void *data)
 }
 
 /**
- * ac_list_preadd - add an item to the front of the list
+ * ac_list_add - add an item to the end of the list
+ *
+ * @list: The list to add the item to
+ * @data: The data to add
+ */
+void ac_list_add(ac_list_t **list, void *data)
+{
+	ac_list_add_with_allocator(list, data, NULL);
+}
+
+/**
+ * ac_list_preadd_with_allocator - add an item to the front of the list
  *
  * @list: The list to add the item to
  * @data: The data to add
+ * @alloc: The allocator for the list nodes, NULL for the default
  *
  * This would be quicker than ac_list_add when adding multiple items,
  * so it may be better to use this function and then ac_list_reverse()
  */
-void ac_list_preadd(ac_list_t **list, void *data)
+void ac_list_preadd_with_allocator(ac_list_t **list, void *data,
+				   const ac_allocator_t *alloc)
 {
-	ac_list_t *new = malloc(sizeof(ac_list_t));
+	ac_list_t *new = mem_alloc(alloc, sizeof(ac_list_t));
 
 	new->data = data;
 	new->prev = NULL;
@@ -99,18 +115,34 @@ void ac_list_preadd(ac_list_t **list, void *data)
 }
 
 /**
- * ac_list_remove - remove an item from the list
+ * ac_list_preadd - add an item to the front of the list
+ *
+ * @list: The list to add the item to
+ * @data: The data to add
+ *
+ * This would be quicker than ac_list_add when adding multiple items,
+ * so it may be better to use this function and then ac_list_reverse()
+ */
+void ac_list_preadd(ac_list_t **list, void *data)
+{
+	ac_list_preadd_with_allocator(list, data, NULL);
+}
+
+/**
+ * ac_list_remove_with_allocator - remove an item from the list
  *
  * @list: The list to remove the item from
  * @data: The data to be removed
  * @free_data: An optional pointer to a function to call to free the item data
+ * @alloc: The allocator for the list nodes, NULL for the default
  *
  * Returns:
  *
  * true if the item was found and removed, false otherwise
  */
-bool ac_list_remove(ac_list_t **list, void *data,
-		    void (*free_data)(void *data))
+bool ac_list_remove_with_allocator(ac_list_t **list, void *data,
+				   void (*free_data)(void *data),
+				   const ac_allocator_t *alloc)
 {
 	ac_list_t **pp = list;
 	ac_list_t *p;
@@ -126,7 +158,7 @@ bool ac_list_remove(ac_list_t **list, void *data,
 
 			if (free_data)
 				free_data(p->data);
-			free(p);
+			mem_free(alloc, p, sizeof(ac_list_t));
 			ret = true;
 			break;
 		}
@@ -137,18 +169,37 @@ bool ac_list_remove(ac_list_t **list, void *data,
 }
 
 /**
- * ac_list_remove_nth - remove the nth item from the list
+ * ac_list_remove - remove an item from the list
+ *
+ * @list: The list to remove the item from
+ * @data: The data to be removed
+ * @free_data: An optional pointer to a function to call to free the item data
+ *
+ * Returns:
+ *
+ * true if the item was found and removed, false otherwise
+ */
+bool ac_list_remove(ac_list_t **list, void *data,
+		    void (*free_data)(void *data))
+{
+	return ac_list_remove_with_allocator(list, data, free_data, NULL);
+}
+
+/**
+ * ac_list_remove_nth_with_allocator - remove the nth item from the list
  *
  * @list: The list to remove the item from
  * @n: The position of the item to be removed. Starting at 0
  * @free_data: An optional pointer to a function to call to free the item data
+ * @alloc: The allocator for the list nodes, NULL for the default
  *
  * Returns:
  *
  * true if the item was found and removed, false otherwise
  */
-bool ac_list_remove_nth(ac_list_t **list, long n,
-			void (*free_data)(void *data))
+bool ac_list_remove_nth_with_allocator(ac_list_t **list, long n,
+				       void (*free_data)(void *data),
+				       const ac_allocator_t *alloc)
 {
 	ac_list_t **pp = list;
 	ac_list_t *p;
@@ -165,7 +216,7 @@ bool ac_list_remove_nth(ac_list_t **list, long n,
 
 			if (free_data)
 				free_data(p->data);
-			free(p);
+			mem_free(alloc, p, sizeof(ac_list_t));
 			ret = true;
 			break;
 		}
@@ -176,20 +227,39 @@ bool ac_list_remove_nth(ac_list_t **list, long n,
 }
 
 /**
- * ac_list_remove_custom - remove an item from the list with the given data
+ * ac_list_remove_nth - remove the nth item from the list
+ *
+ * @list: The list to remove the item from
+ * @n: The position of the item to be removed. Starting at 0
+ * @free_data: An optional pointer to a function to call to free the item data
+ *
+ * Returns:
+ *
+ * true if the item was found and removed, false otherwise
+ */
+bool ac_list_remove_nth(ac_list_t **list, long n,
+			void (*free_data)(void *data))
+{
+	return ac_list_remove_nth_with_allocator(list, n, free_data, NULL);
+}
+
+/**
+ * ac_list_remove_custom_with_allocator - remove an item using an allocator
  *
  * @list: The list to remove the item from
  * @data: The data to be removed
  * @compar: A comparison function (should return 0 when item found)
  * @free_data: An optional pointer to a function to call to free the item data
+ * @alloc: The allocator for the list nodes, NULL for the default
  *
  * Returns:
  *
  * true if the item was found and removed, false otherwise
  */
-bool ac_list_remove_custom(ac_list_t **list, void *data,
-			   int (*compar)(const void *a, const void *b),
-			   void (*free_data)(void *data))
+bool ac_list_remove_custom_with_allocator(ac_list_t **list, void *data,
+				int (*compar)(const void *a, const void *b),
+				void (*free_data)(void *data),
+				const ac_allocator_t *alloc)
 {
 	ac_list_t **pp = list;
 	ac_list_t *p;
@@ -207,7 +277,7 @@ bool ac_list_remove_custom(ac_list_t **list, void *data,
 
 			if (free_data)
 				free_data(p->data);
-			free(p);
+			mem_free(alloc, p, sizeof(ac_list_t));
 			ret = true;
 			break;
 		}
@@ -217,6 +287,26 @@ bool ac_list_remove_custom(ac_list_t **list, void *data,
 	return ret;
 }
 
+/**
+ * ac_list_remove_custom - remove an item from the list with the given data
+ *
+ * @list: The list to remove the item from
+ * @data: The data to be removed
+ * @compar: A comparison function (should return 0 when item found)
+ * @free_data: An optional pointer to a function to call to free the item data
+ *
+ * Returns:
+ *
+ * true if the item was found and removed, false otherwise
+ */
+bool ac_list_remove_custom(ac_list_t **list, void *data,
+			   int (*compar)(const void *a, const void *b),
+			   void (*free_data)(void *data))
+{
+	return ac_list_remove_custom_with_allocator(list, data, compar,
+						    free_data, NULL);
+}
+
 /**
  * ac_list_reverse - reverse a list
  *
@@ -349,19 +439,33 @@ void ac_list_rev_foreach(ac_list_t *list,
 }
 
 /**
- * ac_list_destroy - destroy a list, optionally freeing all its items memory
+ * ac_list_destroy_with_allocator - destroy a list using an allocator
  *
  * @list: The list to destroy
  * @free_data: Function to free an items memory, can be NULL
+ * @alloc: The allocator for the list nodes, NULL for the default
  */
-void ac_list_destroy(ac_list_t **list, void (*free_data)(void *data))
+void ac_list_destroy_with_allocator(ac_list_t **list,
+				    void (*free_data)(void *data),
+				    const ac_allocator_t *alloc)
 {
 	while (*list) {
 		ac_list_t *p = (*list)->next;
 
 		if (free_data)
 			free_data((*list)->data);
-		free(*list);
+		mem_free(alloc, *list, sizeof(ac_list_t));
 		*list = p;
 	}
 }
+
+/**
+ * ac_list_destroy - destroy a list, optionally freeing all its items memory
+ *
+ * @list: The list to destroy
+ * @free_data: Function to free an items memory, can be NULL
+ */
+void ac_list_destroy(ac_list_t **list, void (*free_data)(void *data))
+{
+	ac_list_destroy_with_allocator(list, free_data, NULL);
+}
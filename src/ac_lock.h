@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_lock.h - Optional locking for the containers
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#ifndef _AC_LOCK_H_
+#define _AC_LOCK_H_
+
+#include <pthread.h>
+#include <errno.h>
+
+#include "include/libac.h"
+#include "ac_alloc.h"
+
+/*
+ * A container only has a lock after ac_*_set_thread_safe() has been
+ * called on it, otherwise it's NULL and these are a no-op.
+ *
+ * The allocator may not set errno, so set it here if it fails.
+ */
+static inline pthread_rwlock_t *rwlock_new(const ac_allocator_t *alloc)
+{
+	pthread_rwlock_t *lock = mem_alloc(alloc, sizeof(pthread_rwlock_t));
+
+	if (!lock) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	pthread_rwlock_init(lock, NULL);
+
+	return lock;
+}
+
+static inline void rwlock_destroy(const ac_allocator_t *alloc,
+				  pthread_rwlock_t *lock)
+{
+	if (!lock)
+		return;
+
+	pthread_rwlock_destroy(lock);
+	mem_free(alloc, lock, sizeof(pthread_rwlock_t));
+}
+
+static inline void rwlock_rdlock(pthread_rwlock_t *lock)
+{
+	if (lock)
+		pthread_rwlock_rdlock(lock);
+}
+
+static inline void rwlock_wrlock(pthread_rwlock_t *lock)
+{
+	if (lock)
+		pthread_rwlock_wrlock(lock);
+}
+
+static inline void rwlock_unlock(pthread_rwlock_t *lock)
+{
+	if (lock)
+		pthread_rwlock_unlock(lock);
+}
+
+static inline pthread_mutex_t *mutex_new(const ac_allocator_t *alloc)
+{
+	pthread_mutex_t *lock = mem_alloc(alloc, sizeof(pthread_mutex_t));
+
+	if (!lock) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	pthread_mutex_init(lock, NULL);
+
+	return lock;
+}
+
+static inline void mutex_destroy(const ac_allocator_t *alloc,
+				 pthread_mutex_t *lock)
+{
+	if (!lock)
+		return;
+
+	pthread_mutex_destroy(lock);
+	mem_free(alloc, lock, sizeof(pthread_mutex_t));
+}
+
+static inline void mutex_lock(pthread_mutex_t *lock)
+{
+	if (lock)
+		pthread_mutex_lock(lock);
+}
+
+static inline void mutex_unlock(pthread_mutex_t *lock)
+{
+	if (lock)
+		pthread_mutex_unlock(lock);
+}
+
+#endif /* _AC_LOCK_H_ */
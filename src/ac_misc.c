@@ -13,13 +13,16 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 #if __linux__
 #include <crypt.h>
-#elif __FreeBSD__
-#include <unistd.h>
 #endif
-#include <time.h>
+#include <unistd.h>
 #include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "include/libac.h"
 #include "platform.h"
@@ -33,11 +36,9 @@
 #define E(si)	((si) ? (u64)1000*1000*1000*1000*1000*1000 : \
 			(u64)1024*1024*1024*1024*1024*1024)
 
-#define PRNG_BUFSZ	32
-
 static void ppp_set_prefix(ac_si_units_t si, ac_misc_ppb_t *ppb)
 {
-	const char *pfx;
+	const char *pfx = NULL;
 
 	switch (ppb->factor) {
 	case AC_MISC_PPB_BYTES:
@@ -102,6 +103,134 @@ void ac_misc_ppb(u64 bytes, ac_si_units_t si, ac_misc_ppb_t *ppb)
 	ppp_set_prefix(si, ppb);
 }
 
+static const u64 pow10_tbl[20] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+static const char * const ppb_prefixes[2][7] = {
+	{ "bytes", "KiB", "MiB", "GiB", "TiB", "PiB", "EiB" },
+	{ "bytes", "KB", "MB", "GB", "TB", "PB", "EB" }
+};
+
+/* Which power of 1000 or 1024 bytes falls in, without any division */
+static inline int ppb_factor(u64 bytes, ac_si_units_t si)
+{
+	int bits;
+	int digits;
+
+	if (bytes == 0)
+		return 0;
+
+	bits = 64 - __builtin_clzll(bytes);
+	if (si == AC_SI_UNITS_NO)
+		return (bits - 1) / 10;
+
+	/* log10(2) ~= 1233/4096 */
+	digits = (bits * 1233) >> 12;
+	if (bytes >= pow10_tbl[digits])
+		digits++;
+
+	return (digits - 1) / 3;
+}
+
+static inline char *ppb_put_u32(char *p, u32 val)
+{
+	char buf[10];
+	int len = 0;
+
+	do {
+		buf[len++] = '0' + val % 10;
+	} while ((val /= 10) > 0);
+
+	while (len)
+		*p++ = buf[--len];
+
+	return p;
+}
+
+/**
+ * ac_misc_ppb_str - pretty print bytes into a string
+ *
+ * @bytes: The bytes value to pretty print
+ * @si: Whether to use SI units or not, can be either; AC_SI_UNITS_NO or
+ *      AC_SI_UNITS_YES
+ * @dst: A buffer of size AC_MISC_PPB_STR_LEN + 1 to store the result
+ *
+ * The result is formatted like ac_misc_ppb()'s value & prefix printed with
+ * "%hu %s" or "%.2f %s", e.g "512 bytes" or "14.57 MB", but is done with
+ * integer arithmetic and without printf.
+ *
+ * Returns:
+ *
+ * A pointer to the nul terminated string in @dst
+ */
+const char *ac_misc_ppb_str(u64 bytes, ac_si_units_t si, char *dst)
+{
+	int factor = ppb_factor(bytes, si);
+	const char *pfx = ppb_prefixes[si == AC_SI_UNITS_YES][factor];
+	char *p = dst;
+
+	if (factor == 0) {
+		p = ppb_put_u32(p, bytes);
+	} else {
+		u64 unit = si == AC_SI_UNITS_YES ? pow10_tbl[factor * 3] :
+						   1ULL << (factor * 10);
+		u64 whole = bytes / unit;
+		u64 rem = bytes % unit;
+		u64 frac;
+
+		/* Round to two decimal places, avoiding overflowing rem */
+		if (unit <= UINT64_MAX / 100)
+			frac = (rem * 100 + unit / 2) / unit;
+		else
+			frac = (rem + unit / 200) / (unit / 100);
+		if (frac == 100) {
+			whole++;
+			frac = 0;
+		}
+
+		p = ppb_put_u32(p, whole);
+		*p++ = '.';
+		*p++ = '0' + frac / 10;
+		*p++ = '0' + frac % 10;
+	}
+
+	*p++ = ' ';
+	while (*pfx)
+		*p++ = *pfx++;
+	*p = '\0';
+
+	return dst;
+}
+
+/**
+ * ac_misc_ppb_strm - pretty print a number of bytes values into strings
+ *
+ * @bytes: The bytes values to pretty print
+ * @nmemb: The number of values
+ * @si: Whether to use SI units or not, can be either; AC_SI_UNITS_NO or
+ *      AC_SI_UNITS_YES
+ * @dst: A buffer of size nmemb * (AC_MISC_PPB_STR_LEN + 1) to store the
+ *       results
+ *
+ * Each result is nul terminated and starts AC_MISC_PPB_STR_LEN + 1 bytes
+ * after the previous one.
+ */
+void ac_misc_ppb_strm(const u64 *bytes, size_t nmemb, ac_si_units_t si,
+		      char *dst)
+{
+	size_t i;
+
+	for (i = 0; i < nmemb; i++)
+		ac_misc_ppb_str(bytes[i], si,
+				dst + i * (AC_MISC_PPB_STR_LEN + 1));
+}
+
 /**
  * ac_misc_passcrypt - wrapper around crypt_r(3)
  *
@@ -119,9 +248,6 @@ char *ac_misc_passcrypt(const char *pass, ac_hash_algo_t hash_type,
 	const char salt_chars[64] =
 		"./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
 	char salt[21];
-	char statebuf[PRNG_BUFSZ];
-	struct random_data rndbuf = { .state = NULL };
-	struct timespec tp;
 	int i;
 
 	memset(salt, 0, sizeof(salt));
@@ -139,16 +265,8 @@ char *ac_misc_passcrypt(const char *pass, ac_hash_algo_t hash_type,
 		return NULL;
 	}
 
-	clock_gettime(CLOCK_REALTIME, &tp);
-	initstate_r(tp.tv_nsec / 3, statebuf, PRNG_BUFSZ, &rndbuf);
-
-	for (i = 3; i < 19; i++) {
-		int r;
-
-		random_r(&rndbuf, &r);
-		r %= 64; /* 0 - 63 */
-		salt[i] = salt_chars[r];
-	}
+	for (i = 3; i < 19; i++)
+		salt[i] = salt_chars[ac_rng_bounded(NULL, 64)];
 	salt[i] = '$';
 
 	data->initialized = 0;
@@ -156,14 +274,437 @@ char *ac_misc_passcrypt(const char *pass, ac_hash_algo_t hash_type,
 	return crypt_r(pass, salt, data);
 }
 
+/**
+ * ac_misc_passcrypt_verify - check a password against a crypted password
+ *
+ * @pass: The password to check
+ * @hash: The crypted password as returned by ac_misc_passcrypt()
+ * @data: Used as scratch space for crypt_r(3)
+ *
+ * The comparison takes the same time no matter where the crypted
+ * passwords differ.
+ *
+ * Returns:
+ *
+ * true if the password matches, false otherwise
+ */
+bool ac_misc_passcrypt_verify(const char *pass, const char *hash,
+			      ac_crypt_data_t *data)
+{
+	const char *crypted;
+	size_t len;
+	size_t i;
+	u8 diff = 0;
+
+	data->initialized = 0;
+	crypted = crypt_r(pass, hash, data);
+	/* Some implementations return a "*0" style failure token */
+	if (!crypted || *crypted == '*')
+		return false;
+
+	len = strlen(hash);
+	if (strlen(crypted) != len)
+		return false;
+
+	for (i = 0; i < len; i++)
+		diff |= crypted[i] ^ hash[i];
+
+	return diff == 0;
+}
+
+enum {
+	PASSCRYPT_OP_HASH,
+	PASSCRYPT_OP_VERIFY
+};
+
+struct passcrypt_req {
+	int op;
+	char *pass;
+	char *hash;
+	ac_hash_algo_t hash_type;
+
+	void (*done)(int status, const char *hash, void *user_data);
+	void *user_data;
+};
+
+struct passcrypt_worker {
+	pthread_t tid;
+	ac_misc_passcrypt_pool_t *pool;
+
+	/* struct crypt_data can be large, keep it off the stack */
+	ac_crypt_data_t data;
+};
+
+struct ac_misc_passcrypt_pool {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	ac_queue_t *queue;
+	unsigned int max_queued;
+	bool stop;
+
+	unsigned int nr_workers;
+	struct passcrypt_worker *workers;
+};
+
+/* Make sure the compiler can't optimise the clearing away */
+static void passcrypt_wipe(char *str)
+{
+	volatile char *p = str;
+
+	while (*p)
+		*p++ = '\0';
+}
+
+static void passcrypt_free_req(void *item)
+{
+	struct passcrypt_req *req = item;
+
+	passcrypt_wipe(req->pass);
+	free(req->pass);
+	free(req->hash);
+	free(req);
+}
+
+static void passcrypt_do_req(struct passcrypt_req *req, ac_crypt_data_t *data)
+{
+	const char *hash;
+	int status;
+
+	if (req->op == PASSCRYPT_OP_HASH) {
+		hash = ac_misc_passcrypt(req->pass, req->hash_type, data);
+		status = hash ? 0 : -1;
+	} else {
+		hash = NULL;
+		status = ac_misc_passcrypt_verify(req->pass, req->hash, data);
+	}
+
+	req->done(status, hash, req->user_data);
+}
+
+static void *passcrypt_worker(void *arg)
+{
+	struct passcrypt_worker *worker = arg;
+	ac_misc_passcrypt_pool_t *pool = worker->pool;
+
+	for (;;) {
+		struct passcrypt_req *req;
+
+		pthread_mutex_lock(&pool->mtx);
+		while (ac_queue_nr_items(pool->queue) == 0 && !pool->stop)
+			pthread_cond_wait(&pool->cond, &pool->mtx);
+		req = ac_queue_pop(pool->queue);
+		pthread_mutex_unlock(&pool->mtx);
+
+		/* Only empty when stopping */
+		if (!req)
+			break;
+
+		passcrypt_do_req(req, &worker->data);
+		passcrypt_free_req(req);
+	}
+
+	return NULL;
+}
+
+/**
+ * ac_misc_passcrypt_pool_new - create a password hashing worker pool
+ *
+ * @nr_workers: The number of worker threads
+ * @max_queued: The maximum number of requests waiting for a worker
+ *
+ * This allows the expensive password hashing & verification to be done
+ * away from the calling threads, with the results being passed to a
+ * callback.
+ *
+ * Returns:
+ *
+ * A pointer to the newly created pool or NULL on failure, check errno
+ */
+ac_misc_passcrypt_pool_t *ac_misc_passcrypt_pool_new(unsigned int nr_workers,
+						     unsigned int max_queued)
+{
+	ac_misc_passcrypt_pool_t *pool;
+	int err;
+
+	if (nr_workers == 0 || max_queued == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pool = calloc(1, sizeof(ac_misc_passcrypt_pool_t));
+	if (!pool)
+		return NULL;
+
+	/* Includes each worker's crypt data, so they can't fail to start */
+	pool->workers = calloc(nr_workers, sizeof(struct passcrypt_worker));
+	pool->queue = ac_queue_new();
+	if (!pool->workers || !pool->queue) {
+		free(pool->workers);
+		ac_queue_destroy(pool->queue, NULL);
+		free(pool);
+		errno = ENOMEM;
+		return NULL;
+	}
+	pool->max_queued = max_queued;
+	pthread_mutex_init(&pool->mtx, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	for ( ; pool->nr_workers < nr_workers; pool->nr_workers++) {
+		struct passcrypt_worker *worker =
+			&pool->workers[pool->nr_workers];
+
+		worker->pool = pool;
+		err = pthread_create(&worker->tid, NULL, passcrypt_worker,
+				     worker);
+		if (err) {
+			ac_misc_passcrypt_pool_destroy(pool);
+			errno = err;
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+static int passcrypt_pool_submit(ac_misc_passcrypt_pool_t *pool,
+				 struct passcrypt_req *req)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pool->mtx);
+	if (ac_queue_nr_items(pool->queue) >= pool->max_queued) {
+		ret = -1;
+		errno = EAGAIN;
+	} else {
+		ac_queue_push(pool->queue, req);
+		pthread_cond_signal(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+
+	if (ret == -1)
+		passcrypt_free_req(req);
+
+	return ret;
+}
+
+static struct passcrypt_req *passcrypt_new_req(int op, const char *pass,
+					       const char *hash,
+					       void (*done)(int status,
+							    const char *hash,
+							    void *user_data),
+					       void *user_data)
+{
+	struct passcrypt_req *req;
+
+	req = calloc(1, sizeof(struct passcrypt_req));
+	if (!req)
+		return NULL;
+
+	req->op = op;
+	req->done = done;
+	req->user_data = user_data;
+	req->pass = strdup(pass);
+	if (hash)
+		req->hash = strdup(hash);
+	if (!req->pass || (hash && !req->hash)) {
+		if (req->pass)
+			passcrypt_wipe(req->pass);
+		free(req->pass);
+		free(req->hash);
+		free(req);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return req;
+}
+
+/**
+ * ac_misc_passcrypt_pool_hash - queue a password to be crypted
+ *
+ * @pool: The pool to use
+ * @pass: The password to crypt
+ * @hash_type: The type of hash to pass to crypt_r(3)
+ * @done: Called from a worker thread with the result
+ * @user_data: Passed through to @done
+ *
+ * @done is passed a status of 0 and the crypted password (which is only
+ * valid for the duration of the callback) or -1 and NULL on failure.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno (EAGAIN if the queue is full)
+ */
+int ac_misc_passcrypt_pool_hash(ac_misc_passcrypt_pool_t *pool,
+				const char *pass, ac_hash_algo_t hash_type,
+				void (*done)(int status, const char *hash,
+					     void *user_data),
+				void *user_data)
+{
+	struct passcrypt_req *req;
+
+	req = passcrypt_new_req(PASSCRYPT_OP_HASH, pass, NULL, done,
+				user_data);
+	if (!req)
+		return -1;
+	req->hash_type = hash_type;
+
+	return passcrypt_pool_submit(pool, req);
+}
+
+/**
+ * ac_misc_passcrypt_pool_verify - queue a password to be verified
+ *
+ * @pool: The pool to use
+ * @pass: The password to check
+ * @hash: The crypted password to check against
+ * @done: Called from a worker thread with the result
+ * @user_data: Passed through to @done
+ *
+ * @done is passed a status of 1 if the password matches or 0 if not and a
+ * NULL hash.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno (EAGAIN if the queue is full)
+ */
+int ac_misc_passcrypt_pool_verify(ac_misc_passcrypt_pool_t *pool,
+				  const char *pass, const char *hash,
+				  void (*done)(int status, const char *hash,
+					       void *user_data),
+				  void *user_data)
+{
+	struct passcrypt_req *req;
+
+	req = passcrypt_new_req(PASSCRYPT_OP_VERIFY, pass, hash, done,
+				user_data);
+	if (!req)
+		return -1;
+
+	return passcrypt_pool_submit(pool, req);
+}
+
+/**
+ * ac_misc_passcrypt_pool_destroy - destroy a password hashing worker pool
+ *
+ * @pool: The pool to destroy
+ *
+ * Any queued requests are completed before the workers exit.
+ */
+void ac_misc_passcrypt_pool_destroy(ac_misc_passcrypt_pool_t *pool)
+{
+	unsigned int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mtx);
+
+	for (i = 0; i < pool->nr_workers; i++)
+		pthread_join(pool->workers[i].tid, NULL);
+
+	/* Anything left if the workers couldn't get going */
+	ac_queue_destroy(pool->queue, passcrypt_free_req);
+	pthread_mutex_destroy(&pool->mtx);
+	pthread_cond_destroy(&pool->cond);
+	free(pool->workers);
+	free(pool);
+}
+
+/* Random bytes fetched from the kernel at a time, enough for 256 UUIDs */
+#define UUID_RAND_BUFSZ		4096
+#define UUID_BYTES		16
+
+#define HEX_ROW(h)	h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" \
+			h "8" h "9" h "a" h "b" h "c" h "d" h "e" h "f"
+/* The two hex digits for each byte value, "00" to "ff" */
+static const char hex_pairs[] =
+	HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3")
+	HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7")
+	HEX_ROW("8") HEX_ROW("9") HEX_ROW("a") HEX_ROW("b")
+	HEX_ROW("c") HEX_ROW("d") HEX_ROW("e") HEX_ROW("f");
+
+static __thread u8 uuid_rand[UUID_RAND_BUFSZ];
+static __thread size_t uuid_rand_off = UUID_RAND_BUFSZ;
+static __thread u64 uuid7_last_ms;
+static __thread u16 uuid7_seq;
+static pthread_once_t uuid_atfork_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Don't let a child process hand out the same UUIDs as its parent from
+ * the inherited random buffer.
+ */
+static void uuid_atfork_child(void)
+{
+	uuid_rand_off = UUID_RAND_BUFSZ;
+	uuid7_last_ms = 0;
+}
+
+static void uuid_register_atfork(void)
+{
+	pthread_atfork(NULL, NULL, uuid_atfork_child);
+}
+
+static const u8 *uuid_get_random(void)
+{
+	const u8 *p;
+
+	if (uuid_rand_off == UUID_RAND_BUFSZ) {
+		pthread_once(&uuid_atfork_once, uuid_register_atfork);
+		if (get_random_bytes(uuid_rand, sizeof(uuid_rand)) == -1)
+			return NULL;
+		uuid_rand_off = 0;
+	}
+
+	p = uuid_rand + uuid_rand_off;
+	uuid_rand_off += UUID_BYTES;
+
+	return p;
+}
+
+static void uuid_format(char *dst, const u8 *uuid)
+{
+	int i;
+
+	for (i = 0; i < UUID_BYTES; i++) {
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			*dst++ = '-';
+		memcpy(dst, hex_pairs + uuid[i] * 2, 2);
+		dst += 2;
+	}
+	*dst = '\0';
+}
+
+static char *gen_uuid4(char *dst)
+{
+	const u8 *rand = uuid_get_random();
+	u8 uuid[UUID_BYTES];
+
+	if (!rand)
+		return NULL;
+
+	memcpy(uuid, rand, UUID_BYTES);
+	uuid[6] = (uuid[6] & 0x0f) | 0x40;	/* version 4 */
+	uuid[8] = (uuid[8] & 0x3f) | 0x80;	/* RFC 4122 variant */
+	uuid_format(dst, uuid);
+
+	return dst;
+}
+
 /**
  * ac_misc_gen_uuid4 - generate a type 4 UUID
  *
  * @dst: A buffer of size AC_UUID4_LEN + 1 to store the UUID
  *
+ * The random bytes are fetched from the kernel via getrandom(2) in large
+ * blocks into a per-thread buffer.
+ *
  * Returns:
  *
- * A nul terminated type 4 UUID (taken from /proc/sys/kernel/random/uuid)
+ * A nul terminated type 4 UUID
  *
  * or
  *
@@ -171,9 +712,92 @@ char *ac_misc_passcrypt(const char *pass, ac_hash_algo_t hash_type,
  */
 const char *ac_misc_gen_uuid4(char *dst)
 {
-	return gen_uuid(dst);
+	return gen_uuid4(dst);
+}
+
+/**
+ * ac_misc_gen_uuid4_many - generate a number of type 4 UUIDs
+ *
+ * @dst: A buffer of size nmemb * (AC_UUID4_LEN + 1) to store the UUIDs
+ * @nmemb: The number of UUIDs to generate
+ *
+ * Each UUID is nul terminated and starts AC_UUID4_LEN + 1 bytes after the
+ * previous one.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno
+ */
+int ac_misc_gen_uuid4_many(char *dst, size_t nmemb)
+{
+	size_t i;
+
+	for (i = 0; i < nmemb; i++) {
+		if (!gen_uuid4(dst + i * (AC_UUID4_LEN + 1)))
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * ac_misc_gen_uuid7 - generate a type 7 (time ordered) UUID
+ *
+ * @dst: A buffer of size AC_UUID7_LEN + 1 to store the UUID
+ *
+ * The first 48 bits are the Unix time in milliseconds followed by a 12 bit
+ * counter which is randomly initialised each millisecond, so UUIDs
+ * generated by a thread are always increasing. The remaining 62 bits are
+ * random. These make for better database keys than type 4 UUIDs.
+ *
+ * Returns:
+ *
+ * A nul terminated type 7 UUID
+ *
+ * or
+ *
+ * NULL on failure, check errno
+ */
+const char *ac_misc_gen_uuid7(char *dst)
+{
+	const u8 *rand = uuid_get_random();
+	u8 uuid[UUID_BYTES];
+	struct timespec ts;
+	u64 ms;
+	int i;
+
+	if (!rand)
+		return NULL;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ms = ts.tv_sec * 1000ULL + ts.tv_nsec / AC_TIME_NS_MSEC;
+	if (ms > uuid7_last_ms) {
+		uuid7_last_ms = ms;
+		/* Leave the top bit clear to give room for the counter */
+		uuid7_seq = (rand[6] << 8 | rand[7]) & 0x7ff;
+	} else if (++uuid7_seq > 0xfff) {
+		/* Counter overflowed (or the clock went back), move on */
+		uuid7_last_ms++;
+		uuid7_seq = 0;
+	}
+	ms = uuid7_last_ms;
+
+	for (i = 5; i >= 0; i--) {
+		uuid[i] = ms & 0xff;
+		ms >>= 8;
+	}
+	uuid[6] = 0x70 | (uuid7_seq >> 8);	/* version 7 */
+	uuid[7] = uuid7_seq & 0xff;
+	memcpy(uuid + 8, rand + 8, UUID_BYTES - 8);
+	uuid[8] = (uuid[8] & 0x3f) | 0x80;	/* RFC 4122 variant */
+	uuid_format(dst, uuid);
+
+	return dst;
 }
 
+/* Luhn doubled digit values, 2 * n with 10 - 18 having their digits summed */
+static const u8 luhn_dbl[10] = { 0, 2, 4, 6, 8, 1, 3, 5, 7, 9 };
+
 /**
  * ac_misc_luhn_check - perform the Luhn Check on a number
  *
@@ -198,11 +822,8 @@ bool ac_misc_luhn_check(u64 num)
 	do {
 		u8 digit = num % 10;
 
-		if (alt) {
-			digit *= 2;
-			if (digit > 9)
-				digit = (digit % 10) + 1;
-		}
+		if (alt)
+			digit = luhn_dbl[digit];
 		alt = !alt;
 
 		sum += digit;
@@ -211,31 +832,423 @@ bool ac_misc_luhn_check(u64 num)
 	return !(sum % 10);
 }
 
-static void shuffle_fisher_yates(void *base, size_t nmemb, size_t size)
+#ifdef __SSE2__
+/*
+ * Luhn sum of 16 digit characters, the even lanes (the odd positions
+ * counting from the right) are doubled. Returns -1 if there are any non
+ * digits.
+ */
+static inline int luhn_sum16(const char *s)
 {
-	char *statebuf;
-	struct random_data rndbuf = { 0 };
-	struct timespec tp;
-	void *tmp = malloc(size);
+	const __m128i dbl_lanes = _mm_set1_epi16(0x00ff);
+	const __m128i nine = _mm_set1_epi8(9);
+	__m128i v;
+	__m128i d;
+	__m128i sum;
+
+	v = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)s),
+			 _mm_set1_epi8('0'));
+	/* Anything outside '0' - '9' is now > 9 as unsigned */
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, nine), nine)) !=
+	    0xffff)
+		return -1;
+
+	/* 2n, less 9 where that's > 9 which is the same as summing digits */
+	d = _mm_add_epi8(v, v);
+	d = _mm_sub_epi8(d, _mm_and_si128(_mm_cmpgt_epi8(d, nine), nine));
+	v = _mm_or_si128(_mm_and_si128(dbl_lanes, d),
+			 _mm_andnot_si128(dbl_lanes, v));
+
+	/* Horizontal sum into the two 64 bit halves */
+	sum = _mm_sad_epu8(v, _mm_setzero_si128());
+
+	return _mm_cvtsi128_si32(sum) +
+	       _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+}
+
+static bool luhn_check_str(const char *str, size_t len)
+{
+	char head[16];
+	size_t rem = len % 16;
+	u32 sum = 0;
+	int s;
+
+	/*
+	 * Work back from the end in 16 digit chunks so the doubled digits
+	 * are always in the same lanes. Pad the front with '0's.
+	 */
+	while (len >= 16) {
+		len -= 16;
+		s = luhn_sum16(str + len);
+		if (s == -1)
+			return false;
+		sum += s;
+	}
+	if (rem) {
+		memset(head, '0', sizeof(head));
+		memcpy(head + sizeof(head) - rem, str, rem);
+		s = luhn_sum16(head);
+		if (s == -1)
+			return false;
+		sum += s;
+	}
+
+	return !(sum % 10);
+}
+#else
+static bool luhn_check_str(const char *str, size_t len)
+{
+	u32 sum = 0;
+	bool alt = false;
 
-	statebuf = calloc(1, PRNG_BUFSZ);
-	clock_gettime(CLOCK_REALTIME, &tp);
-	initstate_r(tp.tv_nsec / 3, statebuf, PRNG_BUFSZ, &rndbuf);
+	while (len--) {
+		u8 digit = str[len] - '0';
 
-	while (nmemb) {
-		int rnd;
+		if (digit > 9)
+			return false;
 
-		random_r(&rndbuf, &rnd);
-		rnd %= nmemb;
+		sum += alt ? luhn_dbl[digit] : digit;
+		alt = !alt;
+	}
 
-		memcpy(tmp, base + rnd * size, size);
-		memcpy(base + rnd * size, base + (nmemb - 1) * size, size);
-		memcpy(base + (nmemb - 1) * size, tmp, size);
+	return !(sum % 10);
+}
+#endif
+
+/**
+ * ac_misc_luhn_check_str - perform the Luhn Check on a string of digits
+ *
+ * @str: The digits to perform the luhn check on
+ * @len: The number of digits
+ *
+ * Unlike ac_misc_luhn_check() this isn't limited to numbers that fit in a
+ * u64 and it doesn't need to do a division per digit. On x86 it uses SSE2
+ * to check 16 digits at a time.
+ *
+ * Returns:
+ *
+ * true for pass, false otherwise or if @str contains any non digits
+ */
+bool ac_misc_luhn_check_str(const char *str, size_t len)
+{
+	/* Need at least two digits */
+	if (len < 2)
+		return false;
+
+	return luhn_check_str(str, len);
+}
+
+/**
+ * ac_misc_luhn_check_strm - perform the Luhn Check on a number of strings
+ *
+ * @strs: The strings of digits to check
+ * @lens: The length of each string or NULL if they're nul terminated
+ * @nmemb: The number of strings
+ * @results: Where the result for each string is stored, can be NULL
+ *
+ * Returns:
+ *
+ * The number of strings that passed
+ */
+size_t ac_misc_luhn_check_strm(const char * const *strs, const size_t *lens,
+			       size_t nmemb, bool *results)
+{
+	size_t nr_pass = 0;
+	size_t i;
+
+	for (i = 0; i < nmemb; i++) {
+		size_t len = lens ? lens[i] : strlen(strs[i]);
+		bool pass = ac_misc_luhn_check_str(strs[i], len);
+
+		if (results)
+			results[i] = pass;
+		nr_pass += pass;
+	}
+
+	return nr_pass;
+}
+
+/*
+ * Arrays smaller than this (in bytes) are simply Fisher-Yates shuffled in
+ * place, for larger ones we aim for buckets around this size so that each
+ * bucket's shuffle stays within the L2 cache.
+ */
+#define SHUFFLE_BUCKET_SZ	(256 * 1024)
+#define SHUFFLE_MAX_BUCKET_BITS	10
+#define SHUFFLE_MIN_PER_THREAD	65536
+#define SHUFFLE_MAX_THREADS	64U
+
+struct shuffle_ctx {
+	void *base;
+	void *tmp;
+	size_t size;
+	int bucket_bits;
+	size_t nr_buckets;
+	unsigned int nr_threads;
+	/* nr_threads x nr_buckets, counts then scatter offsets */
+	size_t *offs;
+	/* nr_buckets + 1 */
+	size_t *bucket_start;
+};
+
+struct shuffle_thread {
+	struct shuffle_ctx *ctx;
+	unsigned int idx;
+	u64 seed;
+	size_t start;
+	size_t end;
+};
+
+static inline void copy_elem(void *dst, const void *src, size_t size)
+{
+	switch (size) {
+	case 4:
+		memcpy(dst, src, 4);
+		break;
+	case 8:
+		memcpy(dst, src, 8);
+		break;
+	case 16:
+		memcpy(dst, src, 16);
+		break;
+	default:
+		memcpy(dst, src, size);
+	}
+}
+
+static inline void swap_elem(void *a, void *b, size_t size)
+{
+	switch (size) {
+	case 4: {
+		u32 x;
+		u32 y;
+
+		memcpy(&x, a, 4);
+		memcpy(&y, b, 4);
+		memcpy(a, &y, 4);
+		memcpy(b, &x, 4);
+		break;
+	}
+	case 8: {
+		u64 x;
+		u64 y;
+
+		memcpy(&x, a, 8);
+		memcpy(&y, b, 8);
+		memcpy(a, &y, 8);
+		memcpy(b, &x, 8);
+		break;
+	}
+	case 16: {
+		u64 x[2];
+		u64 y[2];
+
+		memcpy(x, a, 16);
+		memcpy(y, b, 16);
+		memcpy(a, y, 16);
+		memcpy(b, x, 16);
+		break;
+	}
+	default: {
+		/* Swap in stack sized pieces rather than malloc'ing */
+		u8 tmp[64];
+
+		while (size) {
+			size_t n = AC_MIN(size, sizeof(tmp));
+
+			memcpy(tmp, a, n);
+			memcpy(a, b, n);
+			memcpy(b, tmp, n);
+			a = (u8 *)a + n;
+			b = (u8 *)b + n;
+			size -= n;
+		}
+	}
+	}
+}
+
+static void shuffle_fisher_yates(void *base, size_t nmemb, size_t size)
+{
+	while (nmemb > 1) {
+		size_t rnd = ac_rng_bounded(NULL, nmemb);
 
 		--nmemb;
+		if (rnd != nmemb)
+			swap_elem(base + rnd * size, base + nmemb * size,
+				  size);
 	}
-	free(tmp);
-	free(statebuf);
+}
+
+/* Count how many of this thread's elements land in each bucket */
+static void *shuffle_count(void *arg)
+{
+	struct shuffle_thread *st = arg;
+	struct shuffle_ctx *ctx = st->ctx;
+	size_t *counts = ctx->offs + st->idx * ctx->nr_buckets;
+	int shift = 64 - ctx->bucket_bits;
+	ac_rng_t rng;
+	size_t i;
+
+	ac_rng_seed(&rng, AC_RNG_XOSHIRO256SS, st->seed);
+	for (i = st->start; i < st->end; i++)
+		counts[ac_rng_u64(&rng) >> shift]++;
+
+	return NULL;
+}
+
+/*
+ * Replay the same bucket choices as shuffle_count() and copy each element
+ * to its bucket in the temporary array. Each thread has its own disjoint
+ * range within every bucket.
+ */
+static void *shuffle_scatter(void *arg)
+{
+	struct shuffle_thread *st = arg;
+	struct shuffle_ctx *ctx = st->ctx;
+	size_t *offs = ctx->offs + st->idx * ctx->nr_buckets;
+	size_t size = ctx->size;
+	int shift = 64 - ctx->bucket_bits;
+	ac_rng_t rng;
+	size_t i;
+
+	ac_rng_seed(&rng, AC_RNG_XOSHIRO256SS, st->seed);
+	for (i = st->start; i < st->end; i++) {
+		size_t b = ac_rng_u64(&rng) >> shift;
+
+		copy_elem(ctx->tmp + offs[b]++ * size, ctx->base + i * size,
+			  size);
+	}
+
+	return NULL;
+}
+
+/* Shuffle each of this thread's buckets and copy them back into place */
+static void *shuffle_buckets(void *arg)
+{
+	struct shuffle_thread *st = arg;
+	struct shuffle_ctx *ctx = st->ctx;
+	size_t size = ctx->size;
+	size_t b;
+
+	for (b = st->idx; b < ctx->nr_buckets; b += ctx->nr_threads) {
+		size_t off = ctx->bucket_start[b] * size;
+		size_t n = ctx->bucket_start[b + 1] - ctx->bucket_start[b];
+
+		shuffle_fisher_yates(ctx->tmp + off, n, size);
+		memcpy(ctx->base + off, ctx->tmp + off, n * size);
+	}
+
+	return NULL;
+}
+
+static void shuffle_run(struct shuffle_thread *sts, unsigned int nr_threads,
+			void *(*fn)(void *arg))
+{
+	pthread_t tids[SHUFFLE_MAX_THREADS];
+	bool started[SHUFFLE_MAX_THREADS];
+	unsigned int i;
+
+	for (i = 1; i < nr_threads; i++)
+		started[i] = pthread_create(&tids[i], NULL, fn, &sts[i]) == 0;
+
+	fn(&sts[0]);
+
+	/* If a thread couldn't be created, do its share ourselves */
+	for (i = 1; i < nr_threads; i++) {
+		if (started[i])
+			pthread_join(tids[i], NULL);
+		else
+			fn(&sts[i]);
+	}
+}
+
+/*
+ * A bucketed scatter shuffle (Rao-Sandelius). Every element is sent to a
+ * uniformly random bucket, then each bucket is Fisher-Yates shuffled. As
+ * each bucket fits in cache, this avoids the cache & TLB misses of doing
+ * random swaps across a large array, and both passes run in parallel.
+ *
+ * This needs a temporary copy of the array, if that can't be allocated we
+ * fall back to an in place Fisher-Yates shuffle.
+ */
+static void shuffle_bucketed(void *base, size_t nmemb, size_t size)
+{
+	struct shuffle_ctx ctx;
+	struct shuffle_thread sts[SHUFFLE_MAX_THREADS];
+	size_t bytes = nmemb * size;
+	size_t per_thread;
+	size_t pos = 0;
+	size_t b;
+	long nr_cpus;
+	unsigned int nr_threads;
+	unsigned int i;
+
+	if (bytes / 2 < SHUFFLE_BUCKET_SZ)
+		goto fisher_yates;
+
+	ctx.bucket_bits = 1;
+	while (ctx.bucket_bits < SHUFFLE_MAX_BUCKET_BITS &&
+	       bytes >> ctx.bucket_bits > SHUFFLE_BUCKET_SZ)
+		ctx.bucket_bits++;
+	ctx.nr_buckets = 1UL << ctx.bucket_bits;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nr_threads = AC_MIN(nmemb / SHUFFLE_MIN_PER_THREAD,
+			    (size_t)(nr_cpus > 0 ? nr_cpus : 1));
+	nr_threads = AC_MAX(nr_threads, 1U);
+	nr_threads = AC_MIN(nr_threads, SHUFFLE_MAX_THREADS);
+
+	ctx.tmp = malloc(bytes);
+	ctx.offs = calloc(nr_threads * ctx.nr_buckets, sizeof(size_t));
+	ctx.bucket_start = malloc((ctx.nr_buckets + 1) * sizeof(size_t));
+	if (!ctx.tmp || !ctx.offs || !ctx.bucket_start) {
+		free(ctx.tmp);
+		free(ctx.offs);
+		free(ctx.bucket_start);
+		goto fisher_yates;
+	}
+	ctx.base = base;
+	ctx.size = size;
+	ctx.nr_threads = nr_threads;
+
+	per_thread = nmemb / nr_threads;
+	for (i = 0; i < nr_threads; i++) {
+		sts[i].ctx = &ctx;
+		sts[i].idx = i;
+		sts[i].seed = ac_rng_u64(NULL);
+		sts[i].start = i * per_thread;
+		sts[i].end = i == nr_threads - 1 ? nmemb : (i + 1) * per_thread;
+	}
+
+	shuffle_run(sts, nr_threads, shuffle_count);
+
+	/*
+	 * Turn the counts into scatter offsets; bucket by bucket and within
+	 * each bucket, thread by thread.
+	 */
+	for (b = 0; b < ctx.nr_buckets; b++) {
+		ctx.bucket_start[b] = pos;
+		for (i = 0; i < nr_threads; i++) {
+			size_t *off = &ctx.offs[i * ctx.nr_buckets + b];
+			size_t count = *off;
+
+			*off = pos;
+			pos += count;
+		}
+	}
+	ctx.bucket_start[b] = pos;
+
+	shuffle_run(sts, nr_threads, shuffle_scatter);
+	shuffle_run(sts, nr_threads, shuffle_buckets);
+
+	free(ctx.tmp);
+	free(ctx.offs);
+	free(ctx.bucket_start);
+
+	return;
+
+fisher_yates:
+	shuffle_fisher_yates(base, nmemb, size);
 }
 
 /**
@@ -246,6 +1259,12 @@ static void shuffle_fisher_yates(void *base, size_t nmemb, size_t size)
  * @size: The size of each element
  * @algo: The shuffle algorithm to use
  *
+ * AC_MISC_SHUFFLE_FISHER_YATES does a single threaded in place shuffle.
+ *
+ * AC_MISC_SHUFFLE_BUCKETED is better suited to large arrays, it scatters
+ * the elements into cache sized buckets which are then shuffled, using
+ * multiple threads. It temporarily needs a copy of the array.
+ *
  * Returns:
  *
  * 0 on success, -1 if an unknown algorithm was specified
@@ -257,6 +1276,9 @@ int ac_misc_shuffle(void *base, size_t nmemb, size_t size,
 	case AC_MISC_SHUFFLE_FISHER_YATES:
 		shuffle_fisher_yates(base, nmemb, size);
 		break;
+	case AC_MISC_SHUFFLE_BUCKETED:
+		shuffle_bucketed(base, nmemb, size);
+		break;
 	default:
 		errno = EINVAL;
 		return -1;
@@ -265,7 +1287,6 @@ int ac_misc_shuffle(void *base, size_t nmemb, size_t size,
 	return 0;
 }
 
-#define GOLDEN_MUL	0x61C88647	/* From the Linux kernel */
 /**
  * ac_hash_func_str - create a hash value for a given string
  *
@@ -281,21 +1302,7 @@ int ac_misc_shuffle(void *base, size_t nmemb, size_t size,
  */
 u32 ac_hash_func_str(const void *key)
 {
-	size_t i = 0;
-	u32 hash = 0;
-	const char *k = key;
-	size_t len = strlen(k);
-
-	while (i != len) {
-		hash += k[i++];
-		hash += hash << 10;
-		hash ^= hash >> 6;
-	}
-	hash += hash << 3;
-	hash ^= hash >> 11;
-	hash += hash << 15;
-
-	return hash;
+	return __ac_hash_func_str(key);
 }
 
 /**
@@ -311,9 +1318,7 @@ u32 ac_hash_func_str(const void *key)
  */
 u32 ac_hash_func_u32(const void *key)
 {
-	const u32 k = *(const u32 *)key;
-
-	return k * GOLDEN_MUL;
+	return __ac_hash_func_u32(key);
 }
 
 /**
@@ -329,7 +1334,7 @@ u32 ac_hash_func_u32(const void *key)
  */
 u32 ac_hash_func_ptr(const void *key)
 {
-	return (const long)key * GOLDEN_MUL;
+	return __ac_hash_func_ptr(key);
 }
 
 /**
@@ -346,7 +1351,7 @@ u32 ac_hash_func_ptr(const void *key)
  */
 int ac_cmp_ptr(const void *a, const void *b)
 {
-	return !(a == b);
+	return __ac_cmp_ptr(a, b);
 }
 
 /**
@@ -363,10 +1368,7 @@ int ac_cmp_ptr(const void *a, const void *b)
  */
 int ac_cmp_str(const void *a, const void *b)
 {
-	const char *s1 = a;
-	const char *s2 = b;
-
-	return strcmp(s1, s2);
+	return __ac_cmp_str(a, b);
 }
 
 /**
@@ -383,8 +1385,5 @@ int ac_cmp_str(const void *a, const void *b)
  */
 int ac_cmp_u32(const void *a, const void *b)
 {
-	const u32 v1 = *(const u32 *)a;
-	const u32 v2 = *(const u32 *)b;
-
-	return !(v1 == v2);
+	return __ac_cmp_u32(a, b);
 }
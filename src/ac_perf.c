@@ -0,0 +1,448 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_perf.c - Hardware performance counters around named regions
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "include/libac.h"
+#include "platform.h"
+
+static const char * const perf_counter_names[AC_PERF_NR_COUNTERS] = {
+	"cycles",
+	"instructions",
+	"cache_misses",
+	"branch_misses"
+};
+
+/*
+ * The totals for a region in a thread. Only the owning thread changes
+ * these, they're read by ac_perf_stats() & ac_perf_to_json() with the
+ * perf lock held.
+ */
+struct perf_region {
+	u64 calls;
+	u64 ns;
+	u64 counted;
+	u64 counters[AC_PERF_NR_COUNTERS];
+
+	/* Where the current call started */
+	bool active;
+	bool start_valid;
+	u64 start_ns;
+	u64 start[AC_PERF_NR_COUNTERS];
+};
+
+struct perf_thread {
+	struct perf_thread *next;
+	struct ac_perf *perf;
+
+	long tid;
+	int fds[AC_PERF_NR_COUNTERS];
+	bool have_counters;
+
+	/* Only grown with the perf lock held */
+	int nr_regions;
+	struct perf_region *regions;
+};
+
+struct ac_perf {
+	ac_quark_t regions;
+
+	pthread_key_t key;
+	pthread_mutex_t lock;
+	struct perf_thread *threads;
+};
+
+static inline void perf_add(u64 *ptr, u64 value)
+{
+	__atomic_store_n(ptr, *ptr + value, __ATOMIC_RELAXED);
+}
+
+static inline u64 perf_load(const u64 *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+/* The thread's counters are closed when it exits, its totals are kept */
+static void perf_thread_exit(void *data)
+{
+	struct perf_thread *pt = data;
+
+	pthread_mutex_lock(&pt->perf->lock);
+	perf_events_close(pt->fds, AC_PERF_NR_COUNTERS);
+	pt->have_counters = false;
+	pthread_mutex_unlock(&pt->perf->lock);
+}
+
+static struct perf_thread *perf_thread(ac_perf_t *perf)
+{
+	struct perf_thread *pt = pthread_getspecific(perf->key);
+
+	if (pt)
+		return pt;
+
+	pt = calloc(1, sizeof(struct perf_thread));
+	if (!pt)
+		return NULL;
+	pt->perf = perf;
+	pt->tid = get_thread_id();
+	pt->have_counters = perf_events_open(pt->fds,
+					     AC_PERF_NR_COUNTERS) == 0;
+
+	pthread_mutex_lock(&perf->lock);
+	pt->next = perf->threads;
+	perf->threads = pt;
+	pthread_mutex_unlock(&perf->lock);
+
+	pthread_setspecific(perf->key, pt);
+
+	return pt;
+}
+
+static struct perf_region *perf_thread_region(ac_perf_t *perf,
+					      struct perf_thread *pt,
+					      int region)
+{
+	struct perf_region *regions;
+	int nr = region + 1;
+
+	if (region < 0)
+		return NULL;
+	if (region < pt->nr_regions)
+		return &pt->regions[region];
+
+	pthread_mutex_lock(&perf->lock);
+	/* Only ever grow to cover regions that actually exist */
+	if (region > perf->regions.last) {
+		pthread_mutex_unlock(&perf->lock);
+		return NULL;
+	}
+	regions = realloc(pt->regions, nr * sizeof(struct perf_region));
+	if (regions) {
+		memset(regions + pt->nr_regions, 0,
+		       (nr - pt->nr_regions) * sizeof(struct perf_region));
+		pt->regions = regions;
+		pt->nr_regions = nr;
+	}
+	pthread_mutex_unlock(&perf->lock);
+
+	return regions ? &regions[region] : NULL;
+}
+
+/**
+ * ac_perf_available - check if hardware performance counters can be used
+ *
+ * They may not be if the kernel has no perf events support, if
+ * /proc/sys/kernel/perf_event_paranoid is set too high, when running in a
+ * VM without a virtual PMU or when not on Linux. ac_perf still records the
+ * number of calls and elapsed time of each region when they're not.
+ *
+ * Returns:
+ *
+ * true if the counters are available, false otherwise
+ */
+bool ac_perf_available(void)
+{
+	int fds[AC_PERF_NR_COUNTERS];
+
+	if (perf_events_open(fds, AC_PERF_NR_COUNTERS) == -1)
+		return false;
+
+	perf_events_close(fds, AC_PERF_NR_COUNTERS);
+
+	return true;
+}
+
+/**
+ * ac_perf_new - create a new set of instrumented regions
+ *
+ * Returns:
+ *
+ * A pointer to the new ac_perf_t or NULL on failure
+ */
+ac_perf_t *ac_perf_new(void)
+{
+	ac_perf_t *perf = malloc(sizeof(ac_perf_t));
+	int err;
+
+	if (!perf)
+		return NULL;
+
+	err = pthread_key_create(&perf->key, perf_thread_exit);
+	if (err) {
+		free(perf);
+		errno = err;
+		return NULL;
+	}
+	pthread_mutex_init(&perf->lock, NULL);
+	ac_quark_init(&perf->regions, NULL);
+	perf->threads = NULL;
+
+	return perf;
+}
+
+/**
+ * ac_perf_region - get the id of a named region
+ *
+ * @perf: The ac_perf_t
+ * @name: The name of the region, it is copied
+ *
+ * This is best done once up front rather than on every call to
+ * ac_perf_start()/ac_perf_stop().
+ *
+ * Returns:
+ *
+ * The id of the region, the same id is returned for the same name
+ */
+int ac_perf_region(ac_perf_t *perf, const char *name)
+{
+	int id;
+
+	pthread_mutex_lock(&perf->lock);
+	id = ac_quark_from_string(&perf->regions, name);
+	pthread_mutex_unlock(&perf->lock);
+
+	return id;
+}
+
+/**
+ * ac_perf_start - start a call of a region in this thread
+ *
+ * @perf: The ac_perf_t
+ * @region: The id of the region from ac_perf_region()
+ *
+ * Different regions can be nested, but a region can't be started again in
+ * the same thread before it is stopped. When counters are available this
+ * costs a read(2) of the counters. An invalid region id is ignored.
+ */
+void ac_perf_start(ac_perf_t *perf, int region)
+{
+	struct perf_thread *pt = perf_thread(perf);
+	struct perf_region *pr;
+
+	if (!pt)
+		return;
+	pr = perf_thread_region(perf, pt, region);
+	if (!pr)
+		return;
+
+	pr->active = true;
+	pr->start_valid = pt->have_counters &&
+			  perf_events_read(pt->fds[0], pr->start,
+					   AC_PERF_NR_COUNTERS) == 0;
+	pr->start_ns = ac_time_clock_ns();
+}
+
+/**
+ * ac_perf_stop - stop a call of a region in this thread
+ *
+ * @perf: The ac_perf_t
+ * @region: The id of the region from ac_perf_region()
+ *
+ * Adds the elapsed time and counter deltas since the matching
+ * ac_perf_start() to the region's totals for this thread.
+ */
+void ac_perf_stop(ac_perf_t *perf, int region)
+{
+	u64 counters[AC_PERF_NR_COUNTERS];
+	u64 now = ac_time_clock_ns();
+	struct perf_thread *pt = pthread_getspecific(perf->key);
+	struct perf_region *pr;
+	int i;
+
+	/* A region beyond nr_regions can't have been started */
+	if (!pt || region < 0 || region >= pt->nr_regions)
+		return;
+	pr = &pt->regions[region];
+	if (!pr->active)
+		return;
+	pr->active = false;
+
+	perf_add(&pr->calls, 1);
+	perf_add(&pr->ns, now - pr->start_ns);
+
+	if (!pr->start_valid || !pt->have_counters ||
+	    perf_events_read(pt->fds[0], counters, AC_PERF_NR_COUNTERS) == -1)
+		return;
+
+	for (i = 0; i < AC_PERF_NR_COUNTERS; i++)
+		perf_add(&pr->counters[i], counters[i] - pr->start[i]);
+	perf_add(&pr->counted, 1);
+}
+
+static void perf_region_stats(const struct perf_region *pr,
+			      ac_perf_stats_t *stats)
+{
+	int i;
+
+	stats->calls += perf_load(&pr->calls);
+	stats->ns += perf_load(&pr->ns);
+	stats->counted += perf_load(&pr->counted);
+	for (i = 0; i < AC_PERF_NR_COUNTERS; i++)
+		stats->counters[i] += perf_load(&pr->counters[i]);
+}
+
+/**
+ * ac_perf_stats - get the totals for a region across all threads
+ *
+ * @perf: The ac_perf_t
+ * @region: The id of the region from ac_perf_region()
+ * @stats: Filled out with the totals
+ *
+ * The counters only cover stats->counted of the stats->calls calls, those
+ * made while counters were available.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 if there is no such region
+ */
+int ac_perf_stats(ac_perf_t *perf, int region, ac_perf_stats_t *stats)
+{
+	const struct perf_thread *pt;
+	int ret = 0;
+
+	memset(stats, 0, sizeof(ac_perf_stats_t));
+
+	pthread_mutex_lock(&perf->lock);
+	if (region < 0 || region > perf->regions.last) {
+		errno = EINVAL;
+		ret = -1;
+		goto out_unlock;
+	}
+
+	for (pt = perf->threads; pt; pt = pt->next) {
+		if (region < pt->nr_regions)
+			perf_region_stats(&pt->regions[region], stats);
+	}
+
+out_unlock:
+	pthread_mutex_unlock(&perf->lock);
+
+	return ret;
+}
+
+static void perf_stats_to_json(ac_jsonw_t *json, const char *name,
+			       const ac_perf_stats_t *stats)
+{
+	int i;
+
+	ac_jsonw_add_object(json, NULL);
+	ac_jsonw_add_str(json, "name", name);
+	ac_jsonw_add_int(json, "calls", stats->calls);
+	ac_jsonw_add_int(json, "ns", stats->ns);
+	ac_jsonw_add_int(json, "counted", stats->counted);
+	if (stats->counted) {
+		ac_jsonw_add_object(json, "counters");
+		for (i = 0; i < AC_PERF_NR_COUNTERS; i++)
+			ac_jsonw_add_int(json, perf_counter_names[i],
+					 stats->counters[i]);
+		ac_jsonw_end_object(json);
+	} else {
+		ac_jsonw_add_null(json, "counters");
+	}
+	ac_jsonw_end_object(json);
+}
+
+/**
+ * ac_perf_to_json - add the totals for all regions to a JSON object
+ *
+ * @perf: The ac_perf_t
+ * @json: The JSON writer to add it to
+ * @name: The name of the object, or NULL when adding to an array
+ *
+ * Adds an object containing the totals for each region across all threads
+ * and for each region in each thread. Regions with no calls are left out.
+ */
+void ac_perf_to_json(ac_perf_t *perf, ac_jsonw_t *json, const char *name)
+{
+	const struct perf_thread *pt;
+	int region;
+
+	pthread_mutex_lock(&perf->lock);
+
+	ac_jsonw_add_object(json, name);
+	ac_jsonw_add_array(json, "regions");
+	for (region = 0; region <= perf->regions.last; region++) {
+		ac_perf_stats_t stats;
+
+		memset(&stats, 0, sizeof(stats));
+		for (pt = perf->threads; pt; pt = pt->next) {
+			if (region < pt->nr_regions)
+				perf_region_stats(&pt->regions[region],
+						  &stats);
+		}
+		if (!stats.calls)
+			continue;
+
+		perf_stats_to_json(json,
+				   ac_quark_to_string(&perf->regions, region),
+				   &stats);
+	}
+	ac_jsonw_end_array(json);
+
+	ac_jsonw_add_array(json, "threads");
+	for (pt = perf->threads; pt; pt = pt->next) {
+		ac_jsonw_add_object(json, NULL);
+		ac_jsonw_add_int(json, "tid", pt->tid);
+		ac_jsonw_add_array(json, "regions");
+		for (region = 0; region < pt->nr_regions; region++) {
+			ac_perf_stats_t stats;
+
+			memset(&stats, 0, sizeof(stats));
+			perf_region_stats(&pt->regions[region], &stats);
+			if (!stats.calls)
+				continue;
+
+			perf_stats_to_json(json,
+					   ac_quark_to_string(&perf->regions,
+							      region),
+					   &stats);
+		}
+		ac_jsonw_end_array(json);
+		ac_jsonw_end_object(json);
+	}
+	ac_jsonw_end_array(json);
+	ac_jsonw_end_object(json);
+
+	pthread_mutex_unlock(&perf->lock);
+}
+
+/**
+ * ac_perf_destroy - destroy an ac_perf_t freeing all its memory
+ *
+ * @perf: The ac_perf_t to destroy
+ *
+ * No other thread should be using it.
+ */
+void ac_perf_destroy(ac_perf_t *perf)
+{
+	struct perf_thread *pt;
+
+	if (!perf)
+		return;
+
+	pthread_key_delete(perf->key);
+
+	pt = perf->threads;
+	while (pt) {
+		struct perf_thread *next = pt->next;
+
+		perf_events_close(pt->fds, AC_PERF_NR_COUNTERS);
+		free(pt->regions);
+		free(pt);
+		pt = next;
+	}
+	ac_quark_destroy(&perf->regions);
+	pthread_mutex_destroy(&perf->lock);
+	free(perf);
+}
@@ -0,0 +1,559 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_pool.c - Fixed size object pools with per-thread caches
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "include/libac.h"
+
+#define POOL_MAG_SZ		64
+#define POOL_SLAB_SZ		(64 * 1024)
+#define POOL_SLAB_HDR_SZ	64
+#define POOL_MIN_SLAB_OBJS	8
+#define POOL_DIR_SHIFT		10
+#define POOL_DIR_SZ		(1U << POOL_DIR_SHIFT)
+#define POOL_MAX_SLABS		(POOL_DIR_SZ * POOL_DIR_SZ)
+
+/*
+ * A per-thread cache of free objects. Only the owning thread changes
+ * these, the counters are read by ac_pool_stats().
+ */
+struct pool_magazine {
+	struct pool_magazine *next;
+	struct ac_pool *pool;
+
+	u32 count;
+	u64 allocs;
+	u64 frees;
+
+	void *objs[POOL_MAG_SZ];
+};
+
+/*
+ * Slabs are slab_sz aligned so an object's slab can be found from its
+ * address. The header holds the slab's number and the objects follow.
+ */
+struct pool_slab {
+	u32 nr;
+};
+
+/*
+ * Each object has a 32bit id of (slab number << obj_bits | object number)
+ * and the slabs are found from their number through a two level
+ * directory, which never moves so can be read without locking.
+ *
+ * The global free list is a Treiber stack, each free object holds the
+ * (id + 1) of the next free object in its first four bytes. The head is a
+ * (tag << 32 | id + 1) with the tag bumped on every change to avoid the
+ * ABA problem.
+ */
+struct ac_pool {
+	u64 head __attribute__((aligned(64)));
+	u64 next_obj __attribute__((aligned(64)));
+
+	size_t obj_sz __attribute__((aligned(64)));
+	size_t slab_sz;
+	u32 slab_objs;
+	int obj_bits;
+	u32 max_slabs;
+	u32 nr_slabs;
+	char **slab_dir[POOL_DIR_SZ];
+
+	u64 id;
+	pthread_key_t key;
+	pthread_mutex_t lock;
+	struct pool_magazine *mags;
+	u64 allocs;
+	u64 frees;
+};
+
+static inline char *pool_slab(const ac_pool_t *pool, u32 nr)
+{
+	char **dir = __atomic_load_n(&pool->slab_dir[nr >> POOL_DIR_SHIFT],
+				     __ATOMIC_ACQUIRE);
+
+	if (!dir)
+		return NULL;
+
+	return __atomic_load_n(&dir[nr & (POOL_DIR_SZ - 1)], __ATOMIC_ACQUIRE);
+}
+
+static inline void *pool_obj(const ac_pool_t *pool, u32 id)
+{
+	char *slab = pool_slab(pool, id >> pool->obj_bits);
+
+	return slab + POOL_SLAB_HDR_SZ +
+	       (size_t)(id & ((1U << pool->obj_bits) - 1)) * pool->obj_sz;
+}
+
+static inline u32 pool_obj_id(const ac_pool_t *pool, const void *obj)
+{
+	const char *slab = (const char *)((uintptr_t)obj &
+					  ~(uintptr_t)(pool->slab_sz - 1));
+	u32 nr = ((const struct pool_slab *)slab)->nr;
+
+	return nr << pool->obj_bits |
+	       (u32)(((const char *)obj - slab - POOL_SLAB_HDR_SZ) /
+		     pool->obj_sz);
+}
+
+/* Look up an id read from a free list link, which may be garbage */
+static inline void *pool_obj_checked(const ac_pool_t *pool, u32 id)
+{
+	char *slab;
+
+	if ((id & ((1U << pool->obj_bits) - 1)) >= pool->slab_objs)
+		return NULL;
+	slab = pool_slab(pool, id >> pool->obj_bits);
+	if (!slab)
+		return NULL;
+
+	return pool_obj(pool, id);
+}
+
+/*
+ * Pop up to nr objects off the global free list with a single CAS.
+ *
+ * The objects may be popped & reused by another thread while we walk the
+ * list, so the links can be garbage, but then the tag has changed and the
+ * CAS fails.
+ */
+static u32 pool_pop(ac_pool_t *pool, void **objs, u32 nr)
+{
+	u64 head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+
+	for (;;) {
+		u32 next = (u32)head;
+		u32 i;
+
+		for (i = 0; i < nr && next; i++) {
+			objs[i] = pool_obj_checked(pool, next - 1);
+			if (!objs[i])
+				break;
+			next = __atomic_load_n((u32 *)objs[i],
+					       __ATOMIC_RELAXED);
+		}
+
+		if (i == 0 && (u32)head == 0)
+			return 0;
+
+		if (__atomic_compare_exchange_n(&pool->head, &head,
+						(((head >> 32) + 1) << 32) |
+						next, true, __ATOMIC_ACQUIRE,
+						__ATOMIC_ACQUIRE))
+			return i;
+	}
+}
+
+/* Push nr objects onto the global free list with a single CAS */
+static void pool_push(ac_pool_t *pool, void **objs, u32 nr)
+{
+	u32 first = pool_obj_id(pool, objs[0]) + 1;
+	u32 *last = objs[nr - 1];
+	u64 head;
+	u32 i;
+
+	for (i = 0; i < nr - 1; i++)
+		__atomic_store_n((u32 *)objs[i],
+				 pool_obj_id(pool, objs[i + 1]) + 1,
+				 __ATOMIC_RELAXED);
+
+	head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+	do {
+		__atomic_store_n(last, (u32)head, __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&pool->head, &head,
+					      (((head >> 32) + 1) << 32) |
+					      first, true, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+static int pool_add_slab(ac_pool_t *pool, u32 nr)
+{
+	char ***dirp = &pool->slab_dir[nr >> POOL_DIR_SHIFT];
+	void *slab;
+	int ret = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	if (!*dirp) {
+		char **dir = calloc(POOL_DIR_SZ, sizeof(char *));
+
+		if (!dir) {
+			ret = -1;
+			goto out_unlock;
+		}
+		__atomic_store_n(dirp, dir, __ATOMIC_RELEASE);
+	}
+	if ((*dirp)[nr & (POOL_DIR_SZ - 1)])
+		goto out_unlock;
+
+	if (posix_memalign(&slab, pool->slab_sz, pool->slab_sz) != 0) {
+		ret = -1;
+		goto out_unlock;
+	}
+	((struct pool_slab *)slab)->nr = nr;
+	__atomic_store_n(&(*dirp)[nr & (POOL_DIR_SZ - 1)], slab,
+			 __ATOMIC_RELEASE);
+	pool->nr_slabs++;
+
+out_unlock:
+	pthread_mutex_unlock(&pool->lock);
+
+	return ret;
+}
+
+/* Carve up to nr never used objects into the magazine */
+static u32 pool_carve(ac_pool_t *pool, struct pool_magazine *mag, u32 nr)
+{
+	u64 next = __atomic_fetch_add(&pool->next_obj, nr, __ATOMIC_RELAXED);
+	u64 slab_nr = next / pool->slab_objs;
+	u32 obj_nr = next % pool->slab_objs;
+	u32 i;
+
+	for (i = 0; i < nr; i++) {
+		char *slab;
+
+		if (slab_nr >= pool->max_slabs)
+			break;
+
+		slab = pool_slab(pool, slab_nr);
+		if (!slab) {
+			if (pool_add_slab(pool, slab_nr) == -1)
+				break;
+			slab = pool_slab(pool, slab_nr);
+		}
+
+		mag->objs[mag->count + i] = slab + POOL_SLAB_HDR_SZ +
+					    (size_t)obj_nr * pool->obj_sz;
+		if (++obj_nr == pool->slab_objs) {
+			obj_nr = 0;
+			slab_nr++;
+		}
+	}
+
+	return i;
+}
+
+static u32 pool_refill(ac_pool_t *pool, struct pool_magazine *mag)
+{
+	u32 nr;
+
+	nr = pool_pop(pool, mag->objs + mag->count, POOL_MAG_SZ / 2);
+	if (nr == 0)
+		nr = pool_carve(pool, mag, POOL_MAG_SZ / 2);
+	__atomic_store_n(&mag->count, mag->count + nr, __ATOMIC_RELAXED);
+
+	return nr;
+}
+
+static u64 pool_next_id;
+
+/*
+ * Cache the last pool used by this thread to save a pthread_getspecific()
+ * on each call. The pool id stops a new pool at the same address as a
+ * destroyed one matching.
+ */
+static __thread struct {
+	u64 pool_id;
+	struct pool_magazine *mag;
+} pool_last;
+
+static void pool_mag_destroy(void *data)
+{
+	struct pool_magazine *mag = data;
+	ac_pool_t *pool = mag->pool;
+	struct pool_magazine **pp;
+
+	if (pool_last.mag == mag)
+		pool_last.pool_id = 0;
+
+	if (mag->count)
+		pool_push(pool, mag->objs, mag->count);
+
+	pthread_mutex_lock(&pool->lock);
+	for (pp = &pool->mags; *pp != mag; pp = &(*pp)->next)
+		;
+	*pp = mag->next;
+	pool->allocs += mag->allocs;
+	pool->frees += mag->frees;
+	pthread_mutex_unlock(&pool->lock);
+
+	free(mag);
+}
+
+static struct pool_magazine *pool_mag(ac_pool_t *pool)
+{
+	struct pool_magazine *mag;
+
+	if (pool_last.pool_id == pool->id)
+		return pool_last.mag;
+
+	mag = pthread_getspecific(pool->key);
+	if (mag)
+		goto out;
+
+	mag = calloc(1, sizeof(struct pool_magazine));
+	if (!mag)
+		return NULL;
+	mag->pool = pool;
+
+	pthread_mutex_lock(&pool->lock);
+	mag->next = pool->mags;
+	pool->mags = mag;
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_setspecific(pool->key, mag);
+
+out:
+	pool_last.pool_id = pool->id;
+	pool_last.mag = mag;
+
+	return mag;
+}
+
+/**
+ * ac_pool_new - create a new pool of fixed size objects
+ *
+ * @obj_sz: The size of the objects
+ * @slab_sz: The size of the slabs the objects are allocated from, rounded
+ *           up to a power of two and to hold at least 8 objects. 0 for
+ *           the default (64KiB)
+ *
+ * Each pool uses a pthread key for its per-thread caches, so the number
+ * of pools is limited by PTHREAD_KEYS_MAX.
+ *
+ * Returns:
+ *
+ * A pointer to the new pool or NULL on failure, check errno
+ */
+ac_pool_t *ac_pool_new(size_t obj_sz, size_t slab_sz)
+{
+	ac_pool_t *pool;
+	size_t min_sz;
+	int err;
+
+	if (obj_sz == 0 || obj_sz > 1U << 30 || slab_sz > 1U << 30) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pool = aligned_alloc(64, sizeof(ac_pool_t));
+	if (!pool)
+		return NULL;
+	memset(pool, 0, sizeof(ac_pool_t));
+
+	/* Room for the free list link and keep the objects aligned */
+	if (obj_sz < 16)
+		pool->obj_sz = (obj_sz + 7) & ~7;
+	else
+		pool->obj_sz = (obj_sz + 15) & ~15;
+
+	min_sz = POOL_SLAB_HDR_SZ + POOL_MIN_SLAB_OBJS * pool->obj_sz;
+	pool->slab_sz = slab_sz ? slab_sz : POOL_SLAB_SZ;
+	pool->slab_sz = AC_MAX(pool->slab_sz, min_sz);
+	pool->slab_sz = 1UL << (64 - __builtin_clzll(pool->slab_sz - 1));
+
+	pool->slab_objs = (pool->slab_sz - POOL_SLAB_HDR_SZ) / pool->obj_sz;
+	pool->obj_bits = 32 - __builtin_clz(pool->slab_objs - 1);
+	/* Ids (+ 1) must fit in 32 bits */
+	pool->max_slabs = AC_MIN((u64)POOL_MAX_SLABS,
+				 (u64)UINT32_MAX >> pool->obj_bits);
+
+	err = pthread_key_create(&pool->key, pool_mag_destroy);
+	if (err) {
+		free(pool);
+		errno = err;
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pool->id = __atomic_add_fetch(&pool_next_id, 1, __ATOMIC_RELAXED);
+
+	return pool;
+}
+
+/**
+ * ac_pool_alloc - allocate an object from a pool
+ *
+ * @pool: The pool to allocate from
+ *
+ * Returns:
+ *
+ * A pointer to the object or NULL on failure
+ */
+void *ac_pool_alloc(ac_pool_t *pool)
+{
+	struct pool_magazine *mag = pool_mag(pool);
+
+	if (!mag)
+		return NULL;
+
+	if (mag->count == 0 && pool_refill(pool, mag) == 0) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	__atomic_store_n(&mag->count, mag->count - 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&mag->allocs, mag->allocs + 1, __ATOMIC_RELAXED);
+
+	return mag->objs[mag->count];
+}
+
+/**
+ * ac_pool_free - return an object to a pool
+ *
+ * @pool: The pool the object came from
+ * @obj: The object to free, can be NULL
+ *
+ * Objects can be free'd by any thread, not just the one that allocated
+ * them.
+ */
+void ac_pool_free(ac_pool_t *pool, void *obj)
+{
+	struct pool_magazine *mag;
+
+	if (!obj)
+		return;
+
+	mag = pool_mag(pool);
+	if (!mag) {
+		pool_push(pool, &obj, 1);
+		return;
+	}
+
+	if (mag->count == POOL_MAG_SZ) {
+		u32 keep = POOL_MAG_SZ / 2;
+
+		pool_push(pool, mag->objs + keep, POOL_MAG_SZ - keep);
+		__atomic_store_n(&mag->count, keep, __ATOMIC_RELAXED);
+	}
+
+	mag->objs[mag->count] = obj;
+	__atomic_store_n(&mag->count, mag->count + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&mag->frees, mag->frees + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * ac_pool_stats - get statistics about a pool
+ *
+ * @pool: The pool
+ * @stats: Filled in with the statistics
+ *
+ * The figures are a snapshot and can be slightly out if other threads are
+ * using the pool.
+ */
+void ac_pool_stats(ac_pool_t *pool, ac_pool_stats_t *stats)
+{
+	const struct pool_magazine *mag;
+
+	memset(stats, 0, sizeof(ac_pool_stats_t));
+	stats->obj_sz = pool->obj_sz;
+
+	pthread_mutex_lock(&pool->lock);
+	stats->allocs = pool->allocs;
+	stats->frees = pool->frees;
+	for (mag = pool->mags; mag; mag = mag->next) {
+		stats->allocs += __atomic_load_n(&mag->allocs,
+						 __ATOMIC_RELAXED);
+		stats->frees += __atomic_load_n(&mag->frees, __ATOMIC_RELAXED);
+		stats->cached += __atomic_load_n(&mag->count,
+						 __ATOMIC_RELAXED);
+	}
+	stats->nr_slabs = pool->nr_slabs;
+	pthread_mutex_unlock(&pool->lock);
+
+	stats->nr_objs = (u64)stats->nr_slabs * pool->slab_objs;
+
+	stats->live = stats->allocs - stats->frees;
+	stats->free = stats->nr_objs - stats->live;
+}
+
+static void *pool_alloc_hook(size_t size, void *ctx)
+{
+	ac_pool_t *pool = ctx;
+
+	if (size > pool->obj_sz)
+		return malloc(size);
+
+	return ac_pool_alloc(pool);
+}
+
+static void pool_free_hook(void *ptr, size_t size, void *ctx)
+{
+	ac_pool_t *pool = ctx;
+
+	if (size > pool->obj_sz)
+		free(ptr);
+	else
+		ac_pool_free(pool, ptr);
+}
+
+/**
+ * ac_pool_allocator - get an allocator that allocates from a pool
+ *
+ * @pool: The pool to allocate from
+ * @alloc: The allocator to fill in
+ *
+ * Allocations no larger than the pool's object size come from the pool,
+ * larger ones from malloc(3). This lets e.g the nodes of an ac_slist_t
+ * or ac_htable_t come from a pool via the *_with_allocator() functions.
+ */
+void ac_pool_allocator(ac_pool_t *pool, ac_allocator_t *alloc)
+{
+	alloc->alloc = pool_alloc_hook;
+	alloc->realloc = NULL;
+	alloc->free = pool_free_hook;
+	alloc->ctx = pool;
+}
+
+/**
+ * ac_pool_destroy - destroy a pool freeing all its memory
+ *
+ * @pool: The pool to destroy
+ *
+ * All the pool's objects are free'd, whether they have been returned to
+ * the pool or not. No other thread may be using the pool.
+ */
+void ac_pool_destroy(ac_pool_t *pool)
+{
+	struct pool_magazine *mag;
+	u32 i;
+
+	if (!pool)
+		return;
+
+	if (pool_last.pool_id == pool->id)
+		pool_last.pool_id = 0;
+	pthread_setspecific(pool->key, NULL);
+	pthread_key_delete(pool->key);
+
+	mag = pool->mags;
+	while (mag) {
+		struct pool_magazine *next = mag->next;
+
+		free(mag);
+		mag = next;
+	}
+
+	for (i = 0; i < POOL_DIR_SZ; i++) {
+		u32 j;
+
+		if (!pool->slab_dir[i])
+			continue;
+		for (j = 0; j < POOL_DIR_SZ; j++)
+			free(pool->slab_dir[i][j]);
+		free(pool->slab_dir[i]);
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
@@ -13,6 +13,8 @@
 #include <string.h>
 
 #include "include/libac.h"
+#include "ac_alloc.h"
+#include "ac_lock.h"
 
 struct quark_node {
 	int id;
@@ -23,17 +25,6 @@ static void null_free_quark(void *data __always_unused)
 {
 }
 
-static void quark_free_node(void *data)
-{
-	struct quark_node *qn = data;
-
-	if (!qn)
-		return;
-
-	free(qn->string);
-	free(qn);
-}
-
 static int quark_compar(const void *pa, const void *pb)
 {
 	const char *s1 = ((const struct quark_node *)pa)->string;
@@ -43,17 +34,24 @@ static int quark_compar(const void *pa, const void *pb)
 }
 
 /**
- * ac_quark_init - initialise a new quark
+ * ac_quark_init_with_allocator - initialise a new quark
  *
  * @quark: The quark to be initialised
  * @free_func: An optional pointer to a function used to free the quark
  *             itself, not usually needed and can be NULL
+ * @alloc: The allocator to use for the quark's memory, it is copied.
+ *         NULL for the default
  */
-void ac_quark_init(ac_quark_t *quark, void(*free_func)(void *ptr))
+void ac_quark_init_with_allocator(ac_quark_t *quark,
+				  void (*free_func)(void *ptr),
+				  const ac_allocator_t *alloc)
 {
-	quark->qt = ac_btree_new(quark_compar, quark_free_node);
+	/* The nodes are free'd from quark->quarks in ac_quark_destroy() */
+	quark->qt = ac_btree_new_with_allocator(quark_compar, NULL, alloc);
 	quark->quarks = NULL;
 	quark->last = -1;
+	quark->lock = NULL;
+	mem_set_allocator(&quark->alloc, alloc);
 
 	if (!free_func)
 		quark->free_func = null_free_quark;
@@ -61,6 +59,45 @@ void ac_quark_init(ac_quark_t *quark, void(*free_func)(void *ptr))
 		quark->free_func = free_func;
 }
 
+/**
+ * ac_quark_init - initialise a new quark
+ *
+ * @quark: The quark to be initialised
+ * @free_func: An optional pointer to a function used to free the quark
+ *             itself, not usually needed and can be NULL
+ */
+void ac_quark_init(ac_quark_t *quark, void(*free_func)(void *ptr))
+{
+	ac_quark_init_with_allocator(quark, free_func, NULL);
+}
+
+/**
+ * ac_quark_set_thread_safe - make a quark safe to share between threads
+ *
+ * @quark: The quark
+ *
+ * After this the quark is protected by a read/write lock, so existing
+ * mappings can be looked up concurrently. It must be called before the
+ * quark is shared and lasts for its lifetime.
+ *
+ * The strings returned by ac_quark_to_string() stay valid until the quark
+ * is destroyed.
+ *
+ * The allocator is only called with the write lock held, so an ac_arena_t
+ * is fine as long as nothing else allocates from it at the same time.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno (ENOMEM)
+ */
+int ac_quark_set_thread_safe(ac_quark_t *quark)
+{
+	if (!quark->lock)
+		quark->lock = rwlock_new(&quark->alloc);
+
+	return quark->lock ? 0 : -1;
+}
+
 /**
  * ac_quark_from_string - create a new string mapping
  *
@@ -75,21 +112,32 @@ int ac_quark_from_string(ac_quark_t *quark, const char *str)
 {
 	struct quark_node qnl = { .string = (char *)str };
 	struct quark_node *qn;
+	int id;
 
+	/* Most calls are for an existing mapping */
+	rwlock_rdlock(quark->lock);
+	qn = ac_btree_lookup(quark->qt, &qnl);
+	rwlock_unlock(quark->lock);
+	if (qn)
+		return qn->id;
+
+	rwlock_wrlock(quark->lock);
+	/* Another thread may have added it in the meantime */
 	qn = ac_btree_lookup(quark->qt, &qnl);
 	if (!qn) {
-		qn = malloc(sizeof(struct quark_node));
-		qn->string = strdup(str);
+		qn = mem_alloc(&quark->alloc, sizeof(struct quark_node));
+		qn->string = mem_strdup(&quark->alloc, str);
 		qn->id = ++quark->last;
 		ac_btree_add(quark->qt, qn);
-		quark->quarks = realloc(quark->quarks,
-					sizeof(void *) * (quark->last + 1));
+		quark->quarks = mem_realloc(&quark->alloc, quark->quarks,
+					    sizeof(void *) * quark->last,
+					    sizeof(void *) * (quark->last + 1));
 		quark->quarks[quark->last] = qn;
-
-		return quark->last;
 	}
+	id = qn->id;
+	rwlock_unlock(quark->lock);
 
-	return qn->id;
+	return id;
 }
 
 /**
@@ -104,8 +152,14 @@ int ac_quark_from_string(ac_quark_t *quark, const char *str)
  */
 const char *ac_quark_to_string(const ac_quark_t *quark, int id)
 {
-	return id > quark->last ? NULL :
+	const char *str;
+
+	rwlock_rdlock(quark->lock);
+	str = id > quark->last ? NULL :
 		((struct quark_node *)quark->quarks[id])->string;
+	rwlock_unlock(quark->lock);
+
+	return str;
 }
 
 /**
@@ -115,7 +169,17 @@ const char *ac_quark_to_string(const ac_quark_t *quark, int id)
  */
 void ac_quark_destroy(const ac_quark_t *quark)
 {
+	int i;
+
 	ac_btree_destroy(quark->qt);
-	free(quark->quarks);
+	for (i = 0; i <= quark->last; i++) {
+		struct quark_node *qn = quark->quarks[i];
+
+		mem_free(&quark->alloc, qn->string, strlen(qn->string) + 1);
+		mem_free(&quark->alloc, qn, sizeof(struct quark_node));
+	}
+	mem_free(&quark->alloc, quark->quarks,
+		 sizeof(void *) * (quark->last + 1));
+	rwlock_destroy(&quark->alloc, quark->lock);
 	quark->free_func((void *)quark);
 }
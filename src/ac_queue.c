@@ -12,27 +12,75 @@
 #include <stdlib.h>
 
 #include "include/libac.h"
+#include "ac_alloc.h"
+#include "ac_sdt.h"
+#include "ac_lock.h"
 
 /**
- * ac_queue_new - create a new queue
+ * ac_queue_new_with_allocator - create a new queue
+ *
+ * @alloc: The allocator to use for the queue's memory, it is copied.
+ *         NULL for the default
  *
  * Returns:
  *
  * A pointer to the newly created queue
  */
-ac_queue_t *ac_queue_new(void)
+ac_queue_t *ac_queue_new_with_allocator(const ac_allocator_t *alloc)
 {
 	ac_queue_t *queue;
 
-	queue = malloc(sizeof(ac_queue_t));
+	queue = mem_alloc(alloc, sizeof(ac_queue_t));
 
 	queue->queue = NULL;
 	queue->tail = NULL;
 	queue->items = 0;
+	queue->lock = NULL;
+	mem_set_allocator(&queue->alloc, alloc);
 
 	return queue;
 }
 
+/**
+ * ac_queue_new - create a new queue
+ *
+ * Returns:
+ *
+ * A pointer to the newly created queue
+ */
+ac_queue_t *ac_queue_new(void)
+{
+	return ac_queue_new_with_allocator(NULL);
+}
+
+/**
+ * ac_queue_set_thread_safe - make a queue safe to share between threads
+ *
+ * @queue: The queue
+ *
+ * After this the queue is protected by a mutex, items can be pushed and
+ * popped from any number of threads. It must be called before the queue
+ * is shared and lasts for its lifetime.
+ *
+ * ac_queue_foreach()'s action is called with the mutex held and must not
+ * call back into the queue.
+ *
+ * Items are allocated and freed with the mutex held, so the allocator
+ * need only be thread-safe if something else is using it concurrently,
+ * e.g. don't share an ac_arena_t between queues.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno (ENOMEM)
+ */
+int ac_queue_set_thread_safe(ac_queue_t *queue)
+{
+	if (!queue->lock)
+		queue->lock = mutex_new(&queue->alloc);
+
+	return queue->lock ? 0 : -1;
+}
+
 /**
  * ac_queue_push - add an item to the queue
  *
@@ -50,7 +98,9 @@ int ac_queue_push(ac_queue_t *queue, void *item)
 	if (!queue)
 		return -1;
 
-	new = malloc(sizeof(ac_slist_t));
+	/* The allocator is only ever called with the lock held */
+	mutex_lock(queue->lock);
+	new = mem_alloc(&queue->alloc, sizeof(ac_slist_t));
 	new->data = item;
 	new->next = NULL;
 
@@ -64,6 +114,9 @@ int ac_queue_push(ac_queue_t *queue, void *item)
 
 	queue->items++;
 
+	AC_PROBE2(queue_push, queue, queue->items);
+	mutex_unlock(queue->lock);
+
 	return 0;
 }
 
@@ -85,16 +138,23 @@ void *ac_queue_pop(ac_queue_t *queue)
 	if (!queue)
 		return NULL;
 
+	mutex_lock(queue->lock);
 	list = &queue->queue;
 	p = *list;
-	if (!p)
+	if (!p) {
+		mutex_unlock(queue->lock);
 		return NULL;
+	}
 
 	*list = p->next;
-	item = p->data;
-	free(p);
 	queue->items--;
 
+	item = p->data;
+	mem_free(&queue->alloc, p, sizeof(ac_slist_t));
+
+	AC_PROBE2(queue_pop, queue, queue->items);
+	mutex_unlock(queue->lock);
+
 	return item;
 }
 
@@ -109,7 +169,16 @@ void *ac_queue_pop(ac_queue_t *queue)
  */
 u32 ac_queue_nr_items(const ac_queue_t *queue)
 {
-	return !queue ? 0 : queue->items;
+	u32 items;
+
+	if (!queue)
+		return 0;
+
+	mutex_lock(queue->lock);
+	items = __ac_queue_nr_items(queue);
+	mutex_unlock(queue->lock);
+
+	return items;
 }
 
 /**
@@ -122,10 +191,12 @@ u32 ac_queue_nr_items(const ac_queue_t *queue)
 void ac_queue_foreach(const ac_queue_t *queue,
 		      void (*action)(void *item, void *data), void *user_data)
 {
-	if (!queue || queue->items == 0)
+	if (!queue)
 		return;
 
+	mutex_lock(queue->lock);
 	ac_slist_foreach(queue->queue, action, user_data);
+	mutex_unlock(queue->lock);
 }
 
 /**
@@ -139,6 +210,8 @@ void ac_queue_destroy(const ac_queue_t *queue, void (*free_func)(void *item))
 	if (!queue)
 		return;
 
-	ac_slist_destroy((ac_slist_t **)&queue->queue, free_func);
-	free((void *)queue);
+	ac_slist_destroy_with_allocator((ac_slist_t **)&queue->queue, free_func,
+					&queue->alloc);
+	mutex_destroy(&queue->alloc, queue->lock);
+	mem_free(&queue->alloc, (void *)queue, sizeof(ac_queue_t));
 }
@@ -0,0 +1,441 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_ratelimit.c - Rate limiters
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "include/libac.h"
+
+/* Number of slots per set in the keyed limiter */
+#define KEYED_WAYS		8
+
+/* Sliding window state packing; window number, previous & current counts */
+#define SW_COUNT_BITS		20
+#define SW_COUNT_MAX		((1U << SW_COUNT_BITS) - 1)
+#define SW_WINDOW_MASK		((1ULL << (64 - 2*SW_COUNT_BITS)) - 1)
+
+struct ac_ratelimit_slot {
+	u64 key;
+	u64 tat;
+};
+
+static inline u64 rl_now(u64 now)
+{
+	return now ? now : ac_time_clock_ns();
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+/**
+ * ac_ratelimit_tb_init - initialise a token bucket rate limiter
+ *
+ * @tb: The token bucket to initialise
+ * @rate: The number of tokens added every @per_ns nanoseconds
+ * @per_ns: The period over which @rate tokens are added
+ * @burst: The capacity of the bucket
+ *
+ * The bucket starts full. E.g to allow 100 requests per second with
+ * bursts of up to 20
+ *
+ *	ac_ratelimit_tb_init(&tb, 100, AC_TIME_NS_SEC, 20);
+ *
+ * All the ac_ratelimit functions take the current time as a parameter,
+ * this can be 0 to use ac_time_clock_ns().
+ */
+void ac_ratelimit_tb_init(ac_ratelimit_tb_t *tb, u64 rate, u64 per_ns,
+			  u32 burst)
+{
+	tb->ns_per_token = AC_MAX(per_ns / AC_MAX(rate, 1ULL), 1ULL);
+	tb->burst_ns = tb->ns_per_token * burst;
+	tb->zero_ns = 0;
+}
+
+/*
+ * The bucket state is kept as a single time; when the bucket would have
+ * been empty had no tokens been added since. The number of tokens is then
+ * the time since, in tokens, capped at the burst size. This lets it be
+ * updated with a single compare and swap.
+ */
+static inline u64 tb_zero(const ac_ratelimit_tb_t *tb, u64 zero, u64 now)
+{
+	if (now > tb->burst_ns && zero < now - tb->burst_ns)
+		return now - tb->burst_ns;
+	return zero;
+}
+
+/**
+ * ac_ratelimit_tb_allow - try to take tokens from a token bucket
+ *
+ * @tb: The token bucket
+ * @n: The number of tokens to take
+ * @now: The current time from ac_time_clock_ns() or 0
+ *
+ * This is lock free and can be called from multiple threads.
+ *
+ * Returns:
+ *
+ * true if there were enough tokens (which have been taken), false
+ * otherwise
+ */
+bool ac_ratelimit_tb_allow(ac_ratelimit_tb_t *tb, u32 n, u64 now)
+{
+	u64 old = __atomic_load_n(&tb->zero_ns, __ATOMIC_RELAXED);
+	u64 new;
+
+	now = rl_now(now);
+	do {
+		new = tb_zero(tb, old, now) + n * tb->ns_per_token;
+		if (new > now)
+			return false;
+	} while (!__atomic_compare_exchange_n(&tb->zero_ns, &old, new, true,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+
+	return true;
+}
+
+/**
+ * ac_ratelimit_tb_tokens - get the number of tokens in a token bucket
+ *
+ * @tb: The token bucket
+ * @now: The current time from ac_time_clock_ns() or 0
+ *
+ * Returns:
+ *
+ * The number of tokens available
+ */
+u32 ac_ratelimit_tb_tokens(const ac_ratelimit_tb_t *tb, u64 now)
+{
+	u64 zero;
+
+	now = rl_now(now);
+	zero = tb_zero(tb, __atomic_load_n(&tb->zero_ns, __ATOMIC_RELAXED),
+		       now);
+	if (zero >= now)
+		return 0;
+
+	return (now - zero) / tb->ns_per_token;
+}
+
+/**
+ * ac_ratelimit_gcra_init - initialise a GCRA rate limiter
+ *
+ * @gcra: The limiter to initialise
+ * @rate: The number of requests allowed every @per_ns nanoseconds
+ * @per_ns: The period over which @rate requests are allowed
+ * @burst: The number of requests allowed in a burst
+ *
+ * The Generic Cell Rate Algorithm is equivalent to a token bucket but
+ * tells you when a rejected request would be allowed.
+ */
+void ac_ratelimit_gcra_init(ac_ratelimit_gcra_t *gcra, u64 rate, u64 per_ns,
+			    u32 burst)
+{
+	gcra->emission_ns = AC_MAX(per_ns / AC_MAX(rate, 1ULL), 1ULL);
+	gcra->tolerance_ns = gcra->emission_ns * AC_MAX(burst, 1U);
+	gcra->tat = 0;
+}
+
+/*
+ * Check a request against a theoretical arrival time, returns the new
+ * TAT or 0 if the request isn't allowed with *retry_ns set.
+ */
+static inline u64 gcra_check(u64 tat, u64 emission_ns, u64 tolerance_ns,
+			     u32 n, u64 now, u64 *retry_ns)
+{
+	u64 new = AC_MAX(tat, now) + n * emission_ns;
+
+	if (new > now + tolerance_ns) {
+		if (retry_ns)
+			*retry_ns = new - (now + tolerance_ns);
+		return 0;
+	}
+
+	return new;
+}
+
+/**
+ * ac_ratelimit_gcra_allow - check if a request is allowed
+ *
+ * @gcra: The limiter
+ * @n: The cost of the request, normally 1
+ * @now: The current time from ac_time_clock_ns() or 0
+ * @retry_ns: Set to how long until the request would be allowed if it
+ *            isn't, can be NULL
+ *
+ * This is lock free and can be called from multiple threads.
+ *
+ * Returns:
+ *
+ * true if the request is allowed, false otherwise
+ */
+bool ac_ratelimit_gcra_allow(ac_ratelimit_gcra_t *gcra, u32 n, u64 now,
+			     u64 *retry_ns)
+{
+	u64 old = __atomic_load_n(&gcra->tat, __ATOMIC_RELAXED);
+	u64 new;
+
+	now = rl_now(now);
+	do {
+		new = gcra_check(old, gcra->emission_ns, gcra->tolerance_ns,
+				 n, now, retry_ns);
+		if (!new)
+			return false;
+	} while (!__atomic_compare_exchange_n(&gcra->tat, &old, new, true,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+
+	return true;
+}
+
+/**
+ * ac_ratelimit_sw_init - initialise a sliding window rate limiter
+ *
+ * @sw: The limiter to initialise
+ * @limit: The number of requests allowed per window, at most 1048575
+ * @window_ns: The window size in nanoseconds
+ *
+ * This approximates a sliding window by weighting the previous fixed
+ * window's count by how much of it overlaps the sliding window.
+ */
+void ac_ratelimit_sw_init(ac_ratelimit_sw_t *sw, u32 limit, u64 window_ns)
+{
+	sw->limit = AC_MIN(limit, SW_COUNT_MAX);
+	sw->window_ns = AC_MAX(window_ns, 1ULL);
+	sw->state = 0;
+}
+
+/**
+ * ac_ratelimit_sw_allow - check if a request is allowed
+ *
+ * @sw: The limiter
+ * @n: The cost of the request, normally 1
+ * @now: The current time from ac_time_clock_ns() or 0
+ *
+ * This is lock free and can be called from multiple threads, the window
+ * number and the two counts are packed into a single u64.
+ *
+ * Returns:
+ *
+ * true if the request is allowed, false otherwise
+ */
+bool ac_ratelimit_sw_allow(ac_ratelimit_sw_t *sw, u32 n, u64 now)
+{
+	u64 old = __atomic_load_n(&sw->state, __ATOMIC_RELAXED);
+	u64 window;
+	u64 into;
+	u64 new;
+
+	now = rl_now(now);
+	window = (now / sw->window_ns) & SW_WINDOW_MASK;
+	into = now % sw->window_ns;
+	do {
+		u64 old_window = old >> (2*SW_COUNT_BITS);
+		u64 prev = (old >> SW_COUNT_BITS) & SW_COUNT_MAX;
+		u64 cur = old & SW_COUNT_MAX;
+		u64 estimate;
+
+		if (old_window != window) {
+			prev = ((old_window + 1) & SW_WINDOW_MASK) == window ?
+				cur : 0;
+			cur = 0;
+		}
+
+		estimate = cur + (u64)((double)prev *
+				       (sw->window_ns - into) / sw->window_ns);
+		if (estimate + n > sw->limit)
+			return false;
+
+		cur += n;
+		new = (window << (2*SW_COUNT_BITS)) |
+		      (prev << SW_COUNT_BITS) | cur;
+	} while (!__atomic_compare_exchange_n(&sw->state, &old, new, true,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+
+	return true;
+}
+
+static inline u64 rl_mix(u64 h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+/* A seeded 64 bit hash, 8 bytes at a time */
+static u64 rl_hash(u64 seed, const void *key, size_t len)
+{
+	const u8 *p = key;
+	u64 h = seed ^ (len * 0x9e3779b97f4a7c15ULL);
+	u64 v;
+
+	while (len >= 8) {
+		memcpy(&v, p, 8);
+		h = (h ^ rl_mix(v)) * 0x9e3779b97f4a7c15ULL;
+		p += 8;
+		len -= 8;
+	}
+	if (len) {
+		v = 0;
+		memcpy(&v, p, len);
+		h = (h ^ rl_mix(v)) * 0x9e3779b97f4a7c15ULL;
+	}
+
+	h = rl_mix(h);
+
+	/* 0 marks an empty slot */
+	return h ? h : 1;
+}
+
+static inline void set_lock(u32 *lock)
+{
+	while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(lock, __ATOMIC_RELAXED))
+			cpu_relax();
+	}
+}
+
+static inline void set_unlock(u32 *lock)
+{
+	__atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * ac_ratelimit_keyed_new - create a new keyed rate limiter
+ *
+ * @nr_keys: The (approximate) maximum number of keys to track
+ * @rate: The number of requests allowed every @per_ns nanoseconds per key
+ * @per_ns: The period over which @rate requests are allowed
+ * @burst: The number of requests allowed in a burst per key
+ *
+ * This applies a GCRA limit per key. Memory use is fixed, 16 bytes per
+ * key slot. Keys are stored as 64 bit hashes in sets of 8 slots, when a
+ * set is full the key that would be allowed soonest is evicted.
+ *
+ * Returns:
+ *
+ * A pointer to the newly created limiter or NULL on failure
+ */
+ac_ratelimit_keyed_t *ac_ratelimit_keyed_new(u32 nr_keys, u64 rate,
+					     u64 per_ns, u32 burst)
+{
+	ac_ratelimit_keyed_t *kl;
+	ac_ratelimit_gcra_t gcra;
+	u32 nr_sets = 1;
+
+	while ((u64)nr_sets * KEYED_WAYS < nr_keys)
+		nr_sets <<= 1;
+
+	kl = malloc(sizeof(ac_ratelimit_keyed_t));
+	if (!kl)
+		return NULL;
+
+	kl->slots = calloc((size_t)nr_sets * KEYED_WAYS,
+			   sizeof(struct ac_ratelimit_slot));
+	kl->locks = calloc(nr_sets, sizeof(u32));
+	if (!kl->slots || !kl->locks) {
+		free(kl->slots);
+		free(kl->locks);
+		free(kl);
+		return NULL;
+	}
+
+	ac_ratelimit_gcra_init(&gcra, rate, per_ns, burst);
+	kl->emission_ns = gcra.emission_ns;
+	kl->tolerance_ns = gcra.tolerance_ns;
+	kl->nr_sets = nr_sets;
+	kl->seed = ac_rng_u64(NULL);
+
+	return kl;
+}
+
+/**
+ * ac_ratelimit_keyed_allow - check if a request for a key is allowed
+ *
+ * @kl: The limiter
+ * @key: The key, e.g a client address
+ * @len: The length of the key
+ * @n: The cost of the request, normally 1
+ * @now: The current time from ac_time_clock_ns() or 0
+ * @retry_ns: Set to how long until the request would be allowed if it
+ *            isn't, can be NULL
+ *
+ * Each set of slots has its own spinlock, so contention is low.
+ *
+ * Returns:
+ *
+ * true if the request is allowed, false otherwise
+ */
+bool ac_ratelimit_keyed_allow(ac_ratelimit_keyed_t *kl, const void *key,
+			      size_t len, u32 n, u64 now, u64 *retry_ns)
+{
+	u64 hash = rl_hash(kl->seed, key, len);
+	u32 set = (hash >> 32) & (kl->nr_sets - 1);
+	struct ac_ratelimit_slot *slots = kl->slots + set * KEYED_WAYS;
+	struct ac_ratelimit_slot *slot = NULL;
+	struct ac_ratelimit_slot *victim = slots;
+	u64 tat;
+	int i;
+
+	now = rl_now(now);
+
+	set_lock(&kl->locks[set]);
+	for (i = 0; i < KEYED_WAYS; i++) {
+		if (slots[i].key == hash) {
+			slot = &slots[i];
+			break;
+		}
+		if (slots[i].tat < victim->tat)
+			victim = &slots[i];
+	}
+	if (!slot) {
+		/* Empty slots have a tat of 0 so are used first */
+		slot = victim;
+		slot->key = hash;
+		slot->tat = 0;
+	}
+
+	tat = gcra_check(slot->tat, kl->emission_ns, kl->tolerance_ns, n, now,
+			 retry_ns);
+	if (tat)
+		slot->tat = tat;
+	set_unlock(&kl->locks[set]);
+
+	return tat != 0;
+}
+
+/**
+ * ac_ratelimit_keyed_destroy - destroy a keyed rate limiter
+ *
+ * @kl: The limiter to destroy
+ */
+void ac_ratelimit_keyed_destroy(ac_ratelimit_keyed_t *kl)
+{
+	if (!kl)
+		return;
+
+	free(kl->slots);
+	free(kl->locks);
+	free(kl);
+}
@@ -0,0 +1,404 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_rng.c - Pseudo random number generators
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "include/libac.h"
+#include "platform.h"
+
+#define PCG32_MULT		6364136223846793005ULL
+
+/* Number of independent xoshiro256** streams used by ac_rng_fill() */
+#define FILL_LANES		4
+
+static __thread ac_rng_t thread_rng;
+static __thread bool thread_rng_seeded;
+static pthread_once_t rng_atfork_once = PTHREAD_ONCE_INIT;
+
+static inline u64 rotl(u64 x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/*
+ * SplitMix64, used to expand a single 64 bit seed into the larger
+ * generator states.
+ *
+ * https://prng.di.unimi.it/splitmix64.c
+ */
+static inline u64 splitmix64(u64 *x)
+{
+	u64 z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+/*
+ * xoshiro256** by David Blackman and Sebastiano Vigna
+ *
+ * https://prng.di.unimi.it/xoshiro256starstar.c
+ */
+static inline u64 xoshiro256ss_next(u64 *s)
+{
+	const u64 result = rotl(s[1] * 5, 7) * 9;
+	const u64 t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return result;
+}
+
+/*
+ * PCG32 (XSH RR) by Melissa O'Neill
+ *
+ * https://www.pcg-random.org/
+ */
+static inline u32 pcg32_next(ac_rng_t *rng)
+{
+	u64 old = rng->s.pcg.state;
+	u32 xorshifted = ((old >> 18) ^ old) >> 27;
+	u32 rot = old >> 59;
+
+	rng->s.pcg.state = old * PCG32_MULT + rng->s.pcg.inc;
+
+	return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+static void rng_seed(ac_rng_t *rng, ac_rng_algo_t algo, const u64 *seed)
+{
+	u64 x = seed[0];
+
+	rng->algo = algo;
+	switch (algo) {
+	case AC_RNG_PCG32:
+		rng->s.pcg.state = 0;
+		/* The increment must be odd */
+		rng->s.pcg.inc = (seed[1] << 1) | 1;
+		pcg32_next(rng);
+		rng->s.pcg.state += seed[0];
+		pcg32_next(rng);
+		break;
+	default:
+		rng->algo = AC_RNG_XOSHIRO256SS;
+		/* The state must not be all zero, splitmix64 makes sure */
+		rng->s.xoshiro[0] = splitmix64(&x);
+		rng->s.xoshiro[1] = splitmix64(&x) ^ seed[1];
+		rng->s.xoshiro[2] = splitmix64(&x);
+		rng->s.xoshiro[3] = splitmix64(&x);
+	}
+}
+
+/*
+ * Don't let a child process produce the same stream as its parent from the
+ * inherited generator state.
+ */
+static void rng_atfork_child(void)
+{
+	thread_rng_seeded = false;
+}
+
+static void rng_register_atfork(void)
+{
+	pthread_atfork(NULL, NULL, rng_atfork_child);
+}
+
+static ac_rng_t *get_thread_rng(void)
+{
+	u64 seed[2];
+
+	if (thread_rng_seeded)
+		return &thread_rng;
+
+	pthread_once(&rng_atfork_once, rng_register_atfork);
+	if (get_random_bytes(seed, sizeof(seed)) == -1) {
+		struct timespec tp;
+
+		/* Best effort fallback */
+		clock_gettime(CLOCK_MONOTONIC, &tp);
+		seed[0] = tp.tv_sec * AC_TIME_NS_SEC + tp.tv_nsec;
+		seed[1] = (u64)(uintptr_t)&thread_rng;
+	}
+	rng_seed(&thread_rng, AC_RNG_XOSHIRO256SS, seed);
+	thread_rng_seeded = true;
+
+	return &thread_rng;
+}
+
+static inline ac_rng_t *rng_get(ac_rng_t *rng)
+{
+	return rng ? rng : get_thread_rng();
+}
+
+/**
+ * ac_rng_init - initialise a random number generator
+ *
+ * @rng: The generator to initialise
+ * @algo: The algorithm to use; AC_RNG_XOSHIRO256SS or AC_RNG_PCG32
+ *
+ * The generator is seeded from the kernel via getrandom(2).
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno
+ */
+int ac_rng_init(ac_rng_t *rng, ac_rng_algo_t algo)
+{
+	u64 seed[2];
+
+	if (get_random_bytes(seed, sizeof(seed)) == -1)
+		return -1;
+
+	rng_seed(rng, algo, seed);
+
+	return 0;
+}
+
+/**
+ * ac_rng_seed - initialise a random number generator with a given seed
+ *
+ * @rng: The generator to initialise
+ * @algo: The algorithm to use; AC_RNG_XOSHIRO256SS or AC_RNG_PCG32
+ * @seed: The seed
+ *
+ * The same seed will always produce the same sequence of numbers, this is
+ * mainly useful for reproducible tests & simulations.
+ */
+void ac_rng_seed(ac_rng_t *rng, ac_rng_algo_t algo, u64 seed)
+{
+	u64 s[2] = { seed, 0x853c49e6748fea9bULL };
+
+	rng_seed(rng, algo, s);
+}
+
+/**
+ * ac_rng_u64 - get a random 64 bit number
+ *
+ * @rng: The generator to use, or NULL for the calling thread's generator
+ *
+ * The per-thread generator is xoshiro256** and is seeded from
+ * getrandom(2) on first use.
+ *
+ * Returns:
+ *
+ * A uniformly distributed u64
+ */
+u64 ac_rng_u64(ac_rng_t *rng)
+{
+	rng = rng_get(rng);
+
+	if (rng->algo == AC_RNG_PCG32) {
+		u64 hi = pcg32_next(rng);
+
+		return (hi << 32) | pcg32_next(rng);
+	}
+
+	return xoshiro256ss_next(rng->s.xoshiro);
+}
+
+/**
+ * ac_rng_u32 - get a random 32 bit number
+ *
+ * @rng: The generator to use, or NULL for the calling thread's generator
+ *
+ * Returns:
+ *
+ * A uniformly distributed u32
+ */
+u32 ac_rng_u32(ac_rng_t *rng)
+{
+	rng = rng_get(rng);
+
+	if (rng->algo == AC_RNG_PCG32)
+		return pcg32_next(rng);
+
+	/* The upper bits are the better ones */
+	return xoshiro256ss_next(rng->s.xoshiro) >> 32;
+}
+
+/**
+ * ac_rng_bounded - get a random number in the range [0, bound)
+ *
+ * @rng: The generator to use, or NULL for the calling thread's generator
+ * @bound: The upper bound (exclusive)
+ *
+ * This uses Lemire's nearly divisionless method which is unbiased (unlike
+ * taking the modulus) and mostly avoids a division.
+ *
+ * https://arxiv.org/abs/1805.10941
+ *
+ * Returns:
+ *
+ * A uniformly distributed u64 in the range [0, bound), 0 if bound is 0
+ */
+u64 ac_rng_bounded(ac_rng_t *rng, u64 bound)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 m;
+	u64 l;
+
+	if (bound == 0)
+		return 0;
+
+	rng = rng_get(rng);
+	m = (unsigned __int128)ac_rng_u64(rng) * bound;
+	l = (u64)m;
+	if (l < bound) {
+		u64 t = -bound % bound;
+
+		while (l < t) {
+			m = (unsigned __int128)ac_rng_u64(rng) * bound;
+			l = (u64)m;
+		}
+	}
+
+	return m >> 64;
+#else
+	u64 t;
+	u64 r;
+
+	if (bound == 0)
+		return 0;
+
+	rng = rng_get(rng);
+	/* Reject the values that would bias the modulus */
+	t = -bound % bound;
+	do {
+		r = ac_rng_u64(rng);
+	} while (r < t);
+
+	return r % bound;
+#endif
+}
+
+/**
+ * ac_rng_double - get a random double in the range [0, 1)
+ *
+ * @rng: The generator to use, or NULL for the calling thread's generator
+ *
+ * Returns:
+ *
+ * A uniformly distributed double in the range [0, 1) with 53 bits of
+ * randomness
+ */
+double ac_rng_double(ac_rng_t *rng)
+{
+	return (ac_rng_u64(rng) >> 11) * 0x1.0p-53;
+}
+
+/*
+ * Run FILL_LANES independent xoshiro256** generators side by side. The
+ * state is laid out lane-wise and the multiplications are done as shifts
+ * & adds so that the loops can be vectorised.
+ */
+static void xoshiro256ss_fill(ac_rng_t *rng, u64 *dst, size_t nr)
+{
+	u64 s0[FILL_LANES];
+	u64 s1[FILL_LANES];
+	u64 s2[FILL_LANES];
+	u64 s3[FILL_LANES];
+	size_t i;
+	int l;
+
+	for (l = 0; l < FILL_LANES; l++) {
+		u64 x = xoshiro256ss_next(rng->s.xoshiro);
+
+		s0[l] = splitmix64(&x);
+		s1[l] = splitmix64(&x);
+		s2[l] = splitmix64(&x);
+		s3[l] = splitmix64(&x);
+	}
+
+	for (i = 0; i + FILL_LANES <= nr; i += FILL_LANES) {
+		for (l = 0; l < FILL_LANES; l++) {
+			u64 x = (s1[l] << 2) + s1[l];
+			u64 t = s1[l] << 17;
+
+			x = (x << 7) | (x >> 57);
+			dst[i + l] = (x << 3) + x;
+
+			s2[l] ^= s0[l];
+			s3[l] ^= s1[l];
+			s1[l] ^= s2[l];
+			s0[l] ^= s3[l];
+			s2[l] ^= t;
+			s3[l] = (s3[l] << 45) | (s3[l] >> 19);
+		}
+	}
+	for ( ; i < nr; i++)
+		dst[i] = xoshiro256ss_next(rng->s.xoshiro);
+}
+
+/**
+ * ac_rng_fill - fill a buffer with random bytes
+ *
+ * @rng: The generator to use, or NULL for the calling thread's generator
+ * @buf: The buffer to fill
+ * @len: The size of the buffer in bytes
+ *
+ * For the xoshiro256** generator, larger buffers are filled from a number
+ * of independent streams seeded from @rng which are run in parallel.
+ *
+ * This is not suitable for generating cryptographic keys.
+ */
+void ac_rng_fill(ac_rng_t *rng, void *buf, size_t len)
+{
+	size_t nr = len / sizeof(u64);
+	size_t rem = len % sizeof(u64);
+	u64 *dst = buf;
+	u64 last;
+
+	rng = rng_get(rng);
+
+	if (rng->algo == AC_RNG_XOSHIRO256SS && nr >= FILL_LANES * 4) {
+		if (((uintptr_t)buf & (sizeof(u64) - 1)) == 0) {
+			xoshiro256ss_fill(rng, dst, nr);
+		} else {
+			u64 tmp[64];
+			size_t done = 0;
+
+			while (done < nr) {
+				size_t n = AC_MIN(nr - done,
+						  AC_ARRAY_SIZE(tmp));
+
+				xoshiro256ss_fill(rng, tmp, n);
+				memcpy((char *)buf + done * sizeof(u64), tmp,
+				       n * sizeof(u64));
+				done += n;
+			}
+		}
+	} else {
+		size_t i;
+
+		for (i = 0; i < nr; i++) {
+			u64 r = ac_rng_u64(rng);
+
+			memcpy((char *)buf + i * sizeof(u64), &r, sizeof(r));
+		}
+	}
+
+	if (rem == 0)
+		return;
+
+	last = ac_rng_u64(rng);
+	memcpy((char *)buf + nr * sizeof(u64), &last, rem);
+}
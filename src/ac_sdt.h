@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * ac_sdt.h - USDT static tracepoints
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#ifndef _AC_SDT_H_
+#define _AC_SDT_H_
+
+/*
+ * Built with SDT=1 (-DAC_USE_SDT) the probes are sys/sdt.h (systemtap-sdt)
+ * tracepoints in the 'libac' provider. A probe is a single nop until
+ * something like bpftrace or perf attaches to it, e.g
+ *
+ *   bpftrace -e 'usdt:/usr/lib64/libac.so.2:libac:htable_lookup
+ *                { @depth = hist(arg2); }'
+ *
+ * Otherwise they compile to nothing, the arguments are not evaluated.
+ */
+#ifdef AC_USE_SDT
+#include <sys/sdt.h>
+
+#define AC_PROBE0(name)				STAP_PROBE(libac, name)
+#define AC_PROBE1(name, a1)			STAP_PROBE1(libac, name, a1)
+#define AC_PROBE2(name, a1, a2)			STAP_PROBE2(libac, name, a1, a2)
+#define AC_PROBE3(name, a1, a2, a3)		\
+	STAP_PROBE3(libac, name, a1, a2, a3)
+#define AC_PROBE4(name, a1, a2, a3, a4)		\
+	STAP_PROBE4(libac, name, a1, a2, a3, a4)
+#else
+#define AC_PROBE0(name)				do { } while (0)
+#define AC_PROBE1(name, a1)			\
+	do { (void)sizeof(a1); } while (0)
+#define AC_PROBE2(name, a1, a2)			\
+	do { (void)sizeof(a1); (void)sizeof(a2); } while (0)
+#define AC_PROBE3(name, a1, a2, a3)		\
+	do { (void)sizeof(a1); (void)sizeof(a2); (void)sizeof(a3); } while (0)
+#define AC_PROBE4(name, a1, a2, a3, a4)		\
+	do { (void)sizeof(a1); (void)sizeof(a2); (void)sizeof(a3); \
+	     (void)sizeof(a4); } while (0)
+#endif
+
+#endif /* _AC_SDT_H_ */
@@ -12,6 +12,7 @@
 #include <stdbool.h>
 
 #include "include/libac.h"
+#include "ac_alloc.h"
 
 /**
  * ac_slist_last - Find the last item in the list
@@ -52,14 +53,16 @@ long ac_slist_len(const ac_slist_t *list)
 }
 
 /**
- * ac_slist_add - add an item to the end of the list
+ * ac_slist_add_with_allocator - add an item to the end of the list
  *
  * @list: The list to add the item to
  * @data: The data to add
+ * @alloc: The allocator for the list nodes, NULL for the default
  */
-void ac_slist_add(ac_slist_t **list, void *data)
+void ac_slist_add_with_allocator(ac_slist_t **list, void *data,
+				 const ac_allocator_t *alloc)
 {
-	ac_slist_t *new = malloc(sizeof(ac_slist_t));
+	ac_slist_t *new = mem_alloc(alloc, sizeof(ac_slist_t));
 
 	new->data = data;
 	new->next = NULL;
@@ -74,17 +77,30 @@ void ac_slist_add(ac_slist_t **list, void *data)
 }
 
 /**
- * ac_slist_preadd - add an item to the front of the list
+ * ac_slist_add - add an item to the end of the list
+ *
+ * @list: The list to add the item to
+ * @data: The data to add
+ */
+void ac_slist_add(ac_slist_t **list, void *data)
+{
+	ac_slist_add_with_allocator(list, data, NULL);
+}
+
+/**
+ * ac_slist_preadd_with_allocator - add an item to the front of the list
  *
  * @list: The list to add the item to
  * @data: The data to add
+ * @alloc: The allocator for the list nodes, NULL for the default
  *
  * This would be quicker than ac_slist_add when adding multiple items,
  * so it may be better to use this function and then ac_slist_reverse()
  */
-void ac_slist_preadd(ac_slist_t **list, void *data)
+void ac_slist_preadd_with_allocator(ac_slist_t **list, void *data,
+				    const ac_allocator_t *alloc)
 {
-	ac_slist_t *new = malloc(sizeof(ac_slist_t));
+	ac_slist_t *new = mem_alloc(alloc, sizeof(ac_slist_t));
 
 	new->data = data;
 	if (*list)
@@ -96,18 +112,34 @@ void ac_slist_preadd(ac_slist_t **list, void *data)
 }
 
 /**
- * ac_slist_remove - remove an item from the list
+ * ac_slist_preadd - add an item to the front of the list
+ *
+ * @list: The list to add the item to
+ * @data: The data to add
+ *
+ * This would be quicker than ac_slist_add when adding multiple items,
+ * so it may be better to use this function and then ac_slist_reverse()
+ */
+void ac_slist_preadd(ac_slist_t **list, void *data)
+{
+	ac_slist_preadd_with_allocator(list, data, NULL);
+}
+
+/**
+ * ac_slist_remove_with_allocator - remove an item from the list
  *
  * @list: The list to remove the item from
  * @data: The data to be removed
  * @free_data: An optional pointer to a function to call to free the item data
+ * @alloc: The allocator for the list nodes, NULL for the default
  *
  * Returns:
  *
  * true if the item was found and removed, false otherwise
  */
-bool ac_slist_remove(ac_slist_t **list, void *data, void (*free_data)
-							 (void *data))
+bool ac_slist_remove_with_allocator(ac_slist_t **list, void *data,
+				    void (*free_data)(void *data),
+				    const ac_allocator_t *alloc)
 {
 	ac_slist_t **pp = list;
 	ac_slist_t *p;
@@ -119,7 +151,7 @@ bool ac_slist_remove(ac_slist_t **list, void *data, void (*free_data)
 
 			if (free_data)
 				free_data(p->data);
-			free(p);
+			mem_free(alloc, p, sizeof(ac_slist_t));
 			ret = true;
 			break;
 		}
@@ -130,18 +162,37 @@ bool ac_slist_remove(ac_slist_t **list, void *data, void (*free_data)
 }
 
 /**
- * ac_slist_remove_nth - remove the nth item from the list
+ * ac_slist_remove - remove an item from the list
+ *
+ * @list: The list to remove the item from
+ * @data: The data to be removed
+ * @free_data: An optional pointer to a function to call to free the item data
+ *
+ * Returns:
+ *
+ * true if the item was found and removed, false otherwise
+ */
+bool ac_slist_remove(ac_slist_t **list, void *data, void (*free_data)
+							 (void *data))
+{
+	return ac_slist_remove_with_allocator(list, data, free_data, NULL);
+}
+
+/**
+ * ac_slist_remove_nth_with_allocator - remove the nth item from the list
  *
  * @list: The list to remove the item from
  * @n: The position of the item to be removed. Starting at 0
  * @free_data: An optional pointer to a function to call to free the item data
+ * @alloc: The allocator for the list nodes, NULL for the default
  *
  * Returns:
  *
  * true if the item was found and removed, false otherwise
  */
-bool ac_slist_remove_nth(ac_slist_t **list, long n, void (*free_data)
-							(void *data))
+bool ac_slist_remove_nth_with_allocator(ac_slist_t **list, long n,
+					void (*free_data)(void *data),
+					const ac_allocator_t *alloc)
 {
 	ac_slist_t **pp = list;
 	ac_slist_t *p;
@@ -154,7 +205,7 @@ bool ac_slist_remove_nth(ac_slist_t **list, long n, void (*free_data)
 
 			if (free_data)
 				free_data(p->data);
-			free(p);
+			mem_free(alloc, p, sizeof(ac_slist_t));
 			ret = true;
 			break;
 		}
@@ -165,20 +216,39 @@ bool ac_slist_remove_nth(ac_slist_t **list, long n, void (*free_data)
 }
 
 /**
- * ac_slist_remove_custom - remove an item from the list with the given data
+ * ac_slist_remove_nth - remove the nth item from the list
+ *
+ * @list: The list to remove the item from
+ * @n: The position of the item to be removed. Starting at 0
+ * @free_data: An optional pointer to a function to call to free the item data
+ *
+ * Returns:
+ *
+ * true if the item was found and removed, false otherwise
+ */
+bool ac_slist_remove_nth(ac_slist_t **list, long n, void (*free_data)
+							(void *data))
+{
+	return ac_slist_remove_nth_with_allocator(list, n, free_data, NULL);
+}
+
+/**
+ * ac_slist_remove_custom_with_allocator - remove an item using an allocator
  *
  * @list: The list to remove the item from
  * @data: The data to be removed
  * @compar: A comparison function (should return 0 when item found)
  * @free_data: An optional pointer to a function to call to free the item data
+ * @alloc: The allocator for the list nodes, NULL for the default
  *
  * Returns:
  *
  * true if the item was found and removed, false otherwise
  */
-bool ac_slist_remove_custom(ac_slist_t **list, void *data,
-			    int (*compar)(const void *a, const void *b),
-			    void (*free_data)(void *data))
+bool ac_slist_remove_custom_with_allocator(ac_slist_t **list, void *data,
+				int (*compar)(const void *a, const void *b),
+				void (*free_data)(void *data),
+				const ac_allocator_t *alloc)
 {
 	ac_slist_t **pp = list;
 	ac_slist_t *p;
@@ -192,7 +262,7 @@ bool ac_slist_remove_custom(ac_slist_t **list, void *data,
 
 			if (free_data)
 				free_data(p->data);
-			free(p);
+			mem_free(alloc, p, sizeof(ac_slist_t));
 			ret = true;
 			break;
 		}
@@ -202,6 +272,26 @@ bool ac_slist_remove_custom(ac_slist_t **list, void *data,
 	return ret;
 }
 
+/**
+ * ac_slist_remove_custom - remove an item from the list with the given data
+ *
+ * @list: The list to remove the item from
+ * @data: The data to be removed
+ * @compar: A comparison function (should return 0 when item found)
+ * @free_data: An optional pointer to a function to call to free the item data
+ *
+ * Returns:
+ *
+ * true if the item was found and removed, false otherwise
+ */
+bool ac_slist_remove_custom(ac_slist_t **list, void *data,
+			    int (*compar)(const void *a, const void *b),
+			    void (*free_data)(void *data))
+{
+	return ac_slist_remove_custom_with_allocator(list, data, compar,
+						     free_data, NULL);
+}
+
 /**
  * ac_slist_reverse - reverse a list
  *
@@ -311,19 +401,33 @@ void ac_slist_foreach(ac_slist_t *list, void (*action)(void *item, void *data),
 }
 
 /**
- * ac_slist_destroy - destroy a list, optionally freeing all its items memory
+ * ac_slist_destroy_with_allocator - destroy a list using an allocator
  *
  * @list: The list to destroy
  * @free_data: Function to free an items memory, can be NULL
+ * @alloc: The allocator for the list nodes, NULL for the default
  */
-void ac_slist_destroy(ac_slist_t **list, void (*free_data)(void *data))
+void ac_slist_destroy_with_allocator(ac_slist_t **list,
+				     void (*free_data)(void *data),
+				     const ac_allocator_t *alloc)
 {
 	while (*list) {
 		ac_slist_t *p = (*list)->next;
 
 		if (free_data)
 			free_data((*list)->data);
-		free(*list);
+		mem_free(alloc, *list, sizeof(ac_slist_t));
 		*list = p;
 	}
 }
+
+/**
+ * ac_slist_destroy - destroy a list, optionally freeing all its items memory
+ *
+ * @list: The list to destroy
+ * @free_data: Function to free an items memory, can be NULL
+ */
+void ac_slist_destroy(ac_slist_t **list, void (*free_data)(void *data))
+{
+	ac_slist_destroy_with_allocator(list, free_data, NULL);
+}
@@ -89,6 +89,69 @@ char **ac_str_split(const char *string, int delim, int flags)
 	return fields;
 }
 
+/**
+ * ac_str_split_arena - split a string up into a NULL terminated vector
+ *
+ * @arena: The arena to allocate the vector from
+ * @string: String to be split
+ * @delim: The character to use as the delimiter
+ * @flags: Can be 0 or AC_STR_SPLIT_STRICT (to return an empty vector when
+ *	   there's no delimiters)
+ *
+ * As ac_str_split() but the vector and a single copy of the string are
+ * allocated from the given arena and are free'd along with it.
+ *
+ * Returns:
+ *
+ * A NULL terminated vector (array of string pointers) or NULL on failure
+ */
+char **ac_str_split_arena(ac_arena_t *arena, const char *string, int delim,
+			  int flags)
+{
+	char **fields;
+	char *strd;
+	char *p;
+	size_t nr_fields = 1;
+	size_t len;
+	size_t i = 0;
+
+	/* Check for unknown flags */
+	if (flags & ~(AC_STR_SPLIT_STRICT)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	for (p = strchr(string, delim); p && *p; p = strchr(p + 1, delim))
+		nr_fields++;
+
+	len = strlen(string);
+	if (len == 0 ||
+	    (!strchr(string, delim) && (flags & AC_STR_SPLIT_STRICT)))
+		nr_fields = 0;
+
+	fields = ac_arena_alloc(arena, sizeof(char *) * (nr_fields + 1));
+	if (!fields)
+		return NULL;
+	if (nr_fields == 0) {
+		fields[0] = NULL;
+		return fields;
+	}
+
+	strd = ac_arena_alloc_aligned(arena, len + 1, 1);
+	if (!strd)
+		return NULL;
+	memcpy(strd, string, len + 1);
+
+	fields[i++] = strd;
+	for (p = strchr(strd, delim); p && *p; p = strchr(p, delim)) {
+		*p++ = '\0';
+		fields[i++] = p;
+	}
+	fields[i] = NULL;
+
+	return fields;
+}
+
 /**
  * ac_str_chomp - remove trailing white space from a string
  *
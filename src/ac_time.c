@@ -3,13 +3,21 @@
 /*
  * ac_time.c - Time related functions
  *
- * Copyright (c) 2017 - 2018	Andrew Clayton <andrew@digital-domain.net>
+ * Copyright (c) 2017 - 2018, 2022	Andrew Clayton <andrew@digital-domain.net>
  */
 
 #define _GNU_SOURCE		/* struct timespec, nanosleep(2) */
 
+#include <stdbool.h>
+#include <limits.h>
+#include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
 
 #include "include/libac.h"
 
@@ -91,3 +99,770 @@ int ac_time_nsleep(u64 nsecs)
 
 	return 0;
 }
+
+/* How long to calibrate the TSC against CLOCK_MONOTONIC for */
+#define TSC_CALIBRATE_NS	(10 * AC_TIME_NS_MSEC)
+#define TSC_MULT_SHIFT		32
+
+static struct {
+	bool use_tsc;
+	u64 base_cycles;
+	u64 base_ns;
+	/* ns = (cycles * mult) >> TSC_MULT_SHIFT */
+	u64 mult;
+} tsc;
+static pthread_once_t tsc_once = PTHREAD_ONCE_INIT;
+
+static inline u64 timespec_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * AC_TIME_NS_SEC + ts->tv_nsec;
+}
+
+static inline void ns_to_timespec(u64 ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / AC_TIME_NS_SEC;
+	ts->tv_nsec = ns % AC_TIME_NS_SEC;
+}
+
+static inline u64 clock_monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return timespec_to_ns(&ts);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline u64 read_tsc(void)
+{
+	return __rdtsc();
+}
+
+/*
+ * The TSC is only any good as a clock if it ticks at a constant rate
+ * regardless of frequency scaling & sleep states, CPUID Fn8000_0007 EDX[8].
+ */
+static bool tsc_is_invariant(void)
+{
+	unsigned int eax;
+	unsigned int ebx;
+	unsigned int ecx;
+	unsigned int edx;
+
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		return false;
+
+	return edx & (1U << 8);
+}
+#else
+static inline u64 read_tsc(void)
+{
+	return clock_monotonic_ns();
+}
+
+static bool tsc_is_invariant(void)
+{
+	return false;
+}
+#endif
+
+static inline u64 tsc_cycles_to_ns(u64 cycles)
+{
+#ifdef __SIZEOF_INT128__
+	return ((unsigned __int128)cycles * tsc.mult) >> TSC_MULT_SHIFT;
+#else
+	u64 hi = (cycles >> 32) * tsc.mult;
+	u64 lo = ((cycles & 0xffffffff) * tsc.mult) >> TSC_MULT_SHIFT;
+
+	return hi + lo;
+#endif
+}
+
+/*
+ * Take a CLOCK_MONOTONIC reading along with the TSC value at the same
+ * moment. The read with the fewest cycles between the TSC reads either
+ * side of it is used to minimise the error.
+ */
+static void tsc_sample(u64 *cycles, u64 *ns)
+{
+	u64 best = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		u64 c0 = read_tsc();
+		u64 t = clock_monotonic_ns();
+		u64 c1 = read_tsc();
+
+		if (c1 - c0 < best) {
+			best = c1 - c0;
+			*cycles = c0 + (c1 - c0) / 2;
+			*ns = t;
+		}
+	}
+}
+
+/* Work out the TSC frequency by counting the cycles over a short sleep */
+static void tsc_calibrate(void)
+{
+	u64 c0;
+	u64 c1;
+	u64 ns0;
+	u64 ns1;
+
+	if (!tsc_is_invariant())
+		return;
+
+	tsc_sample(&c0, &ns0);
+	ac_time_nsleep(TSC_CALIBRATE_NS);
+	tsc_sample(&c1, &ns1);
+
+	/* Anything under 100MHz is too suspicious to use */
+	if (c1 <= c0 || (c1 - c0) / ((ns1 - ns0) / AC_TIME_NS_USEC) < 100)
+		return;
+
+	tsc.mult = ((ns1 - ns0) << TSC_MULT_SHIFT) / (c1 - c0);
+	tsc.base_cycles = c1;
+	tsc.base_ns = ns1;
+	tsc.use_tsc = true;
+}
+
+static inline void tsc_init(void)
+{
+	pthread_once(&tsc_once, tsc_calibrate);
+}
+
+/**
+ * ac_time_clock_ns - get the monotonic time in nanoseconds
+ *
+ * Where the CPU has an invariant TSC this reads the TSC and converts it to
+ * nanoseconds, it's calibrated against CLOCK_MONOTONIC on first use (which
+ * takes ~10ms). Otherwise it uses clock_gettime(CLOCK_MONOTONIC).
+ *
+ * The TSC is read without serialising instructions, so it should be used
+ * for timing things taking longer than a few tens of nanoseconds.
+ *
+ * Returns:
+ *
+ * The time in nanoseconds since some unspecified starting point
+ */
+u64 ac_time_clock_ns(void)
+{
+	tsc_init();
+
+	if (!tsc.use_tsc)
+		return clock_monotonic_ns();
+
+	return tsc.base_ns + tsc_cycles_to_ns(read_tsc() - tsc.base_cycles);
+}
+
+/**
+ * ac_time_clock_cycles - get the raw TSC value
+ *
+ * This is the cheapest clock available, use ac_time_cycles_to_ns() to
+ * convert the difference between two readings to nanoseconds.
+ *
+ * Returns:
+ *
+ * The TSC value or the monotonic time in nanoseconds if the TSC isn't
+ * usable
+ */
+u64 ac_time_clock_cycles(void)
+{
+	tsc_init();
+
+	if (!tsc.use_tsc)
+		return clock_monotonic_ns();
+
+	return read_tsc();
+}
+
+/**
+ * ac_time_cycles_to_ns - convert a number of cycles to nanoseconds
+ *
+ * @cycles: The number of cycles, as the difference between two values
+ *          returned by ac_time_clock_cycles()
+ *
+ * Returns:
+ *
+ * The number of nanoseconds
+ */
+u64 ac_time_cycles_to_ns(u64 cycles)
+{
+	tsc_init();
+
+	if (!tsc.use_tsc)
+		return cycles;
+
+	return tsc_cycles_to_ns(cycles);
+}
+
+/**
+ * ac_time_clock_is_tsc - check if the TSC is being used as the clock source
+ *
+ * Returns:
+ *
+ * true if ac_time_clock_ns() is using the TSC, false otherwise
+ */
+bool ac_time_clock_is_tsc(void)
+{
+	tsc_init();
+
+	return tsc.use_tsc;
+}
+
+static u64 coarse_ns;
+static struct {
+	pthread_mutex_t mtx;
+	/* Signalled on stop, uses CLOCK_MONOTONIC, see coarse_cond_init() */
+	pthread_cond_t cond;
+	pthread_t tid;
+	bool running;
+	bool stop;
+	u64 interval_ns;
+} coarse_ticker = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER
+};
+static pthread_once_t coarse_once = PTHREAD_ONCE_INIT;
+
+static void coarse_cond_init(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&coarse_ticker.cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * ac_time_coarse_update - update the cached coarse clock
+ *
+ * This can be called periodically from an event loop instead of (or as
+ * well as) running the ticker thread via ac_time_coarse_start().
+ */
+void ac_time_coarse_update(void)
+{
+	__atomic_store_n(&coarse_ns, clock_monotonic_ns(), __ATOMIC_RELEASE);
+}
+
+static void *coarse_ticker_thread(void *arg __always_unused)
+{
+	pthread_mutex_lock(&coarse_ticker.mtx);
+	while (!coarse_ticker.stop) {
+		struct timespec ts;
+
+		ac_time_coarse_update();
+
+		/*
+		 * Wait on the condvar rather than sleeping so that
+		 * ac_time_coarse_stop() doesn't have to wait out a full
+		 * interval. A spurious wakeup just means an early update.
+		 */
+		ns_to_timespec(clock_monotonic_ns() + coarse_ticker.interval_ns,
+			       &ts);
+		pthread_cond_timedwait(&coarse_ticker.cond, &coarse_ticker.mtx,
+				       &ts);
+	}
+	pthread_mutex_unlock(&coarse_ticker.mtx);
+
+	return NULL;
+}
+
+/**
+ * ac_time_coarse_start - start a thread updating the cached coarse clock
+ *
+ * @interval_us: How often to update the clock in microseconds
+ *
+ * Returns:
+ *
+ * 0 on success or -1 on failure, check errno (EBUSY if it's already
+ * running)
+ */
+int ac_time_coarse_start(u64 interval_us)
+{
+	int err;
+
+	if (interval_us == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_once(&coarse_once, coarse_cond_init);
+
+	pthread_mutex_lock(&coarse_ticker.mtx);
+	if (coarse_ticker.running) {
+		pthread_mutex_unlock(&coarse_ticker.mtx);
+		errno = EBUSY;
+		return -1;
+	}
+
+	ac_time_coarse_update();
+	coarse_ticker.interval_ns = interval_us * AC_TIME_NS_USEC;
+	coarse_ticker.stop = false;
+	err = pthread_create(&coarse_ticker.tid, NULL, coarse_ticker_thread,
+			     NULL);
+	if (!err)
+		coarse_ticker.running = true;
+	pthread_mutex_unlock(&coarse_ticker.mtx);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * ac_time_coarse_stop - stop the coarse clock ticker thread
+ *
+ * The cached time is left as it was last updated. The ticker is only
+ * considered stopped once its thread has been joined, until then
+ * ac_time_coarse_start() will fail with EBUSY.
+ */
+void ac_time_coarse_stop(void)
+{
+	pthread_t tid;
+
+	pthread_mutex_lock(&coarse_ticker.mtx);
+	/* Not running or someone else is already stopping it */
+	if (!coarse_ticker.running || coarse_ticker.stop) {
+		pthread_mutex_unlock(&coarse_ticker.mtx);
+		return;
+	}
+	coarse_ticker.stop = true;
+	tid = coarse_ticker.tid;
+	pthread_cond_signal(&coarse_ticker.cond);
+	pthread_mutex_unlock(&coarse_ticker.mtx);
+
+	pthread_join(tid, NULL);
+
+	pthread_mutex_lock(&coarse_ticker.mtx);
+	coarse_ticker.running = false;
+	coarse_ticker.stop = false;
+	pthread_mutex_unlock(&coarse_ticker.mtx);
+}
+
+/**
+ * ac_time_coarse_ns - get the cached coarse monotonic time in nanoseconds
+ *
+ * This is a single memory load, the value is only as accurate as the
+ * interval it's updated at. If it has never been updated, it is updated
+ * now.
+ *
+ * Returns:
+ *
+ * The CLOCK_MONOTONIC time in nanoseconds as of the last update
+ */
+u64 ac_time_coarse_ns(void)
+{
+	u64 ns = __atomic_load_n(&coarse_ns, __ATOMIC_ACQUIRE);
+
+	if (ns == 0) {
+		ac_time_coarse_update();
+		ns = __atomic_load_n(&coarse_ns, __ATOMIC_ACQUIRE);
+	}
+
+	return ns;
+}
+
+/**
+ * ac_time_coarse_tspec - get the cached coarse monotonic time
+ *
+ * @ts: Filled out with the CLOCK_MONOTONIC time as of the last update
+ */
+void ac_time_coarse_tspec(struct timespec *ts)
+{
+	u64 ns = ac_time_coarse_ns();
+
+	ts->tv_sec = ns / AC_TIME_NS_SEC;
+	ts->tv_nsec = ns % AC_TIME_NS_SEC;
+}
+
+/**
+ * ac_time_coarse_elapsed - get the time elapsed since start
+ *
+ * @delta: Filled out with the result
+ * @start: struct timespec containing the CLOCK_MONOTONIC start time
+ *
+ * This is like ac_time_tspec_diff() with the end time being the cached
+ * coarse time.
+ *
+ * Returns:
+ *
+ * The time difference in seconds as a double
+ */
+double ac_time_coarse_elapsed(struct timespec *delta,
+			      const struct timespec *start)
+{
+	struct timespec now;
+
+	ac_time_coarse_tspec(&now);
+
+	return ac_time_tspec_diff(delta, &now, start);
+}
+
+/*
+ * How far ahead of a deadline to stop sleeping and start spinning. This
+ * needs to cover the default 50us timer slack plus wakeup latency.
+ */
+#define PRECISE_SPIN_NS		(100 * AC_TIME_NS_USEC)
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static int sleep_until_ns(u64 deadline)
+{
+	u64 now = clock_monotonic_ns();
+
+	if (deadline > now + PRECISE_SPIN_NS) {
+		struct timespec ts;
+		int err;
+
+		ns_to_timespec(deadline - PRECISE_SPIN_NS, &ts);
+		do {
+			err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					      &ts, NULL);
+		} while (err == EINTR);
+		if (err) {
+			errno = err;
+			return -1;
+		}
+	}
+
+	while (clock_monotonic_ns() < deadline)
+		cpu_relax();
+
+	return 0;
+}
+
+/**
+ * ac_time_sleep_until - sleep until an absolute time
+ *
+ * @deadline: The CLOCK_MONOTONIC time to sleep until
+ *
+ * This sleeps until shortly before @deadline then busy waits for the
+ * remainder, so wakes up within a microsecond or so of the deadline
+ * rather than overshooting by the timer slack. The cost is up to 100us of
+ * CPU time per call.
+ *
+ * Returns:
+ *
+ * 0 On success or -1 on failure, check errno
+ */
+int ac_time_sleep_until(const struct timespec *deadline)
+{
+	return sleep_until_ns(timespec_to_ns(deadline));
+}
+
+/**
+ * ac_time_nsleep_precise - sleep for an accurate number of nanoseconds
+ *
+ * @nsecs: Number of nanoseconds to sleep for
+ *
+ * Like ac_time_nsleep() but using ac_time_sleep_until() to avoid
+ * overshooting, for when short sleeps need to be accurate.
+ *
+ * Returns:
+ *
+ * 0 On success or -1 on failure, check errno
+ */
+int ac_time_nsleep_precise(u64 nsecs)
+{
+	return sleep_until_ns(clock_monotonic_ns() + nsecs);
+}
+
+/**
+ * ac_time_period_init - initialise a periodic timer
+ *
+ * @period: The periodic timer to initialise
+ * @period_ns: The period in nanoseconds
+ *
+ * The first period starts now.
+ */
+void ac_time_period_init(ac_time_period_t *period, u64 period_ns)
+{
+	period->period_ns = period_ns;
+	period->next_ns = clock_monotonic_ns();
+}
+
+/**
+ * ac_time_period_wait - wait for the start of the next period
+ *
+ * @period: The periodic timer
+ *
+ * The deadlines are absolute, each one period after the last, so time
+ * spent between calls and any wake up latency doesn't accumulate.
+ *
+ * If one or more whole periods have already been missed, this doesn't
+ * wait and the following deadline is the next one in the future.
+ *
+ * Returns:
+ *
+ * The number of periods missed, 0 if on time or -1 on failure, check
+ * errno
+ */
+int ac_time_period_wait(ac_time_period_t *period)
+{
+	u64 now = clock_monotonic_ns();
+	u64 missed;
+
+	period->next_ns += period->period_ns;
+	if (period->next_ns > now)
+		return sleep_until_ns(period->next_ns);
+
+	missed = (now - period->next_ns) / period->period_ns + 1;
+	period->next_ns += (missed - 1) * period->period_ns;
+
+	return missed > INT_MAX ? INT_MAX : (int)missed;
+}
+
+/* The date & time part of the last formatted timestamp, per thread */
+static __thread struct {
+	s64 sec;
+	s64 day;
+	char str[19];
+} rfc3339_cache = { .sec = -1, .day = -1 };
+
+static inline void put_2digits(char *p, int val)
+{
+	p[0] = '0' + val / 10;
+	p[1] = '0' + val % 10;
+}
+
+/*
+ * Days since 1970-01-01 to a proleptic Gregorian date, from Howard
+ * Hinnant's chrono-Compatible Low-Level Date Algorithms.
+ */
+static void civil_from_days(s64 z, s64 *y, int *m, int *d)
+{
+	s64 era;
+	u32 doe;
+	u32 yoe;
+	u32 doy;
+	u32 mp;
+
+	z += 719468;
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = z - era * 146097;
+	yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+	doy = doe - (365*yoe + yoe/4 - yoe/100);
+	mp = (5*doy + 2) / 153;
+	*d = doy - (153*mp + 2)/5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = (s64)yoe + era * 400 + (*m <= 2);
+}
+
+static s64 days_from_civil(s64 y, int m, int d)
+{
+	s64 era;
+	u32 yoe;
+	u32 doy;
+	u32 doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153*(m > 2 ? m - 3 : m + 9) + 2)/5 + d - 1;
+	doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+
+	return era * 146097 + (s64)doe - 719468;
+}
+
+/**
+ * ac_time_fmt_rfc3339 - format a time as an RFC 3339 UTC timestamp
+ *
+ * @dst: A buffer of at least AC_TIME_RFC3339_LEN + 1 bytes
+ * @ts: The (CLOCK_REALTIME) time to format
+ * @frac_digits: The number of sub-second digits, 0 - 9
+ *
+ * E.g "2022-04-01T12:34:56.789Z". The date & time part is cached per
+ * thread, so formatting several timestamps within the same second just
+ * copies it. Only years 0 - 9999 can be represented.
+ *
+ * Returns:
+ *
+ * The length of the timestamp, or 0 if it couldn't be formatted
+ */
+size_t ac_time_fmt_rfc3339(char *dst, const struct timespec *ts,
+			   int frac_digits)
+{
+	s64 sec = ts->tv_sec;
+	char *p = dst + sizeof(rfc3339_cache.str);
+
+	if (frac_digits < 0 || frac_digits > 9)
+		return 0;
+
+	if (sec != rfc3339_cache.sec) {
+		s64 day = (sec >= 0 ? sec : sec - 86399) / 86400;
+		int secs = sec - day * 86400;
+		char *str = rfc3339_cache.str;
+
+		if (day != rfc3339_cache.day) {
+			s64 y;
+			int m;
+			int d;
+
+			civil_from_days(day, &y, &m, &d);
+			if (y < 0 || y > 9999)
+				return 0;
+
+			put_2digits(str, y / 100);
+			put_2digits(str + 2, y % 100);
+			str[4] = '-';
+			put_2digits(str + 5, m);
+			str[7] = '-';
+			put_2digits(str + 8, d);
+			str[10] = 'T';
+			rfc3339_cache.day = day;
+		}
+		put_2digits(str + 11, secs / 3600);
+		str[13] = ':';
+		put_2digits(str + 14, secs / 60 % 60);
+		str[16] = ':';
+		put_2digits(str + 17, secs % 60);
+		rfc3339_cache.sec = sec;
+	}
+	memcpy(dst, rfc3339_cache.str, sizeof(rfc3339_cache.str));
+
+	if (frac_digits) {
+		long nsec = ts->tv_nsec;
+		int i;
+
+		*p++ = '.';
+		for (i = 9; i > frac_digits; i--)
+			nsec /= 10;
+		for (i = frac_digits - 1; i >= 0; i--) {
+			p[i] = '0' + nsec % 10;
+			nsec /= 10;
+		}
+		p += frac_digits;
+	}
+	*p++ = 'Z';
+	*p = '\0';
+
+	return p - dst;
+}
+
+static inline int parse_digits(const char *p, int n)
+{
+	int val = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (p[i] < '0' || p[i] > '9')
+			return -1;
+		val = val * 10 + (p[i] - '0');
+	}
+
+	return val;
+}
+
+static inline bool is_leap_year(int y)
+{
+	return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+/**
+ * ac_time_parse_rfc3339 - parse an RFC 3339 timestamp
+ *
+ * @str: The timestamp, it doesn't need to be nul terminated
+ * @len: The length of the timestamp
+ * @ts: Filled out with the time since the Epoch (UTC)
+ *
+ * This is strict, the whole string must be a timestamp of the form
+ * YYYY-MM-DDTHH:MM:SS[.fraction](Z|+HH:MM|-HH:MM) ('T' may also be 't' or
+ * a space and 'Z' may be 'z'). Up to 9 fractional digits are used, any
+ * more are checked but ignored. A leap second (:60) is taken as the
+ * following second.
+ *
+ * Returns:
+ *
+ * 0 on success or -1 if the timestamp is invalid (errno is set to EINVAL)
+ */
+int ac_time_parse_rfc3339(const char *str, size_t len, struct timespec *ts)
+{
+	static const u8 mdays[12] = {
+		31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+	};
+	const char *p = str + 19;
+	const char *end = str + len;
+	int year;
+	int mon;
+	int mday;
+	int hour;
+	int min;
+	int sec;
+	long nsec = 0;
+	int offset = 0;
+	s64 secs;
+
+	if (len < 20 || str[4] != '-' || str[7] != '-' ||
+	    (str[10] != 'T' && str[10] != 't' && str[10] != ' ') ||
+	    str[13] != ':' || str[16] != ':')
+		goto invalid;
+
+	year = parse_digits(str, 4);
+	mon = parse_digits(str + 5, 2);
+	mday = parse_digits(str + 8, 2);
+	hour = parse_digits(str + 11, 2);
+	min = parse_digits(str + 14, 2);
+	sec = parse_digits(str + 17, 2);
+	if (year < 0 || mon < 1 || mon > 12 || mday < 1 || hour < 0 ||
+	    hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 60)
+		goto invalid;
+	if (mday > mdays[mon - 1] + (mon == 2 && is_leap_year(year)))
+		goto invalid;
+
+	if (*p == '.') {
+		int digits = 0;
+
+		p++;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (digits < 9) {
+				nsec = nsec * 10 + (*p - '0');
+				digits++;
+			}
+			p++;
+		}
+		if (p == str + 20)
+			goto invalid;
+		for ( ; digits < 9; digits++)
+			nsec *= 10;
+	}
+
+	if (p == end)
+		goto invalid;
+	if ((*p == 'Z' || *p == 'z') && p + 1 == end) {
+		offset = 0;
+	} else if ((*p == '+' || *p == '-') && end - p == 6 && p[3] == ':') {
+		int oh = parse_digits(p + 1, 2);
+		int om = parse_digits(p + 4, 2);
+
+		if (oh < 0 || oh > 23 || om < 0 || om > 59)
+			goto invalid;
+		offset = (oh * 60 + om) * 60;
+		if (*p == '-')
+			offset = -offset;
+	} else {
+		goto invalid;
+	}
+
+	secs = days_from_civil(year, mon, mday) * 86400 + hour * 3600 +
+	       min * 60 + sec;
+	ts->tv_sec = secs - offset;
+	ts->tv_nsec = nsec;
+
+	return 0;
+
+invalid:
+	errno = EINVAL;
+	return -1;
+}
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * cpu_avx2.c - AVX2 kernels, built with -mavx2
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <immintrin.h>
+
+#include "../../ac_cpu.h"
+
+size_t json_escape_span_avx2(const char *str, size_t len)
+{
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i bslash = _mm256_set1_epi8('\\');
+	const __m256i ctrl = _mm256_set1_epi8(0x1f);
+	size_t i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(str + i));
+		__m256i m;
+		unsigned int mask;
+
+		m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+				    _mm256_cmpeq_epi8(v, bslash));
+		/* Unsigned v <= 0x1f */
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(
+					_mm256_min_epu8(v, ctrl), v));
+		mask = _mm256_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	/* Less than 32 bytes left, finish up 16 at a time */
+	return i + json_escape_span_sse2(str + i, len - i);
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * cpu_avx512.c - AVX-512 (F & BW) kernels, built with -mavx512f -mavx512bw
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include "../../ac_cpu.h"
+
+/* Only built when the compiler supports AVX-512, see src/Makefile */
+#ifdef AC_HAVE_AVX512
+
+#include <immintrin.h>
+
+size_t json_escape_span_avx512(const char *str, size_t len)
+{
+	const __m512i quote = _mm512_set1_epi8('"');
+	const __m512i bslash = _mm512_set1_epi8('\\');
+	const __m512i ctrl = _mm512_set1_epi8(0x1f);
+	size_t i = 0;
+
+	while (i < len) {
+		/* The tail is done with a masked load, which can't fault */
+		__mmask64 lmask = len - i >= 64 ? ~0ULL :
+						  (1ULL << (len - i)) - 1;
+		__m512i v = _mm512_maskz_loadu_epi8(lmask, str + i);
+		__mmask64 mask;
+
+		mask = _mm512_cmpeq_epi8_mask(v, quote) |
+		       _mm512_cmpeq_epi8_mask(v, bslash) |
+		       _mm512_cmple_epu8_mask(v, ctrl);
+		mask &= lmask;
+		if (mask)
+			return i + __builtin_ctzll(mask);
+		i += 64;
+	}
+
+	return len;
+}
+
+#endif /* AC_HAVE_AVX512 */
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * cpu_sse2.c - SSE2 kernels
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <emmintrin.h>
+
+#include "../../ac_cpu.h"
+
+size_t json_escape_span_sse2(const char *str, size_t len)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	const __m128i ctrl = _mm_set1_epi8(0x1f);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+		__m128i m;
+		int mask;
+
+		m = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+				 _mm_cmpeq_epi8(v, bslash));
+		/* Unsigned v <= 0x1f */
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+		mask = _mm_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + json_escape_span_generic(str + i, len - i);
+}
@@ -0,0 +1,1760 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * bench.c - Microbenchmarks for libac
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <getopt.h>
+#include <sys/utsname.h>
+
+#include "../include/libac.h"
+
+#define BENCH_JSON_VERSION	1
+#define BENCH_REPS		15
+#define BENCH_MIN_MS		20
+
+/* Stop the compiler from optimising away a result */
+#define bench_keep(v)	__asm__ __volatile__("" : : "g"(v) : "memory")
+
+struct bench {
+	const char *module;
+	const char *name;
+	size_t size;
+
+	void *(*setup)(size_t size);
+	void (*run)(void *data, u64 iters);
+	void (*teardown)(void *data);
+};
+
+static const char * const bench_cnt_names[AC_PERF_NR_COUNTERS] = {
+	"cycles",
+	"instructions",
+	"cache_misses",
+	"branch_misses"
+};
+
+struct bench_result {
+	u64 iters;
+	double median;
+	double p99;
+	double min;
+	double mean;
+	double ops_sec;
+	double mb_sec;
+
+	bool have_counters;
+	double counters[AC_PERF_NR_COUNTERS];
+};
+
+/* Bytes processed per operation, set by a benchmark's setup function */
+static size_t bench_bytes;
+
+static ac_rng_t bench_rng;
+
+static u32 *bench_keys(size_t nmemb)
+{
+	u32 *keys = malloc(nmemb * sizeof(u32));
+	size_t i;
+
+	/* Unique and in a (repeatable) random order */
+	for (i = 0; i < nmemb; i++)
+		keys[i] = i * 2654435761U;
+	for (i = nmemb; i > 1; i--) {
+		size_t j = ac_rng_bounded(&bench_rng, i);
+		u32 tmp = keys[i - 1];
+
+		keys[i - 1] = keys[j];
+		keys[j] = tmp;
+	}
+
+	return keys;
+}
+
+/*
+ * arena
+ */
+
+struct arena_bench {
+	ac_arena_t *arena;
+	size_t size;
+};
+
+static void *arena_setup(size_t size)
+{
+	struct arena_bench *ab = malloc(sizeof(struct arena_bench));
+
+	ab->arena = ac_arena_new(0);
+	ab->size = size;
+
+	return ab;
+}
+
+static void arena_alloc_run(void *data, u64 iters)
+{
+	struct arena_bench *ab = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		void *ptr = ac_arena_alloc(ab->arena, ab->size);
+
+		bench_keep(ptr);
+		if ((i & 1023) == 1023)
+			ac_arena_reset(ab->arena);
+	}
+	ac_arena_reset(ab->arena);
+}
+
+static void arena_teardown(void *data)
+{
+	struct arena_bench *ab = data;
+
+	ac_arena_destroy(ab->arena);
+	free(ab);
+}
+
+/*
+ * btree
+ */
+
+struct btree_bench {
+	ac_btree_t *tree;
+	u32 *keys;
+	size_t nmemb;
+	size_t next;
+};
+
+static int btree_cmp(const void *a, const void *b)
+{
+	const u32 k1 = *(const u32 *)a;
+	const u32 k2 = *(const u32 *)b;
+
+	return (k1 > k2) - (k1 < k2);
+}
+
+static void *btree_setup(size_t size)
+{
+	struct btree_bench *bb = malloc(sizeof(struct btree_bench));
+	size_t i;
+
+	bb->tree = ac_btree_new(btree_cmp, NULL);
+	bb->keys = bench_keys(size);
+	bb->nmemb = size;
+	bb->next = 0;
+	for (i = 0; i < size; i++)
+		ac_btree_add(bb->tree, &bb->keys[i]);
+
+	return bb;
+}
+
+static void btree_lookup_run(void *data, u64 iters)
+{
+	struct btree_bench *bb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		bench_keep(ac_btree_lookup(bb->tree, &bb->keys[bb->next]));
+		if (++bb->next == bb->nmemb)
+			bb->next = 0;
+	}
+}
+
+static void btree_remove_add_run(void *data, u64 iters)
+{
+	struct btree_bench *bb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_btree_remove(bb->tree, &bb->keys[bb->next]);
+		ac_btree_add(bb->tree, &bb->keys[bb->next]);
+		if (++bb->next == bb->nmemb)
+			bb->next = 0;
+	}
+}
+
+static void btree_teardown(void *data)
+{
+	struct btree_bench *bb = data;
+
+	ac_btree_destroy(bb->tree);
+	free(bb->keys);
+	free(bb);
+}
+
+/*
+ * circ_buf
+ */
+
+static void *circ_buf_setup(size_t size)
+{
+	ac_circ_buf_t *cbuf = ac_circ_buf_new(size, 0);
+	size_t i;
+
+	/* Half full so the head & tail keep moving through the buffer */
+	for (i = 0; i < size / 2; i++)
+		ac_circ_buf_push(cbuf, cbuf);
+
+	return cbuf;
+}
+
+static void circ_buf_push_pop_run(void *data, u64 iters)
+{
+	ac_circ_buf_t *cbuf = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_circ_buf_push(cbuf, cbuf);
+		bench_keep(ac_circ_buf_pop(cbuf));
+	}
+}
+
+static void circ_buf_teardown(void *data)
+{
+	ac_circ_buf_destroy(data);
+}
+
+/*
+ * geo
+ */
+
+struct geo_bench {
+	ac_geo_t *points;
+	size_t nmemb;
+	size_t next;
+
+	ac_geo_kdtree_t *tree;
+};
+
+static void *geo_setup(size_t size)
+{
+	struct geo_bench *gb = malloc(sizeof(struct geo_bench));
+	size_t i;
+
+	gb->points = calloc(size, sizeof(ac_geo_t));
+	gb->nmemb = size;
+	gb->next = 0;
+	gb->tree = NULL;
+	/* Somewhere in Great Britain, so the BNG conversions make sense */
+	for (i = 0; i < size; i++) {
+		gb->points[i].ref = AC_GEO_EREF_WGS84;
+		gb->points[i].lat = 50.0 + ac_rng_double(&bench_rng) * 8.0;
+		gb->points[i].lon = -6.0 + ac_rng_double(&bench_rng) * 7.5;
+	}
+
+	return gb;
+}
+
+static void *geo_kdtree_setup(size_t size)
+{
+	struct geo_bench *gb = geo_setup(size);
+
+	gb->tree = ac_geo_kdtree_new(gb->points, size);
+
+	return gb;
+}
+
+static void geo_haversine_run(void *data, u64 iters)
+{
+	struct geo_bench *gb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		size_t to = gb->next + 1 == gb->nmemb ? 0 : gb->next + 1;
+
+		bench_keep(ac_geo_haversine(&gb->points[gb->next],
+					    &gb->points[to]));
+		gb->next = to;
+	}
+}
+
+static void geo_geohash_encode_run(void *data, u64 iters)
+{
+	struct geo_bench *gb = data;
+	char hash[AC_GEO_GEOHASH_MAX_LEN + 1];
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		bench_keep(ac_geo_geohash_encode(&gb->points[gb->next],
+						 AC_GEO_GEOHASH_MAX_LEN,
+						 hash));
+		if (++gb->next == gb->nmemb)
+			gb->next = 0;
+	}
+}
+
+static void geo_lat_lon_to_bng_run(void *data, u64 iters)
+{
+	struct geo_bench *gb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_geo_t geo = gb->points[gb->next];
+
+		ac_geo_lat_lon_to_bng(&geo);
+		bench_keep(geo.easting);
+		if (++gb->next == gb->nmemb)
+			gb->next = 0;
+	}
+}
+
+static void geo_kdtree_nearest_run(void *data, u64 iters)
+{
+	struct geo_bench *gb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_geo_t centre = gb->points[gb->next];
+		size_t idx;
+		double dist;
+
+		centre.lat += 0.01;
+		bench_keep(ac_geo_kdtree_nearest(gb->tree, &centre, 1, &idx,
+						 &dist));
+		if (++gb->next == gb->nmemb)
+			gb->next = 0;
+	}
+}
+
+static void geo_teardown(void *data)
+{
+	struct geo_bench *gb = data;
+
+	ac_geo_kdtree_destroy(gb->tree);
+	free(gb->points);
+	free(gb);
+}
+
+/*
+ * histogram
+ */
+
+struct histogram_bench {
+	ac_histogram_t *hist;
+	u64 values[4096];
+};
+
+static void *histogram_setup(size_t size)
+{
+	struct histogram_bench *hb = malloc(sizeof(struct histogram_bench));
+	size_t i;
+
+	hb->hist = ac_histogram_new(size, 7);
+	for (i = 0; i < AC_ARRAY_SIZE(hb->values); i++)
+		hb->values[i] = ac_rng_bounded(&bench_rng, size);
+
+	return hb;
+}
+
+static void histogram_record_run(void *data, u64 iters)
+{
+	struct histogram_bench *hb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		ac_histogram_record(hb->hist,
+				    hb->values[i & (AC_ARRAY_SIZE(hb->values) -
+						    1)]);
+}
+
+static void histogram_teardown(void *data)
+{
+	struct histogram_bench *hb = data;
+
+	ac_histogram_destroy(hb->hist);
+	free(hb);
+}
+
+/*
+ * htable
+ */
+
+struct htable_bench {
+	ac_htable_t *htable;
+	u32 *keys;
+	size_t nmemb;
+	size_t next;
+};
+
+static void *htable_setup(size_t size)
+{
+	struct htable_bench *hb = malloc(sizeof(struct htable_bench));
+	size_t i;
+
+	hb->htable = ac_htable_new(ac_hash_func_u32, ac_cmp_u32, NULL, NULL);
+	hb->keys = bench_keys(size);
+	hb->nmemb = size;
+	hb->next = 0;
+	for (i = 0; i < size; i++)
+		ac_htable_insert(hb->htable, &hb->keys[i], &hb->keys[i]);
+
+	return hb;
+}
+
+static void htable_lookup_run(void *data, u64 iters)
+{
+	struct htable_bench *hb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		bench_keep(ac_htable_lookup(hb->htable, &hb->keys[hb->next]));
+		if (++hb->next == hb->nmemb)
+			hb->next = 0;
+	}
+}
+
+static void htable_lookup_miss_run(void *data, u64 iters)
+{
+	struct htable_bench *hb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		/* The keys are all multiples of an odd number... */
+		u32 key = hb->keys[hb->next] + 1;
+
+		bench_keep(ac_htable_lookup(hb->htable, &key));
+		if (++hb->next == hb->nmemb)
+			hb->next = 0;
+	}
+}
+
+static void htable_remove_insert_run(void *data, u64 iters)
+{
+	struct htable_bench *hb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		u32 *key = &hb->keys[hb->next];
+
+		ac_htable_remove(hb->htable, key);
+		ac_htable_insert(hb->htable, key, key);
+		if (++hb->next == hb->nmemb)
+			hb->next = 0;
+	}
+}
+
+static void htable_teardown(void *data)
+{
+	struct htable_bench *hb = data;
+
+	ac_htable_destroy(hb->htable);
+	free(hb->keys);
+	free(hb);
+}
+
+/*
+ * jsonw
+ */
+
+static size_t jsonw_nr_fields;
+
+static void jsonw_build(ac_jsonw_t *json, size_t nr_fields)
+{
+	size_t i;
+
+	ac_jsonw_add_array(json, "items");
+	for (i = 0; i < nr_fields; i++) {
+		ac_jsonw_add_object(json, NULL);
+		ac_jsonw_add_int(json, "id", i);
+		ac_jsonw_add_str(json, "name", "a \"quoted\" name\twith tab");
+		ac_jsonw_add_real(json, "value", i * 1.5, 3);
+		ac_jsonw_add_bool(json, "ok", i & 1);
+		ac_jsonw_end_object(json);
+	}
+	ac_jsonw_end_array(json);
+	ac_jsonw_end(json);
+}
+
+static void *jsonw_setup(size_t size)
+{
+	ac_jsonw_t *json = ac_jsonw_init();
+
+	jsonw_nr_fields = size;
+	jsonw_build(json, size);
+	bench_bytes = ac_jsonw_len(json);
+	ac_jsonw_free(json);
+
+	return NULL;
+}
+
+static void jsonw_build_run(void *data __always_unused, u64 iters)
+{
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_jsonw_t *json = ac_jsonw_init();
+
+		jsonw_build(json, jsonw_nr_fields);
+		bench_keep(ac_jsonw_get(json));
+		ac_jsonw_free(json);
+	}
+}
+
+/* A string of size bytes with something to escape about every 128 */
+static void *jsonw_str_setup(size_t size)
+{
+	char *str = malloc(size + 1);
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		str[i] = (i % 128 == 127) ? '"' : 'a' + i % 26;
+	str[size] = '\0';
+	bench_bytes = size;
+
+	return str;
+}
+
+static void jsonw_add_str_run(void *data, u64 iters)
+{
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_jsonw_t *json = ac_jsonw_init();
+
+		ac_jsonw_add_str(json, "str", data);
+		bench_keep(ac_jsonw_get(json));
+		ac_jsonw_free(json);
+	}
+}
+
+static void *jsonw_arena_setup(size_t size)
+{
+	jsonw_setup(size);
+
+	return ac_arena_new(0);
+}
+
+static void jsonw_build_arena_run(void *data, u64 iters)
+{
+	ac_arena_t *arena = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_jsonw_t *json = ac_jsonw_init_arena(arena);
+
+		jsonw_build(json, jsonw_nr_fields);
+		bench_keep(ac_jsonw_get(json));
+		ac_arena_reset(arena);
+	}
+}
+
+static void jsonw_arena_teardown(void *data)
+{
+	ac_arena_destroy(data);
+}
+
+/*
+ * list & slist
+ */
+
+struct list_bench {
+	size_t nmemb;
+	size_t count;
+	ac_list_t *list;
+	ac_slist_t *slist;
+};
+
+static void *list_setup(size_t size)
+{
+	struct list_bench *lb = calloc(1, sizeof(struct list_bench));
+
+	lb->nmemb = size;
+
+	return lb;
+}
+
+static void list_preadd_destroy_run(void *data, u64 iters)
+{
+	struct list_bench *lb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_list_preadd(&lb->list, lb);
+		if (++lb->count == lb->nmemb) {
+			ac_list_destroy(&lb->list, NULL);
+			lb->count = 0;
+		}
+	}
+}
+
+static void slist_preadd_destroy_run(void *data, u64 iters)
+{
+	struct list_bench *lb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_slist_preadd(&lb->slist, lb);
+		if (++lb->count == lb->nmemb) {
+			ac_slist_destroy(&lb->slist, NULL);
+			lb->count = 0;
+		}
+	}
+}
+
+static void list_teardown(void *data)
+{
+	struct list_bench *lb = data;
+
+	ac_list_destroy(&lb->list, NULL);
+	ac_slist_destroy(&lb->slist, NULL);
+	free(lb);
+}
+
+/*
+ * misc
+ */
+
+struct misc_bench {
+	u64 *values;
+	char **strs;
+	size_t nmemb;
+	size_t next;
+};
+
+static void *misc_setup(size_t size)
+{
+	struct misc_bench *mb = malloc(sizeof(struct misc_bench));
+	size_t i;
+
+	mb->values = malloc(size * sizeof(u64));
+	mb->strs = malloc(size * sizeof(char *));
+	mb->nmemb = size;
+	mb->next = 0;
+	for (i = 0; i < size; i++) {
+		mb->values[i] = ac_rng_u64(&bench_rng) >>
+				ac_rng_bounded(&bench_rng, 64);
+		/* 16 digit card style numbers */
+		mb->strs[i] = malloc(17);
+		snprintf(mb->strs[i], 17, "%016llu",
+			 (unsigned long long)(ac_rng_u64(&bench_rng) %
+					      10000000000000000ULL));
+	}
+
+	return mb;
+}
+
+static void misc_ppb_str_run(void *data, u64 iters)
+{
+	struct misc_bench *mb = data;
+	char buf[AC_MISC_PPB_STR_LEN + 1];
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		bench_keep(ac_misc_ppb_str(mb->values[mb->next],
+					   AC_SI_UNITS_NO, buf));
+		if (++mb->next == mb->nmemb)
+			mb->next = 0;
+	}
+}
+
+static void misc_luhn_check_str_run(void *data, u64 iters)
+{
+	struct misc_bench *mb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		bench_keep(ac_misc_luhn_check_str(mb->strs[mb->next], 16));
+		if (++mb->next == mb->nmemb)
+			mb->next = 0;
+	}
+}
+
+static void misc_teardown(void *data)
+{
+	struct misc_bench *mb = data;
+	size_t i;
+
+	for (i = 0; i < mb->nmemb; i++)
+		free(mb->strs[i]);
+	free(mb->strs);
+	free(mb->values);
+	free(mb);
+}
+
+static void misc_gen_uuid4_run(void *data __always_unused, u64 iters)
+{
+	char uuid[AC_UUID4_LEN + 1];
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_misc_gen_uuid4(uuid));
+}
+
+static void misc_gen_uuid7_run(void *data __always_unused, u64 iters)
+{
+	char uuid[AC_UUID7_LEN + 1];
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_misc_gen_uuid7(uuid));
+}
+
+struct shuffle_bench {
+	u32 *array;
+	size_t nmemb;
+};
+
+static void *shuffle_setup(size_t size)
+{
+	struct shuffle_bench *sb = malloc(sizeof(struct shuffle_bench));
+
+	sb->array = bench_keys(size);
+	sb->nmemb = size;
+	bench_bytes = size * sizeof(u32);
+
+	return sb;
+}
+
+static void misc_shuffle_fy_run(void *data, u64 iters)
+{
+	struct shuffle_bench *sb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		ac_misc_shuffle(sb->array, sb->nmemb, sizeof(u32),
+				AC_MISC_SHUFFLE_FISHER_YATES);
+}
+
+static void misc_shuffle_bucketed_run(void *data, u64 iters)
+{
+	struct shuffle_bench *sb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		ac_misc_shuffle(sb->array, sb->nmemb, sizeof(u32),
+				AC_MISC_SHUFFLE_BUCKETED);
+}
+
+static void shuffle_teardown(void *data)
+{
+	struct shuffle_bench *sb = data;
+
+	free(sb->array);
+	free(sb);
+}
+
+static void misc_hash_func_str_run(void *data, u64 iters)
+{
+	struct misc_bench *mb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		bench_keep(ac_hash_func_str(mb->strs[mb->next]));
+		if (++mb->next == mb->nmemb)
+			mb->next = 0;
+	}
+}
+
+/*
+ * net
+ */
+
+static void net_ipv4_isin_run(void *data __always_unused, u64 iters)
+{
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_net_ipv4_isin("192.168.1.0", 24,
+					    "192.168.1.202"));
+}
+
+static void net_ipv6_isin_run(void *data __always_unused, u64 iters)
+{
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_net_ipv6_isin("2001:db8:dead:beef::", 64,
+					    "2001:db8:dead:beef::1:2"));
+}
+
+/*
+ * pool
+ */
+
+struct pool_bench {
+	ac_pool_t *pool;
+	void **objs;
+	size_t nmemb;
+	size_t next;
+};
+
+static void *pool_setup(size_t size)
+{
+	struct pool_bench *pb = malloc(sizeof(struct pool_bench));
+	size_t i;
+
+	pb->pool = ac_pool_new(64, 0);
+	pb->objs = malloc(size * sizeof(void *));
+	pb->nmemb = size;
+	pb->next = 0;
+	for (i = 0; i < size; i++)
+		pb->objs[i] = ac_pool_alloc(pb->pool);
+
+	return pb;
+}
+
+static void pool_alloc_free_run(void *data, u64 iters)
+{
+	struct pool_bench *pb = data;
+	u64 i;
+
+	/* Keep size objects outstanding, freeing the oldest each time */
+	for (i = 0; i < iters; i++) {
+		ac_pool_free(pb->pool, pb->objs[pb->next]);
+		pb->objs[pb->next] = ac_pool_alloc(pb->pool);
+		if (++pb->next == pb->nmemb)
+			pb->next = 0;
+	}
+}
+
+static void pool_teardown(void *data)
+{
+	struct pool_bench *pb = data;
+
+	ac_pool_destroy(pb->pool);
+	free(pb->objs);
+	free(pb);
+}
+
+static void *malloc_setup(size_t size)
+{
+	struct pool_bench *pb = malloc(sizeof(struct pool_bench));
+	size_t i;
+
+	pb->pool = NULL;
+	pb->objs = malloc(size * sizeof(void *));
+	pb->nmemb = size;
+	pb->next = 0;
+	for (i = 0; i < size; i++)
+		pb->objs[i] = malloc(64);
+
+	return pb;
+}
+
+/* The baseline for pool/alloc_free */
+static void malloc_free_run(void *data, u64 iters)
+{
+	struct pool_bench *pb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		free(pb->objs[pb->next]);
+		pb->objs[pb->next] = malloc(64);
+		bench_keep(pb->objs[pb->next]);
+		if (++pb->next == pb->nmemb)
+			pb->next = 0;
+	}
+}
+
+static void malloc_teardown(void *data)
+{
+	struct pool_bench *pb = data;
+	size_t i;
+
+	for (i = 0; i < pb->nmemb; i++)
+		free(pb->objs[i]);
+	free(pb->objs);
+	free(pb);
+}
+
+/*
+ * quark
+ */
+
+struct quark_bench {
+	ac_quark_t quark;
+	char **strs;
+	size_t nmemb;
+	size_t next;
+};
+
+static void *quark_setup(size_t size)
+{
+	struct quark_bench *qb = malloc(sizeof(struct quark_bench));
+	size_t i;
+
+	ac_quark_init(&qb->quark, NULL);
+	qb->strs = malloc(size * sizeof(char *));
+	qb->nmemb = size;
+	qb->next = 0;
+	for (i = 0; i < size; i++) {
+		qb->strs[i] = malloc(32);
+		snprintf(qb->strs[i], 32, "quark-%zu", i);
+		ac_quark_from_string(&qb->quark, qb->strs[i]);
+	}
+
+	return qb;
+}
+
+static void quark_from_string_run(void *data, u64 iters)
+{
+	struct quark_bench *qb = data;
+	u64 i;
+
+	/* All the strings exist, so this is the lookup path */
+	for (i = 0; i < iters; i++) {
+		bench_keep(ac_quark_from_string(&qb->quark,
+						qb->strs[qb->next]));
+		if (++qb->next == qb->nmemb)
+			qb->next = 0;
+	}
+}
+
+static void quark_teardown(void *data)
+{
+	struct quark_bench *qb = data;
+	size_t i;
+
+	ac_quark_destroy(&qb->quark);
+	for (i = 0; i < qb->nmemb; i++)
+		free(qb->strs[i]);
+	free(qb->strs);
+	free(qb);
+}
+
+/*
+ * queue
+ */
+
+static void *queue_setup(size_t size)
+{
+	ac_queue_t *queue = ac_queue_new();
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		ac_queue_push(queue, queue);
+
+	return queue;
+}
+
+static void queue_push_pop_run(void *data, u64 iters)
+{
+	ac_queue_t *queue = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_queue_push(queue, queue);
+		bench_keep(ac_queue_pop(queue));
+	}
+}
+
+static void queue_teardown(void *data)
+{
+	ac_queue_destroy(data, NULL);
+}
+
+/*
+ * ratelimit
+ */
+
+struct ratelimit_bench {
+	ac_ratelimit_tb_t tb;
+	ac_ratelimit_gcra_t gcra;
+	ac_ratelimit_sw_t sw;
+	ac_ratelimit_keyed_t *kl;
+	u32 *keys;
+	size_t nmemb;
+	size_t next;
+	u64 now;
+};
+
+static void *ratelimit_setup(size_t size)
+{
+	struct ratelimit_bench *rb = malloc(sizeof(struct ratelimit_bench));
+
+	/* 1000/s with a burst of 100, about half get through at 2000/s */
+	ac_ratelimit_tb_init(&rb->tb, 1000, AC_TIME_NS_SEC, 100);
+	ac_ratelimit_gcra_init(&rb->gcra, 1000, AC_TIME_NS_SEC, 100);
+	ac_ratelimit_sw_init(&rb->sw, 1000, AC_TIME_NS_SEC);
+	rb->kl = ac_ratelimit_keyed_new(size, 1000, AC_TIME_NS_SEC, 100);
+	rb->keys = bench_keys(size);
+	rb->nmemb = size;
+	rb->next = 0;
+	rb->now = AC_TIME_NS_SEC;
+
+	return rb;
+}
+
+static void ratelimit_tb_run(void *data, u64 iters)
+{
+	struct ratelimit_bench *rb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		rb->now += 500 * AC_TIME_NS_USEC;
+		bench_keep(ac_ratelimit_tb_allow(&rb->tb, 1, rb->now));
+	}
+}
+
+static void ratelimit_gcra_run(void *data, u64 iters)
+{
+	struct ratelimit_bench *rb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		u64 retry;
+
+		rb->now += 500 * AC_TIME_NS_USEC;
+		bench_keep(ac_ratelimit_gcra_allow(&rb->gcra, 1, rb->now,
+						   &retry));
+	}
+}
+
+static void ratelimit_sw_run(void *data, u64 iters)
+{
+	struct ratelimit_bench *rb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		rb->now += 500 * AC_TIME_NS_USEC;
+		bench_keep(ac_ratelimit_sw_allow(&rb->sw, 1, rb->now));
+	}
+}
+
+static void ratelimit_keyed_run(void *data, u64 iters)
+{
+	struct ratelimit_bench *rb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		u64 retry;
+
+		rb->now += AC_TIME_NS_USEC;
+		bench_keep(ac_ratelimit_keyed_allow(rb->kl,
+						    &rb->keys[rb->next],
+						    sizeof(u32), 1, rb->now,
+						    &retry));
+		if (++rb->next == rb->nmemb)
+			rb->next = 0;
+	}
+}
+
+static void ratelimit_teardown(void *data)
+{
+	struct ratelimit_bench *rb = data;
+
+	ac_ratelimit_keyed_destroy(rb->kl);
+	free(rb->keys);
+	free(rb);
+}
+
+/*
+ * rng
+ */
+
+struct rng_bench {
+	ac_rng_t rng;
+	size_t size;
+	u8 *buf;
+};
+
+static void *rng_setup(size_t size)
+{
+	struct rng_bench *rb = malloc(sizeof(struct rng_bench));
+
+	rb->size = size;
+	rb->buf = malloc(size);
+
+	return rb;
+}
+
+static void *rng_xoshiro_setup(size_t size)
+{
+	struct rng_bench *rb = rng_setup(size);
+
+	ac_rng_seed(&rb->rng, AC_RNG_XOSHIRO256SS, 42);
+
+	return rb;
+}
+
+static void *rng_pcg32_setup(size_t size)
+{
+	struct rng_bench *rb = rng_setup(size);
+
+	ac_rng_seed(&rb->rng, AC_RNG_PCG32, 42);
+
+	return rb;
+}
+
+static void *rng_fill_setup(size_t size)
+{
+	bench_bytes = size;
+
+	return rng_xoshiro_setup(size);
+}
+
+static void rng_u64_run(void *data, u64 iters)
+{
+	struct rng_bench *rb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_rng_u64(&rb->rng));
+}
+
+static void rng_u32_run(void *data, u64 iters)
+{
+	struct rng_bench *rb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_rng_u32(&rb->rng));
+}
+
+static void rng_bounded_run(void *data, u64 iters)
+{
+	struct rng_bench *rb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_rng_bounded(&rb->rng, 1000));
+}
+
+static void rng_fill_run(void *data, u64 iters)
+{
+	struct rng_bench *rb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ac_rng_fill(&rb->rng, rb->buf, rb->size);
+		bench_keep(rb->buf);
+	}
+}
+
+static void rng_teardown(void *data)
+{
+	struct rng_bench *rb = data;
+
+	free(rb->buf);
+	free(rb);
+}
+
+/*
+ * str
+ */
+
+struct str_bench {
+	char *string;
+	char *other;
+	ac_arena_t *arena;
+};
+
+static void *str_setup(size_t size)
+{
+	struct str_bench *sb = malloc(sizeof(struct str_bench));
+	size_t len = size * 8;
+	size_t i;
+
+	/* size comma separated fields of 7 characters */
+	sb->string = malloc(len);
+	for (i = 0; i < len; i++)
+		sb->string[i] = (i & 7) == 7 ? ',' :
+				'a' + ac_rng_bounded(&bench_rng, 26);
+	sb->string[len - 1] = '\0';
+	sb->other = NULL;
+	sb->arena = ac_arena_new(0);
+	bench_bytes = len;
+
+	return sb;
+}
+
+static void *str_levenshtein_setup(size_t size)
+{
+	struct str_bench *sb = malloc(sizeof(struct str_bench));
+	size_t i;
+
+	sb->string = malloc(size + 1);
+	sb->other = malloc(size + 1);
+	for (i = 0; i < size; i++) {
+		sb->string[i] = 'a' + ac_rng_bounded(&bench_rng, 4);
+		sb->other[i] = 'a' + ac_rng_bounded(&bench_rng, 4);
+	}
+	sb->string[size] = sb->other[size] = '\0';
+	sb->arena = NULL;
+
+	return sb;
+}
+
+static void str_split_run(void *data, u64 iters)
+{
+	struct str_bench *sb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		char **fields = ac_str_split(sb->string, ',', 0);
+
+		bench_keep(fields);
+		ac_str_freev(fields);
+	}
+}
+
+static void str_split_arena_run(void *data, u64 iters)
+{
+	struct str_bench *sb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		bench_keep(ac_str_split_arena(sb->arena, sb->string, ',', 0));
+		ac_arena_reset(sb->arena);
+	}
+}
+
+static void str_levenshtein_run(void *data, u64 iters)
+{
+	struct str_bench *sb = data;
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_str_levenshtein(sb->string, sb->other));
+}
+
+static void str_teardown(void *data)
+{
+	struct str_bench *sb = data;
+
+	ac_arena_destroy(sb->arena);
+	free(sb->string);
+	free(sb->other);
+	free(sb);
+}
+
+/*
+ * time
+ */
+
+static void time_clock_ns_run(void *data __always_unused, u64 iters)
+{
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_time_clock_ns());
+}
+
+static void time_clock_cycles_run(void *data __always_unused, u64 iters)
+{
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_time_clock_cycles());
+}
+
+static void time_coarse_ns_run(void *data __always_unused, u64 iters)
+{
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bench_keep(ac_time_coarse_ns());
+}
+
+static void time_fmt_rfc3339_run(void *data __always_unused, u64 iters)
+{
+	struct timespec ts = { 1650000000, 123456789 };
+	char buf[AC_TIME_RFC3339_LEN + 1];
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		ts.tv_sec += 61;
+		bench_keep(ac_time_fmt_rfc3339(buf, &ts, 9));
+	}
+}
+
+static void time_parse_rfc3339_run(void *data __always_unused, u64 iters)
+{
+	static const char ts_str[] = "2022-04-15T05:20:00.123456789+01:00";
+	struct timespec ts = { 0 };
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		bench_keep(ac_time_parse_rfc3339(ts_str, sizeof(ts_str) - 1,
+						 &ts));
+		bench_keep(ts.tv_sec);
+	}
+}
+
+static const struct bench benchmarks[] = {
+	{ "arena", "alloc_reset", 16,
+	  arena_setup, arena_alloc_run, arena_teardown },
+	{ "arena", "alloc_reset", 256,
+	  arena_setup, arena_alloc_run, arena_teardown },
+
+	{ "btree", "lookup", 1024,
+	  btree_setup, btree_lookup_run, btree_teardown },
+	{ "btree", "lookup", 65536,
+	  btree_setup, btree_lookup_run, btree_teardown },
+	{ "btree", "remove_add", 1024,
+	  btree_setup, btree_remove_add_run, btree_teardown },
+	{ "btree", "remove_add", 65536,
+	  btree_setup, btree_remove_add_run, btree_teardown },
+
+	{ "circ_buf", "push_pop", 64,
+	  circ_buf_setup, circ_buf_push_pop_run, circ_buf_teardown },
+	{ "circ_buf", "push_pop", 65536,
+	  circ_buf_setup, circ_buf_push_pop_run, circ_buf_teardown },
+
+	{ "geo", "haversine", 1024,
+	  geo_setup, geo_haversine_run, geo_teardown },
+	{ "geo", "geohash_encode", 1024,
+	  geo_setup, geo_geohash_encode_run, geo_teardown },
+	{ "geo", "lat_lon_to_bng", 1024,
+	  geo_setup, geo_lat_lon_to_bng_run, geo_teardown },
+	{ "geo", "kdtree_nearest", 1024,
+	  geo_kdtree_setup, geo_kdtree_nearest_run, geo_teardown },
+	{ "geo", "kdtree_nearest", 65536,
+	  geo_kdtree_setup, geo_kdtree_nearest_run, geo_teardown },
+
+	{ "histogram", "record", 1000000,
+	  histogram_setup, histogram_record_run, histogram_teardown },
+
+	{ "htable", "lookup", 1024,
+	  htable_setup, htable_lookup_run, htable_teardown },
+	{ "htable", "lookup", 65536,
+	  htable_setup, htable_lookup_run, htable_teardown },
+	{ "htable", "lookup", 16384,
+	  htable_setup, htable_lookup_run, htable_teardown },
+	{ "htable", "lookup_miss", 65536,
+	  htable_setup, htable_lookup_miss_run, htable_teardown },
+	{ "htable", "remove_insert", 1024,
+	  htable_setup, htable_remove_insert_run, htable_teardown },
+	{ "htable", "remove_insert", 65536,
+	  htable_setup, htable_remove_insert_run, htable_teardown },
+
+	{ "jsonw", "build", 16,
+	  jsonw_setup, jsonw_build_run, NULL },
+	{ "jsonw", "build", 1024,
+	  jsonw_setup, jsonw_build_run, NULL },
+	{ "jsonw", "build_arena", 1024,
+	  jsonw_arena_setup, jsonw_build_arena_run, jsonw_arena_teardown },
+	{ "jsonw", "add_str", 64,
+	  jsonw_str_setup, jsonw_add_str_run, free },
+	{ "jsonw", "add_str", 4096,
+	  jsonw_str_setup, jsonw_add_str_run, free },
+
+	{ "list", "preadd_destroy", 16,
+	  list_setup, list_preadd_destroy_run, list_teardown },
+	{ "list", "preadd_destroy", 4096,
+	  list_setup, list_preadd_destroy_run, list_teardown },
+	{ "slist", "preadd_destroy", 16,
+	  list_setup, slist_preadd_destroy_run, list_teardown },
+	{ "slist", "preadd_destroy", 4096,
+	  list_setup, slist_preadd_destroy_run, list_teardown },
+
+	{ "misc", "ppb_str", 1024,
+	  misc_setup, misc_ppb_str_run, misc_teardown },
+	{ "misc", "luhn_check_str", 1024,
+	  misc_setup, misc_luhn_check_str_run, misc_teardown },
+	{ "misc", "hash_func_str", 1024,
+	  misc_setup, misc_hash_func_str_run, misc_teardown },
+	{ "misc", "gen_uuid4", 1,
+	  NULL, misc_gen_uuid4_run, NULL },
+	{ "misc", "gen_uuid7", 1,
+	  NULL, misc_gen_uuid7_run, NULL },
+	{ "misc", "shuffle_fisher_yates", 1024,
+	  shuffle_setup, misc_shuffle_fy_run, shuffle_teardown },
+	{ "misc", "shuffle_fisher_yates", 1048576,
+	  shuffle_setup, misc_shuffle_fy_run, shuffle_teardown },
+	{ "misc", "shuffle_bucketed", 1024,
+	  shuffle_setup, misc_shuffle_bucketed_run, shuffle_teardown },
+	{ "misc", "shuffle_bucketed", 1048576,
+	  shuffle_setup, misc_shuffle_bucketed_run, shuffle_teardown },
+
+	{ "net", "ipv4_isin", 1,
+	  NULL, net_ipv4_isin_run, NULL },
+	{ "net", "ipv6_isin", 1,
+	  NULL, net_ipv6_isin_run, NULL },
+
+	{ "pool", "alloc_free", 16,
+	  pool_setup, pool_alloc_free_run, pool_teardown },
+	{ "pool", "alloc_free", 65536,
+	  pool_setup, pool_alloc_free_run, pool_teardown },
+	{ "pool", "malloc_free", 16,
+	  malloc_setup, malloc_free_run, malloc_teardown },
+	{ "pool", "malloc_free", 65536,
+	  malloc_setup, malloc_free_run, malloc_teardown },
+
+	{ "quark", "from_string", 1024,
+	  quark_setup, quark_from_string_run, quark_teardown },
+	{ "quark", "from_string", 65536,
+	  quark_setup, quark_from_string_run, quark_teardown },
+
+	{ "queue", "push_pop", 1,
+	  queue_setup, queue_push_pop_run, queue_teardown },
+	{ "queue", "push_pop", 4096,
+	  queue_setup, queue_push_pop_run, queue_teardown },
+
+	{ "ratelimit", "tb_allow", 1,
+	  ratelimit_setup, ratelimit_tb_run, ratelimit_teardown },
+	{ "ratelimit", "gcra_allow", 1,
+	  ratelimit_setup, ratelimit_gcra_run, ratelimit_teardown },
+	{ "ratelimit", "sw_allow", 1,
+	  ratelimit_setup, ratelimit_sw_run, ratelimit_teardown },
+	{ "ratelimit", "keyed_allow", 1024,
+	  ratelimit_setup, ratelimit_keyed_run, ratelimit_teardown },
+	{ "ratelimit", "keyed_allow", 65536,
+	  ratelimit_setup, ratelimit_keyed_run, ratelimit_teardown },
+
+	{ "rng", "xoshiro256ss_u64", 1,
+	  rng_xoshiro_setup, rng_u64_run, rng_teardown },
+	{ "rng", "pcg32_u32", 1,
+	  rng_pcg32_setup, rng_u32_run, rng_teardown },
+	{ "rng", "bounded", 1,
+	  rng_xoshiro_setup, rng_bounded_run, rng_teardown },
+	{ "rng", "fill", 4096,
+	  rng_fill_setup, rng_fill_run, rng_teardown },
+
+	{ "str", "split", 16,
+	  str_setup, str_split_run, str_teardown },
+	{ "str", "split", 1024,
+	  str_setup, str_split_run, str_teardown },
+	{ "str", "split_arena", 16,
+	  str_setup, str_split_arena_run, str_teardown },
+	{ "str", "split_arena", 1024,
+	  str_setup, str_split_arena_run, str_teardown },
+	{ "str", "levenshtein", 16,
+	  str_levenshtein_setup, str_levenshtein_run, str_teardown },
+	{ "str", "levenshtein", 256,
+	  str_levenshtein_setup, str_levenshtein_run, str_teardown },
+
+	{ "time", "clock_ns", 1,
+	  NULL, time_clock_ns_run, NULL },
+	{ "time", "clock_cycles", 1,
+	  NULL, time_clock_cycles_run, NULL },
+	{ "time", "coarse_ns", 1,
+	  NULL, time_coarse_ns_run, NULL },
+	{ "time", "fmt_rfc3339", 1,
+	  NULL, time_fmt_rfc3339_run, NULL },
+	{ "time", "parse_rfc3339", 1,
+	  NULL, time_parse_rfc3339_run, NULL },
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+	const double d1 = *(const double *)a;
+	const double d2 = *(const double *)b;
+
+	return (d1 > d2) - (d1 < d2);
+}
+
+static u64 bench_time(const struct bench *b, void *data, u64 iters)
+{
+	u64 start = ac_time_clock_ns();
+
+	b->run(data, iters);
+
+	return ac_time_clock_ns() - start;
+}
+
+/*
+ * Find an iteration count that takes at least min_ns, do a warmup
+ * repetition then time reps repetitions.
+ */
+static void bench_run(const struct bench *b, int reps, u64 min_ns,
+		      ac_perf_t *perf, struct bench_result *res)
+{
+	ac_perf_stats_t stats;
+	double *samples = malloc(reps * sizeof(double));
+	void *data;
+	u64 iters = 1;
+	double sum = 0.0;
+	int region = -1;
+	int i;
+
+	bench_bytes = 0;
+	data = b->setup ? b->setup(b->size) : NULL;
+
+	for (;;) {
+		u64 ns = bench_time(b, data, iters);
+
+		if (ns >= min_ns)
+			break;
+		if (ns < min_ns / 100)
+			iters *= 10;
+		else
+			iters = iters * 1.2 * min_ns / ns + 1;
+	}
+
+	bench_time(b, data, iters);
+
+	if (perf) {
+		char name[64];
+
+		snprintf(name, sizeof(name), "%s/%s/%zu", b->module, b->name,
+			 b->size);
+		region = ac_perf_region(perf, name);
+	}
+	for (i = 0; i < reps; i++) {
+		u64 ns;
+
+		if (perf)
+			ac_perf_start(perf, region);
+		ns = bench_time(b, data, iters);
+		if (perf)
+			ac_perf_stop(perf, region);
+
+		samples[i] = (double)ns / iters;
+		sum += samples[i];
+	}
+
+	if (b->teardown)
+		b->teardown(data);
+
+	qsort(samples, reps, sizeof(double), cmp_double);
+	res->iters = iters;
+	res->min = samples[0];
+	if (reps & 1)
+		res->median = samples[reps / 2];
+	else
+		res->median = (samples[reps / 2 - 1] + samples[reps / 2]) / 2;
+	/* Nearest rank */
+	res->p99 = samples[(int)ceil(0.99 * reps) - 1];
+	res->mean = sum / reps;
+	res->ops_sec = res->median > 0.0 ? 1e9 / res->median : 0.0;
+	res->mb_sec = res->median > 0.0 ?
+		      bench_bytes * 1e9 / res->median / (1024 * 1024) : 0.0;
+
+	res->have_counters = false;
+	if (perf && ac_perf_stats(perf, region, &stats) == 0 &&
+	    stats.counted) {
+		res->have_counters = true;
+		for (i = 0; i < AC_PERF_NR_COUNTERS; i++)
+			res->counters[i] = (double)stats.counters[i] /
+					   ((double)iters * stats.counted);
+	}
+
+	free(samples);
+}
+
+static void json_add_header(ac_jsonw_t *json, int reps, int min_ms)
+{
+	char ts_str[AC_TIME_RFC3339_LEN + 1];
+	struct timespec ts;
+	struct utsname un;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ac_time_fmt_rfc3339(ts_str, &ts, 0);
+	uname(&un);
+
+	ac_jsonw_add_int(json, "version", BENCH_JSON_VERSION);
+	ac_jsonw_add_str(json, "timestamp", ts_str);
+	ac_jsonw_add_object(json, "host");
+	ac_jsonw_add_str(json, "nodename", un.nodename);
+	ac_jsonw_add_str(json, "sysname", un.sysname);
+	ac_jsonw_add_str(json, "release", un.release);
+	ac_jsonw_add_str(json, "machine", un.machine);
+	ac_jsonw_add_int(json, "nr_cpus", sysconf(_SC_NPROCESSORS_ONLN));
+	ac_jsonw_end_object(json);
+	ac_jsonw_add_int(json, "repetitions", reps);
+	ac_jsonw_add_int(json, "min_time_ms", min_ms);
+	ac_jsonw_add_array(json, "benchmarks");
+}
+
+static void json_add_result(ac_jsonw_t *json, const struct bench *b,
+			    const struct bench_result *res)
+{
+	int i;
+
+	ac_jsonw_add_object(json, NULL);
+	ac_jsonw_add_str(json, "module", b->module);
+	ac_jsonw_add_str(json, "name", b->name);
+	ac_jsonw_add_int(json, "size", b->size);
+	ac_jsonw_add_int(json, "iterations", res->iters);
+	ac_jsonw_add_object(json, "ns_per_op");
+	ac_jsonw_add_real(json, "median", res->median, 3);
+	ac_jsonw_add_real(json, "p99", res->p99, 3);
+	ac_jsonw_add_real(json, "min", res->min, 3);
+	ac_jsonw_add_real(json, "mean", res->mean, 3);
+	ac_jsonw_end_object(json);
+	ac_jsonw_add_real(json, "ops_per_sec", res->ops_sec, 1);
+	if (bench_bytes) {
+		ac_jsonw_add_int(json, "bytes_per_op", bench_bytes);
+		ac_jsonw_add_real(json, "mib_per_sec", res->mb_sec, 1);
+	}
+	if (res->have_counters) {
+		ac_jsonw_add_object(json, "counters_per_op");
+		for (i = 0; i < AC_PERF_NR_COUNTERS; i++)
+			ac_jsonw_add_real(json, bench_cnt_names[i],
+					  res->counters[i], 3);
+		ac_jsonw_end_object(json);
+	} else {
+		ac_jsonw_add_null(json, "counters_per_op");
+	}
+	ac_jsonw_end_object(json);
+}
+
+static int json_write(const ac_jsonw_t *json, const char *file)
+{
+	FILE *fp = fopen(file, "w");
+
+	if (!fp) {
+		perror(file);
+		return -1;
+	}
+	fprintf(fp, "%s\n", ac_jsonw_get(json));
+	fclose(fp);
+
+	return 0;
+}
+
+static void print_result(const struct bench *b,
+			 const struct bench_result *res)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "%s/%s/%zu", b->module, b->name,
+		 b->size);
+	printf("%-36s %12.2f %12.2f %12.2f %14.0f", name, res->median,
+	       res->p99, res->min, res->ops_sec);
+	if (res->have_counters)
+		printf(" %9.1f %9.1f %9.3f",
+		       res->counters[AC_PERF_CYCLES],
+		       res->counters[AC_PERF_INSTRUCTIONS],
+		       res->counters[AC_PERF_CACHE_MISSES]);
+	if (bench_bytes)
+		printf(" %10.1f MiB/s", res->mb_sec);
+	printf("\n");
+}
+
+static bool bench_match(const struct bench *b, const char *filter)
+{
+	char name[64];
+
+	if (!filter)
+		return true;
+
+	snprintf(name, sizeof(name), "%s/%s/%zu", b->module, b->name,
+		 b->size);
+
+	return strstr(name, filter);
+}
+
+static void usage(void)
+{
+	printf("Usage: bench [-f filter] [-r repetitions] [-t min_ms] "
+	       "[-j file] [-p] [-l] [-h]\n\n");
+	printf("  -f  Only run benchmarks whose module/name/size contains "
+	       "filter\n");
+	printf("  -r  Number of timed repetitions (default %d)\n",
+	       BENCH_REPS);
+	printf("  -t  Minimum time per repetition in milliseconds "
+	       "(default %d)\n", BENCH_MIN_MS);
+	printf("  -j  Write the results as JSON to file\n");
+	printf("  -p  Collect hardware performance counters\n");
+	printf("  -l  List the benchmarks\n");
+	printf("  -h  This help\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filter = NULL;
+	const char *json_file = NULL;
+	ac_jsonw_t *json = NULL;
+	ac_perf_t *perf = NULL;
+	bool counters = false;
+	bool list = false;
+	int reps = BENCH_REPS;
+	int min_ms = BENCH_MIN_MS;
+	int ret = EXIT_SUCCESS;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:r:t:j:plh")) != -1) {
+		switch (opt) {
+		case 'f':
+			filter = optarg;
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 't':
+			min_ms = atoi(optarg);
+			break;
+		case 'j':
+			json_file = optarg;
+			break;
+		case 'p':
+			counters = true;
+			break;
+		case 'l':
+			list = true;
+			break;
+		case 'h':
+			usage();
+			exit(EXIT_SUCCESS);
+		default:
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (reps < 1 || min_ms < 1) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if (list) {
+		for (i = 0; i < AC_ARRAY_SIZE(benchmarks); i++) {
+			if (bench_match(&benchmarks[i], filter))
+				printf("%s/%s/%zu\n", benchmarks[i].module,
+				       benchmarks[i].name,
+				       benchmarks[i].size);
+		}
+		exit(EXIT_SUCCESS);
+	}
+
+	if (counters && !ac_perf_available()) {
+		fprintf(stderr, "bench: Hardware performance counters not "
+				"available\n");
+		counters = false;
+	}
+	if (counters)
+		perf = ac_perf_new();
+
+	if (json_file) {
+		json = ac_jsonw_init();
+		json_add_header(json, reps, min_ms);
+	}
+
+	printf("%-36s %12s %12s %12s %14s", "benchmark", "median ns",
+	       "p99 ns", "min ns", "ops/s");
+	if (counters)
+		printf(" %9s %9s %9s", "cycles", "instrs", "cmisses");
+	printf("\n");
+
+	for (i = 0; i < AC_ARRAY_SIZE(benchmarks); i++) {
+		const struct bench *b = &benchmarks[i];
+		struct bench_result res;
+
+		if (!bench_match(b, filter))
+			continue;
+
+		/* The same data for every run of a given benchmark */
+		ac_rng_seed(&bench_rng, AC_RNG_XOSHIRO256SS, 0x1ac);
+
+		bench_run(b, reps, (u64)min_ms * AC_TIME_NS_MSEC, perf,
+			  &res);
+		print_result(b, &res);
+		if (json)
+			json_add_result(json, b, &res);
+		fflush(stdout);
+	}
+
+	ac_perf_destroy(perf);
+
+	if (json) {
+		ac_jsonw_end_array(json);
+		ac_jsonw_end(json);
+		if (json_write(json, json_file) == -1)
+			ret = EXIT_FAILURE;
+		ac_jsonw_free(json);
+	}
+
+	exit(ret);
+}
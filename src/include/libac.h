@@ -21,13 +21,14 @@
 #include <crypt.h>
 #endif
 #include <fcntl.h>
+#include <pthread.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define LIBAC_MAJOR_VERSION	 1
-#define LIBAC_MINOR_VERSION	 99
+#define LIBAC_MAJOR_VERSION	 2
+#define LIBAC_MINOR_VERSION	 0
 #define LIBAC_MICRO_VERSION	 0
 
 typedef uint64_t u64;
@@ -72,6 +73,8 @@ typedef struct crypt_data ac_crypt_data_t;
 #define AC_TIME_NS_MSEC		   1000000L
 #define AC_TIME_NS_USEC		      1000L
 
+#define AC_TIME_RFC3339_LEN	30
+
 #define AC_LONG_TO_PTR(x)	((void *)(long)x)
 #define AC_PTR_TO_LONG(p)	((long)p)
 
@@ -88,6 +91,11 @@ typedef struct crypt_data ac_crypt_data_t;
 #define AC_ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
 #define AC_UUID4_LEN		36
+#define AC_UUID7_LEN		36
+
+#define AC_MISC_PPB_STR_LEN	11
+
+#define AC_GEO_GEOHASH_MAX_LEN	12
 
 typedef enum {
 	AC_GEO_EREF_WGS84 = 0,
@@ -113,19 +121,56 @@ typedef enum {
 } ac_misc_ppb_factor_t;
 
 typedef enum {
-	AC_MISC_SHUFFLE_FISHER_YATES = 0
+	AC_MISC_SHUFFLE_FISHER_YATES = 0,
+	AC_MISC_SHUFFLE_BUCKETED
 } ac_misc_shuffle_t;
 
+typedef enum {
+	AC_PERF_CYCLES = 0,
+	AC_PERF_INSTRUCTIONS,
+	AC_PERF_CACHE_MISSES,
+	AC_PERF_BRANCH_MISSES,
+
+	AC_PERF_NR_COUNTERS
+} ac_perf_counter_t;
+
+typedef enum {
+	AC_RNG_XOSHIRO256SS = 0,
+	AC_RNG_PCG32
+} ac_rng_algo_t;
+
 typedef enum {
 	AC_SI_UNITS_NO = 0,
 	AC_SI_UNITS_YES
 } ac_si_units_t;
 
+typedef struct {
+	void *(*alloc)(size_t size, void *ctx);
+	void *(*realloc)(void *ptr, size_t old_size, size_t size, void *ctx);
+	void (*free)(void *ptr, size_t size, void *ctx);
+	void *ctx;
+} ac_allocator_t;
+
+typedef struct {
+	struct ac_arena_chunk *head;
+	struct ac_arena_chunk *cur;
+	size_t chunk_sz;
+} ac_arena_t;
+
+typedef struct {
+	struct ac_arena_chunk *chunk;
+	size_t used;
+} ac_arena_mark_t;
+
 typedef struct ac_btree {
 	void *rootp;
 
 	int (*compar)(const void *, const void *);
 	void (*free_node)(void *nodep);
+
+	pthread_rwlock_t *lock;
+
+	ac_allocator_t alloc;
 } ac_btree_t;
 
 typedef struct {
@@ -141,6 +186,10 @@ typedef struct {
 	u32 elem_sz;
 
 	int type;
+
+	pthread_mutex_t *lock;
+
+	ac_allocator_t alloc;
 } ac_circ_buf_t;
 
 typedef struct {
@@ -159,6 +208,24 @@ typedef struct {
 	double seconds;
 } ac_geo_dms_t;
 
+typedef struct {
+	double *coords;
+	size_t *idx;
+	size_t nmemb;
+} ac_geo_kdtree_t;
+
+typedef struct {
+	u64 *counts;
+	u32 nr_buckets;
+	int sub_bits;
+	u64 max_value;
+
+	u64 total;
+	u64 sum;
+	u64 min;
+	u64 max;
+} ac_histogram_t;
+
 typedef struct {
 	struct ac_slist **buckets;
 	unsigned long count;
@@ -167,6 +234,10 @@ typedef struct {
 	int (*key_cmp)(const void *a, const void *b);
 	void (*free_key_func)(void *ptr);
 	void (*free_data_func)(void *ptr);
+
+	pthread_rwlock_t *lock;
+
+	ac_allocator_t alloc;
 } ac_htable_t;
 
 typedef struct {
@@ -176,6 +247,8 @@ typedef struct {
 	u8 depth;
 	bool skip_tabs;
 	char *indenter;
+
+	ac_allocator_t alloc;
 } ac_jsonw_t;
 
 typedef struct ac_list {
@@ -195,20 +268,96 @@ typedef struct {
 	} value;
 } ac_misc_ppb_t;
 
+typedef struct ac_misc_passcrypt_pool ac_misc_passcrypt_pool_t;
+
+typedef struct ac_perf ac_perf_t;
+
+typedef struct {
+	u64 calls;
+	u64 ns;
+
+	/* The number of calls that have counter values */
+	u64 counted;
+	u64 counters[AC_PERF_NR_COUNTERS];
+} ac_perf_stats_t;
+
+typedef struct ac_pool ac_pool_t;
+
+typedef struct {
+	size_t obj_sz;
+	u32 nr_slabs;
+	u64 nr_objs;
+
+	u64 live;
+	u64 free;
+	u64 cached;
+
+	u64 allocs;
+	u64 frees;
+} ac_pool_stats_t;
+
 typedef struct {
 	struct ac_btree *qt;
 	void **quarks;
 	int last;
 
 	void (*free_func)(void *ptr);
+
+	pthread_rwlock_t *lock;
+
+	ac_allocator_t alloc;
 } ac_quark_t;
 
+typedef struct {
+	u64 zero_ns;
+	u64 ns_per_token;
+	u64 burst_ns;
+} ac_ratelimit_tb_t;
+
+typedef struct {
+	u64 tat;
+	u64 emission_ns;
+	u64 tolerance_ns;
+} ac_ratelimit_gcra_t;
+
+typedef struct {
+	u64 state;
+	u64 window_ns;
+	u32 limit;
+} ac_ratelimit_sw_t;
+
+typedef struct {
+	struct ac_ratelimit_slot *slots;
+	u32 *locks;
+	u32 nr_sets;
+	u64 seed;
+
+	u64 emission_ns;
+	u64 tolerance_ns;
+} ac_ratelimit_keyed_t;
+
+typedef struct {
+	ac_rng_algo_t algo;
+
+	union {
+		u64 xoshiro[4];
+		struct {
+			u64 state;
+			u64 inc;
+		} pcg;
+	} s;
+} ac_rng_t;
+
 typedef struct {
 	struct ac_slist *queue;
 	struct ac_slist *tail;
 	u32 items;
 
 	void (*free_func)(void *item);
+
+	pthread_mutex_t *lock;
+
+	ac_allocator_t alloc;
 } ac_queue_t;
 
 typedef struct ac_slist {
@@ -217,9 +366,31 @@ typedef struct ac_slist {
 	struct ac_slist *next;
 } ac_slist_t;
 
+typedef struct {
+	u64 next_ns;
+	u64 period_ns;
+} ac_time_period_t;
+
 #pragma GCC visibility push(default)
+extern ac_arena_t *ac_arena_new(size_t chunk_sz);
+extern void *ac_arena_alloc(ac_arena_t *arena, size_t size);
+extern void *ac_arena_alloc_aligned(ac_arena_t *arena, size_t size,
+				    size_t align);
+extern char *ac_arena_strdup(ac_arena_t *arena, const char *str);
+extern void ac_arena_allocator(ac_arena_t *arena, ac_allocator_t *alloc);
+extern ac_arena_mark_t ac_arena_mark(const ac_arena_t *arena);
+extern void ac_arena_rewind(ac_arena_t *arena, ac_arena_mark_t mark);
+extern void ac_arena_reset(ac_arena_t *arena);
+extern size_t ac_arena_size(const ac_arena_t *arena);
+extern void ac_arena_destroy(ac_arena_t *arena);
+
 extern void *ac_btree_new(int (*compar)(const void *, const void *),
 			  void (*free_node)(void *nodep));
+extern void *ac_btree_new_with_allocator(int (*compar)(const void *,
+						       const void *),
+					 void (*free_node)(void *nodep),
+					 const ac_allocator_t *alloc);
+extern int ac_btree_set_thread_safe(ac_btree_t *tree);
 extern void ac_btree_foreach(const ac_btree_t *tree,
 			     void (*action)(const void *nodep, VISIT which,
 					    int depth));
@@ -238,6 +409,9 @@ extern int ac_fs_mkdir_p(int dirfd, const char *path, mode_t mode);
 extern ssize_t ac_fs_copy(const char *from, const char *to, int flags);
 
 extern ac_circ_buf_t *ac_circ_buf_new(u32 size, u32 elem_sz);
+extern ac_circ_buf_t *ac_circ_buf_new_with_allocator(u32 size, u32 elem_sz,
+						     const ac_allocator_t *alloc);
+extern int ac_circ_buf_set_thread_safe(ac_circ_buf_t *cbuf);
 extern u32 ac_circ_buf_count(const ac_circ_buf_t *cbuf);
 extern int ac_circ_buf_pushm(ac_circ_buf_t *cbuf, const void *buf,
 			     u32 count);
@@ -252,16 +426,66 @@ extern void ac_circ_buf_destroy(const ac_circ_buf_t *cbuf);
 
 extern void ac_geo_dd_to_dms(double degrees, ac_geo_dms_t *dms);
 extern double ac_geo_dms_to_dd(const ac_geo_dms_t *dms);
+extern u64 ac_geo_morton_encode(const ac_geo_t *geo);
+extern void ac_geo_morton_decode(u64 code, ac_geo_t *geo);
+extern char *ac_geo_geohash_encode(const ac_geo_t *geo, int precision,
+				   char *dst);
+extern int ac_geo_geohash_decode(const char *hash, ac_geo_t *geo);
+extern int ac_geo_geohash_neighbours(const char *hash,
+				     char neighbours[8]
+						    [AC_GEO_GEOHASH_MAX_LEN + 1]);
 extern double ac_geo_haversine(const ac_geo_t *from, const ac_geo_t *to);
 extern void ac_geo_vincenty_direct(const ac_geo_t *from, ac_geo_t *to,
 				   double distance);
 extern void ac_geo_bng_to_lat_lon(ac_geo_t *geo);
+extern void ac_geo_bng_to_lat_lon_m(ac_geo_t *geo, size_t nmemb,
+				    unsigned int nr_threads);
 extern void ac_geo_lat_lon_to_bng(ac_geo_t *geo);
+extern void ac_geo_lat_lon_to_bng_m(ac_geo_t *geo, size_t nmemb,
+				    unsigned int nr_threads);
+extern ac_geo_kdtree_t *ac_geo_kdtree_new(const ac_geo_t *points,
+					  size_t nmemb);
+extern size_t ac_geo_kdtree_radius(const ac_geo_kdtree_t *tree,
+				   const ac_geo_t *centre, double radius,
+				   void (*action)(size_t idx, double distance,
+						  void *user_data),
+				   void *user_data);
+extern ssize_t ac_geo_kdtree_nearest(const ac_geo_kdtree_t *tree,
+				     const ac_geo_t *centre, size_t k,
+				     size_t *idx, double *distance);
+extern void ac_geo_kdtree_destroy(const ac_geo_kdtree_t *tree);
+
+extern ac_histogram_t *ac_histogram_new(u64 max_value, int sub_bits);
+extern void ac_histogram_record(ac_histogram_t *hist, u64 value);
+extern void ac_histogram_record_n(ac_histogram_t *hist, u64 value,
+				  u64 count);
+extern int ac_histogram_merge(ac_histogram_t *dst, const ac_histogram_t *src);
+extern u64 ac_histogram_percentile(const ac_histogram_t *hist,
+				   double percentile);
+extern void ac_histogram_foreach(const ac_histogram_t *hist,
+				 void (*action)(u64 low, u64 high, u64 count,
+						void *data),
+				 void *user_data);
+extern u64 ac_histogram_count(const ac_histogram_t *hist);
+extern u64 ac_histogram_min(const ac_histogram_t *hist);
+extern u64 ac_histogram_max(const ac_histogram_t *hist);
+extern double ac_histogram_mean(const ac_histogram_t *hist);
+extern void ac_histogram_to_json(const ac_histogram_t *hist, ac_jsonw_t *json,
+				 const char *name);
+extern void ac_histogram_reset(ac_histogram_t *hist);
+extern void ac_histogram_destroy(ac_histogram_t *hist);
 
 extern ac_htable_t *ac_htable_new(u32 (*hash_func)(const void *key),
 				  int (*key_cmp)(const void *a, const void *b),
 				  void (*free_key_func)(void *key),
 				  void (*free_data_func)(void *data));
+extern ac_htable_t *ac_htable_new_with_allocator(
+				u32 (*hash_func)(const void *key),
+				int (*key_cmp)(const void *a, const void *b),
+				void (*free_key_func)(void *key),
+				void (*free_data_func)(void *data),
+				const ac_allocator_t *alloc);
+extern int ac_htable_set_thread_safe(ac_htable_t *htable);
 extern void ac_htable_insert(ac_htable_t *htable, void *key, void *data);
 extern bool ac_htable_remove(ac_htable_t *htable, const void *key);
 extern void *ac_htable_lookup(const ac_htable_t *htable, const void *key);
@@ -275,6 +499,8 @@ extern char *ac_json_load_from_fd(int fd, off_t offset);
 extern char *ac_json_load_from_file(const char *file, off_t offset);
 
 extern ac_jsonw_t *ac_jsonw_init(void);
+extern ac_jsonw_t *ac_jsonw_init_with_allocator(const ac_allocator_t *alloc);
+extern ac_jsonw_t *ac_jsonw_init_arena(ac_arena_t *arena);
 extern void ac_jsonw_indent_sz(ac_jsonw_t *json, int size);
 extern void ac_jsonw_set_indenter(ac_jsonw_t *json, const char *indenter);
 extern void ac_jsonw_add_str(ac_jsonw_t *json, const char *name,
@@ -319,14 +545,59 @@ extern void ac_list_rev_foreach(ac_list_t *list,
 				void (*action)(void *item, void *data),
 				void *user_data);
 extern void ac_list_destroy(ac_list_t **list, void (*free_data)(void *data));
+extern void ac_list_add_with_allocator(ac_list_t **list, void *data,
+				       const ac_allocator_t *alloc);
+extern void ac_list_preadd_with_allocator(ac_list_t **list, void *data,
+					  const ac_allocator_t *alloc);
+extern bool ac_list_remove_with_allocator(ac_list_t **list, void *data,
+					  void (*free_data)(void *data),
+					  const ac_allocator_t *alloc);
+extern bool ac_list_remove_nth_with_allocator(ac_list_t **list, long n,
+					      void (*free_data)(void *data),
+					      const ac_allocator_t *alloc);
+extern bool ac_list_remove_custom_with_allocator(ac_list_t **list, void *data,
+				int (*compar)(const void *a, const void *b),
+				void (*free_data)(void *data),
+				const ac_allocator_t *alloc);
+extern void ac_list_destroy_with_allocator(ac_list_t **list,
+					   void (*free_data)(void *data),
+					   const ac_allocator_t *alloc);
 
 extern void ac_misc_ppb(u64 bytes, ac_si_units_t si, ac_misc_ppb_t *ppb);
+extern const char *ac_misc_ppb_str(u64 bytes, ac_si_units_t si, char *dst);
+extern void ac_misc_ppb_strm(const u64 *bytes, size_t nmemb, ac_si_units_t si,
+			     char *dst);
 extern char *ac_misc_passcrypt(const char *pass, ac_hash_algo_t hash_type,
 			       ac_crypt_data_t *data);
+extern bool ac_misc_passcrypt_verify(const char *pass, const char *hash,
+				     ac_crypt_data_t *data);
+extern ac_misc_passcrypt_pool_t *ac_misc_passcrypt_pool_new(
+					unsigned int nr_workers,
+					unsigned int max_queued);
+extern int ac_misc_passcrypt_pool_hash(ac_misc_passcrypt_pool_t *pool,
+				       const char *pass,
+				       ac_hash_algo_t hash_type,
+				       void (*done)(int status,
+						    const char *hash,
+						    void *user_data),
+				       void *user_data);
+extern int ac_misc_passcrypt_pool_verify(ac_misc_passcrypt_pool_t *pool,
+					 const char *pass, const char *hash,
+					 void (*done)(int status,
+						      const char *hash,
+						      void *user_data),
+					 void *user_data);
+extern void ac_misc_passcrypt_pool_destroy(ac_misc_passcrypt_pool_t *pool);
 extern const char *ac_misc_gen_uuid4(char *dst);
+extern int ac_misc_gen_uuid4_many(char *dst, size_t nmemb);
+extern const char *ac_misc_gen_uuid7(char *dst);
 extern int ac_misc_shuffle(void *base, size_t nmemb, size_t size,
 			   ac_misc_shuffle_t algo);
 extern bool ac_misc_luhn_check(u64 num);
+extern bool ac_misc_luhn_check_str(const char *str, size_t len);
+extern size_t ac_misc_luhn_check_strm(const char * const *strs,
+				      const size_t *lens, size_t nmemb,
+				      bool *results);
 extern u32 ac_hash_func_ptr(const void *key);
 extern u32 ac_hash_func_str(const void *key);
 extern u32 ac_hash_func_u32(const void *key);
@@ -355,12 +626,35 @@ extern bool ac_net_ipv6_isin(const char *network, u8 prefixlen,
 extern bool ac_net_ipv6_isin_sa(const char *network, u8 prefixlen,
 				const struct sockaddr *sa);
 
+extern bool ac_perf_available(void);
+extern ac_perf_t *ac_perf_new(void);
+extern int ac_perf_region(ac_perf_t *perf, const char *name);
+extern void ac_perf_start(ac_perf_t *perf, int region);
+extern void ac_perf_stop(ac_perf_t *perf, int region);
+extern int ac_perf_stats(ac_perf_t *perf, int region, ac_perf_stats_t *stats);
+extern void ac_perf_to_json(ac_perf_t *perf, ac_jsonw_t *json,
+			    const char *name);
+extern void ac_perf_destroy(ac_perf_t *perf);
+
+extern ac_pool_t *ac_pool_new(size_t obj_sz, size_t slab_sz);
+extern void *ac_pool_alloc(ac_pool_t *pool);
+extern void ac_pool_free(ac_pool_t *pool, void *obj);
+extern void ac_pool_stats(ac_pool_t *pool, ac_pool_stats_t *stats);
+extern void ac_pool_allocator(ac_pool_t *pool, ac_allocator_t *alloc);
+extern void ac_pool_destroy(ac_pool_t *pool);
+
 extern void ac_quark_init(ac_quark_t *quark, void (*free_func)(void *ptr));
+extern void ac_quark_init_with_allocator(ac_quark_t *quark,
+					 void (*free_func)(void *ptr),
+					 const ac_allocator_t *alloc);
+extern int ac_quark_set_thread_safe(ac_quark_t *quark);
 extern int ac_quark_from_string(ac_quark_t *quark, const char *str);
 extern const char *ac_quark_to_string(const ac_quark_t *quark, int id);
 extern void ac_quark_destroy(const ac_quark_t *quark);
 
 extern ac_queue_t *ac_queue_new(void);
+extern ac_queue_t *ac_queue_new_with_allocator(const ac_allocator_t *alloc);
+extern int ac_queue_set_thread_safe(ac_queue_t *queue);
 extern u32 ac_queue_nr_items(const ac_queue_t *queue);
 extern int ac_queue_push(ac_queue_t *queue, void *item);
 extern void *ac_queue_pop(ac_queue_t *queue);
@@ -370,6 +664,32 @@ extern void ac_queue_foreach(const ac_queue_t *queue,
 extern void ac_queue_destroy(const ac_queue_t *queue,
 			     void (*free_func)(void *item));
 
+extern void ac_ratelimit_tb_init(ac_ratelimit_tb_t *tb, u64 rate, u64 per_ns,
+				 u32 burst);
+extern bool ac_ratelimit_tb_allow(ac_ratelimit_tb_t *tb, u32 n, u64 now);
+extern u32 ac_ratelimit_tb_tokens(const ac_ratelimit_tb_t *tb, u64 now);
+extern void ac_ratelimit_gcra_init(ac_ratelimit_gcra_t *gcra, u64 rate,
+				   u64 per_ns, u32 burst);
+extern bool ac_ratelimit_gcra_allow(ac_ratelimit_gcra_t *gcra, u32 n, u64 now,
+				    u64 *retry_ns);
+extern void ac_ratelimit_sw_init(ac_ratelimit_sw_t *sw, u32 limit,
+				 u64 window_ns);
+extern bool ac_ratelimit_sw_allow(ac_ratelimit_sw_t *sw, u32 n, u64 now);
+extern ac_ratelimit_keyed_t *ac_ratelimit_keyed_new(u32 nr_keys, u64 rate,
+						    u64 per_ns, u32 burst);
+extern bool ac_ratelimit_keyed_allow(ac_ratelimit_keyed_t *kl, const void *key,
+				     size_t len, u32 n, u64 now,
+				     u64 *retry_ns);
+extern void ac_ratelimit_keyed_destroy(ac_ratelimit_keyed_t *kl);
+
+extern int ac_rng_init(ac_rng_t *rng, ac_rng_algo_t algo);
+extern void ac_rng_seed(ac_rng_t *rng, ac_rng_algo_t algo, u64 seed);
+extern u64 ac_rng_u64(ac_rng_t *rng);
+extern u32 ac_rng_u32(ac_rng_t *rng);
+extern u64 ac_rng_bounded(ac_rng_t *rng, u64 bound);
+extern double ac_rng_double(ac_rng_t *rng);
+extern void ac_rng_fill(ac_rng_t *rng, void *buf, size_t len);
+
 extern ac_slist_t *ac_slist_last(ac_slist_t *list);
 extern long ac_slist_len(const ac_slist_t *list);
 extern void ac_slist_add(ac_slist_t **list, void *data);
@@ -391,9 +711,29 @@ extern void ac_slist_foreach(ac_slist_t *list,
 			     void (*action)(void *item, void *data),
 			     void *user_data);
 extern void ac_slist_destroy(ac_slist_t **list, void (*free_data)(void *data));
+extern void ac_slist_add_with_allocator(ac_slist_t **list, void *data,
+					const ac_allocator_t *alloc);
+extern void ac_slist_preadd_with_allocator(ac_slist_t **list, void *data,
+					   const ac_allocator_t *alloc);
+extern bool ac_slist_remove_with_allocator(ac_slist_t **list, void *data,
+					   void (*free_data)(void *data),
+					   const ac_allocator_t *alloc);
+extern bool ac_slist_remove_nth_with_allocator(ac_slist_t **list, long n,
+					       void (*free_data)(void *data),
+					       const ac_allocator_t *alloc);
+extern bool ac_slist_remove_custom_with_allocator(ac_slist_t **list,
+				void *data,
+				int (*compar)(const void *a, const void *b),
+				void (*free_data)(void *data),
+				const ac_allocator_t *alloc);
+extern void ac_slist_destroy_with_allocator(ac_slist_t **list,
+					    void (*free_data)(void *data),
+					    const ac_allocator_t *alloc);
 
 extern void ac_str_freev(char **stringv);
 extern char **ac_str_split(const char *string, int delim, int flags);
+extern char **ac_str_split_arena(ac_arena_t *arena, const char *string,
+				 int delim, int flags);
 extern char *ac_str_chomp(char *string);
 extern char *ac_str_substr(const char *src, char *dest, size_t start,
 			   size_t len);
@@ -405,8 +745,29 @@ extern double ac_time_tspec_diff(struct timespec *delta,
 extern void ac_time_secs_to_hms(long total, int *hours, int *minutes,
 				int *seconds);
 extern int ac_time_nsleep(u64 period);
+extern u64 ac_time_clock_ns(void);
+extern u64 ac_time_clock_cycles(void);
+extern u64 ac_time_cycles_to_ns(u64 cycles);
+extern bool ac_time_clock_is_tsc(void);
+extern void ac_time_coarse_update(void);
+extern int ac_time_coarse_start(u64 interval_us);
+extern void ac_time_coarse_stop(void);
+extern u64 ac_time_coarse_ns(void);
+extern void ac_time_coarse_tspec(struct timespec *ts);
+extern double ac_time_coarse_elapsed(struct timespec *delta,
+				     const struct timespec *start);
+extern int ac_time_sleep_until(const struct timespec *deadline);
+extern int ac_time_nsleep_precise(u64 nsecs);
+extern void ac_time_period_init(ac_time_period_t *period, u64 period_ns);
+extern int ac_time_period_wait(ac_time_period_t *period);
+extern size_t ac_time_fmt_rfc3339(char *dst, const struct timespec *ts,
+				  int frac_digits);
+extern int ac_time_parse_rfc3339(const char *str, size_t len,
+				 struct timespec *ts);
 #pragma GCC visibility pop
 
+#include "libac_inline.h"
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
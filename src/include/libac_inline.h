@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * libac_inline.h - Inline versions of the trivial libac functions
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#ifndef _LIBAC_INLINE_H_
+#define _LIBAC_INLINE_H_
+
+#ifndef _LIBAC_H_
+#error "Include <libac.h> instead of <libac_inline.h>"
+#endif
+
+#include <string.h>
+
+/*
+ * GNU inline definitions are only ever used for inlining, no symbol is
+ * emitted for them and taking the address of one gets the external
+ * definition.
+ */
+#define __AC_INLINE	extern __inline__ \
+			__attribute__((__gnu_inline__, __always_inline__))
+
+/*
+ * The bodies of the functions below, shared by the library's exported
+ * versions and the inline versions.
+ */
+#define __AC_GOLDEN_MUL		0x61C88647	/* From the Linux kernel */
+
+__AC_INLINE u32 __ac_circ_buf_count(const ac_circ_buf_t *cbuf)
+{
+	return ((cbuf->head - cbuf->tail) / cbuf->elem_sz) & (cbuf->size - 1);
+}
+
+__AC_INLINE u32 __ac_queue_nr_items(const ac_queue_t *queue)
+{
+	return !queue ? 0 : queue->items;
+}
+
+__AC_INLINE bool __ac_btree_is_empty(const ac_btree_t *tree)
+{
+	return !tree->rootp;
+}
+
+__AC_INLINE size_t __ac_jsonw_len(const ac_jsonw_t *json)
+{
+	return json->len;
+}
+
+__AC_INLINE const char *__ac_jsonw_get(const ac_jsonw_t *json)
+{
+	return json->str;
+}
+
+/* Jenkins One At A Time */
+__AC_INLINE u32 __ac_hash_func_str(const void *key)
+{
+	const char *k = (const char *)key;
+	size_t len = strlen(k);
+	size_t i = 0;
+	u32 hash = 0;
+
+	while (i != len) {
+		hash += k[i++];
+		hash += hash << 10;
+		hash ^= hash >> 6;
+	}
+	hash += hash << 3;
+	hash ^= hash >> 11;
+	hash += hash << 15;
+
+	return hash;
+}
+
+__AC_INLINE u32 __ac_hash_func_u32(const void *key)
+{
+	return *(const u32 *)key * __AC_GOLDEN_MUL;
+}
+
+__AC_INLINE u32 __ac_hash_func_ptr(const void *key)
+{
+	return (const long)key * __AC_GOLDEN_MUL;
+}
+
+__AC_INLINE int __ac_cmp_ptr(const void *a, const void *b)
+{
+	return !(a == b);
+}
+
+__AC_INLINE int __ac_cmp_str(const void *a, const void *b)
+{
+	return strcmp((const char *)a, (const char *)b);
+}
+
+__AC_INLINE int __ac_cmp_u32(const void *a, const void *b)
+{
+	return !(*(const u32 *)a == *(const u32 *)b);
+}
+
+/*
+ * With AC_INLINE_FAST_PATHS defined before including libac.h, calls to
+ * these functions are inlined rather than going through the PLT. Taking
+ * the address of one (e.g passing ac_hash_func_u32 to ac_htable_new()) still
+ * gets the exported function and the ABI is unchanged.
+ */
+#ifdef AC_INLINE_FAST_PATHS
+/*
+ * The exported functions under another name, so the inline versions can
+ * call them to take the lock of a container that has been made thread
+ * safe without recursing into themselves.
+ */
+extern u32 __ac_circ_buf_count_locked(const ac_circ_buf_t *cbuf)
+	__asm__("ac_circ_buf_count");
+extern u32 __ac_queue_nr_items_locked(const ac_queue_t *queue)
+	__asm__("ac_queue_nr_items");
+extern bool __ac_btree_is_empty_locked(const ac_btree_t *tree)
+	__asm__("ac_btree_is_empty");
+
+__AC_INLINE u32 ac_circ_buf_count(const ac_circ_buf_t *cbuf)
+{
+	if (cbuf->lock)
+		return __ac_circ_buf_count_locked(cbuf);
+
+	return __ac_circ_buf_count(cbuf);
+}
+
+__AC_INLINE u32 ac_queue_nr_items(const ac_queue_t *queue)
+{
+	if (queue && queue->lock)
+		return __ac_queue_nr_items_locked(queue);
+
+	return __ac_queue_nr_items(queue);
+}
+
+__AC_INLINE bool ac_btree_is_empty(const ac_btree_t *tree)
+{
+	if (tree->lock)
+		return __ac_btree_is_empty_locked(tree);
+
+	return __ac_btree_is_empty(tree);
+}
+
+__AC_INLINE size_t ac_jsonw_len(const ac_jsonw_t *json)
+{
+	return __ac_jsonw_len(json);
+}
+
+__AC_INLINE const char *ac_jsonw_get(const ac_jsonw_t *json)
+{
+	return __ac_jsonw_get(json);
+}
+
+__AC_INLINE u32 ac_hash_func_str(const void *key)
+{
+	return __ac_hash_func_str(key);
+}
+
+__AC_INLINE u32 ac_hash_func_u32(const void *key)
+{
+	return __ac_hash_func_u32(key);
+}
+
+__AC_INLINE u32 ac_hash_func_ptr(const void *key)
+{
+	return __ac_hash_func_ptr(key);
+}
+
+__AC_INLINE int ac_cmp_ptr(const void *a, const void *b)
+{
+	return __ac_cmp_ptr(a, b);
+}
+
+__AC_INLINE int ac_cmp_str(const void *a, const void *b)
+{
+	return __ac_cmp_str(a, b);
+}
+
+__AC_INLINE int ac_cmp_u32(const void *a, const void *b)
+{
+	return __ac_cmp_u32(a, b);
+}
+#endif /* AC_INLINE_FAST_PATHS */
+
+#endif /* _LIBAC_INLINE_H_ */
@@ -10,26 +10,9 @@
 #define _PLATFORM_H_
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <search.h>
 
-#ifndef __GLIBC__
-struct random_data {
-	int32_t *fptr;		    /* Front pointer.			   */
-	int32_t *rptr;		    /* Rear pointer.			   */
-	int32_t *state;		    /* Array of state values.		   */
-	int rand_type;		    /* Type of random number generator.	   */
-	int rand_deg;		    /* Degree of random number generator.  */
-	int rand_sep;		    /* Distance between front and rear.	   */
-	int32_t *end_ptr;	    /* Pointer behind state table.	   */
-};
-
-extern int random_r(struct random_data *buf, int32_t *result);
-extern int srandom_r(unsigned int seed, struct random_data *buf);
-extern int initstate_r(unsigned int seed, char *statebuf,
-		       size_t statelen, struct random_data *buf);
-extern int setstate_r(char *statebuf, struct random_data *buf);
-#endif
-
 #ifdef __FreeBSD__
 extern int fallocate(int fd, int mode, off_t offset, off_t len);
 extern void tdestroy(void *root, void (*destroy_func)(void *));
@@ -42,6 +25,11 @@ extern void twalk_r(const void *vroot,
 #endif
 
 extern ssize_t file_copy(int in_fd, int out_fd);
-extern char *gen_uuid(char *buf);
+extern int get_random_bytes(void *buf, size_t len);
+
+extern long get_thread_id(void);
+extern int perf_events_open(int *fds, int nr);
+extern int perf_events_read(int leader, uint64_t *counts, int nr);
+extern void perf_events_close(int *fds, int nr);
 
 #endif /* _PLATFORM_H_ */
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * platform/common/get_random_bytes.c - fill a buffer from the kernel's
+ *					random number generator
+ *
+ * Copyright (C) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+
+#if defined(__GLIBC__) && __GLIBC__ <= 2 && __GLIBC_MINOR__ < 25
+/* No getrandom(3) wrapper, go direct to the system call if we can */
+#include <sys/syscall.h>
+#include <fcntl.h>
+
+static ssize_t __getrandom(void *buf, size_t len)
+{
+#ifdef SYS_getrandom
+	return syscall(SYS_getrandom, buf, len, 0);
+#else
+	int fd;
+	ssize_t ret;
+
+	fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	ret = read(fd, buf, len);
+	close(fd);
+
+	return ret;
+#endif
+}
+#else
+#include <sys/random.h>
+
+static ssize_t __getrandom(void *buf, size_t len)
+{
+	return getrandom(buf, len, 0);
+}
+#endif
+
+int get_random_bytes(void *buf, size_t len)
+{
+	char *p = buf;
+
+	while (len > 0) {
+		ssize_t bytes = __getrandom(p, len);
+
+		if (bytes == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		p += bytes;
+		len -= bytes;
+	}
+
+	return 0;
+}
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * platform/freebsd/perf_events.c - dummy hardware performance counters
+ *
+ * Copyright (C) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <pthread_np.h>
+
+long get_thread_id(void)
+{
+	return pthread_getthreadid_np();
+}
+
+int perf_events_open(int *fds, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		fds[i] = -1;
+
+	errno = ENOSYS;
+	return -1;
+}
+
+int perf_events_read(int leader __unused, uint64_t *counts __unused,
+		     int nr __unused)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+void perf_events_close(int *fds __unused, int nr __unused)
+{
+}
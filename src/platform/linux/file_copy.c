@@ -13,6 +13,8 @@
 #include <fcntl.h>
 #include <sys/sendfile.h>
 
+#include "../../ac_sdt.h"
+
 #define IO_SIZE (1024*1024 * 8ul)
 ssize_t file_copy(int in_fd, int out_fd)
 {
@@ -26,6 +28,8 @@ ssize_t file_copy(int in_fd, int out_fd)
 			return -1;
 		total += bytes_wrote;
 
+		AC_PROBE2(fs_copy_progress, out_fd, total);
+
 		/*
 		 * Try not to blow the page cache. After each sendfile() we
 		 * write out the data and then make sure the previous lot
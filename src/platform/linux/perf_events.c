@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * platform/linux/perf_events.c - Hardware performance counters
+ *
+ * Copyright (C) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/* In the same order as ac_perf_counter_t */
+static const uint64_t perf_configs[] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES
+};
+
+long get_thread_id(void)
+{
+	return syscall(SYS_gettid);
+}
+
+void perf_events_close(int *fds, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (fds[i] != -1)
+			close(fds[i]);
+		fds[i] = -1;
+	}
+}
+
+/*
+ * Open a group of counters for the calling thread in user space, with
+ * fds[0] the group leader. They count from now on and are read with a
+ * single read(2) of the leader.
+ */
+int perf_events_open(int *fds, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		fds[i] = -1;
+
+	for (i = 0; i < nr; i++) {
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = perf_configs[i];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1,
+				 i == 0 ? -1 : fds[0], 0);
+		if (fds[i] == -1) {
+			perf_events_close(fds, i);
+			return -1;
+		}
+		/* PERF_FLAG_FD_CLOEXEC needs Linux 3.14 */
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	return 0;
+}
+
+int perf_events_read(int leader, uint64_t *counts, int nr)
+{
+	uint64_t buf[1 + 8];
+	ssize_t bytes;
+	size_t len = (1 + nr) * sizeof(uint64_t);
+	int i;
+
+	if (len > sizeof(buf))
+		return -1;
+
+	bytes = read(leader, buf, len);
+	if (bytes != (ssize_t)len || buf[0] != (uint64_t)nr)
+		return -1;
+
+	for (i = 0; i < nr; i++)
+		counts[i] = buf[i + 1];
+
+	return 0;
+}
@@ -0,0 +1,574 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+
+/*
+ * stress.c - Hammer the thread safe containers from several threads
+ *
+ * Built by 'make stress' with -fsanitize=thread along with the library
+ * itself, so ThreadSanitizer reports any data races, as well as the
+ * results being checked here.
+ *
+ * The inline fast paths are used, so that the inline ac_btree_is_empty(),
+ * ac_circ_buf_count() & ac_queue_nr_items() are checked to take the lock.
+ *
+ * Copyright (c) 2022		Andrew Clayton <andrew@digital-domain.net>
+ */
+
+#define _GNU_SOURCE
+
+#define AC_INLINE_FAST_PATHS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "../include/libac.h"
+
+#define STRESS_THREADS		4
+#define STRESS_ITERS		20000
+#define STRESS_NR_KEYS		1024
+#define STRESS_NR_QUARKS	256
+#define STRESS_CIRC_BUF_SZ	256
+
+struct worker {
+	pthread_t tid;
+	int idx;
+	u32 rnd;
+
+	void *data;
+	bool ok;
+};
+
+struct stress {
+	const char *name;
+	bool (*run)(void);
+};
+
+static int nr_threads = STRESS_THREADS;
+static u32 nr_iters = STRESS_ITERS;
+
+static u32 stress_keys[STRESS_NR_KEYS];
+
+/* xorshift32, each thread has its own state */
+static u32 stress_rand(struct worker *w)
+{
+	w->rnd ^= w->rnd << 13;
+	w->rnd ^= w->rnd >> 17;
+	w->rnd ^= w->rnd << 5;
+
+	return w->rnd;
+}
+
+static bool stress_run_threads(void *(*fn)(void *arg), void *data)
+{
+	struct worker *workers = calloc(nr_threads, sizeof(struct worker));
+	bool ok = true;
+	int i;
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].idx = i;
+		workers[i].rnd = 0x9e3779b9 * (i + 1);
+		workers[i].data = data;
+		workers[i].ok = true;
+		pthread_create(&workers[i].tid, NULL, fn, &workers[i]);
+	}
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].tid, NULL);
+		if (!workers[i].ok)
+			ok = false;
+	}
+	free(workers);
+
+	return ok;
+}
+
+static int stress_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a;
+	u32 y = *(const u32 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * The containers only call their allocator with their lock held, so this
+ * one is deliberately not thread-safe and ThreadSanitizer will complain
+ * if that's ever not the case. It also catches leaks.
+ */
+
+struct stress_alloc {
+	u64 allocs;
+	u64 frees;
+	ac_allocator_t alloc;
+};
+
+static void *stress_alloc(size_t size, void *ctx)
+{
+	struct stress_alloc *sa = ctx;
+
+	sa->allocs++;
+
+	return malloc(size);
+}
+
+static void *stress_realloc(void *ptr, size_t old_size __always_unused,
+			    size_t size, void *ctx)
+{
+	struct stress_alloc *sa = ctx;
+
+	if (!ptr)
+		sa->allocs++;
+
+	return realloc(ptr, size);
+}
+
+static void stress_free(void *ptr, size_t size __always_unused, void *ctx)
+{
+	struct stress_alloc *sa = ctx;
+
+	sa->frees++;
+	free(ptr);
+}
+
+static const ac_allocator_t *stress_alloc_init(struct stress_alloc *sa)
+{
+	sa->allocs = sa->frees = 0;
+	sa->alloc.alloc = stress_alloc;
+	sa->alloc.realloc = stress_realloc;
+	sa->alloc.free = stress_free;
+	sa->alloc.ctx = sa;
+
+	return &sa->alloc;
+}
+
+/*
+ * htable: random inserts, removes & lookups of a set of keys with the
+ * key as the data, and the odd walk over the whole table.
+ */
+
+static void htable_check_entry(void *key, void *data, void *user_data)
+{
+	struct worker *w = user_data;
+
+	if (key != data)
+		w->ok = false;
+}
+
+static void *htable_worker(void *arg)
+{
+	struct worker *w = arg;
+	ac_htable_t *htable = w->data;
+	u32 i;
+
+	for (i = 0; i < nr_iters; i++) {
+		u32 r = stress_rand(w);
+		u32 *key = &stress_keys[r % STRESS_NR_KEYS];
+		u32 *data;
+
+		switch ((r >> 16) % 8) {
+		case 0:
+		case 1:
+			ac_htable_insert(htable, key, key);
+			break;
+		case 2:
+			ac_htable_remove(htable, key);
+			break;
+		case 3:
+			if (i % 256 == 0)
+				ac_htable_foreach(htable, htable_check_entry,
+						  w);
+			break;
+		default:
+			data = ac_htable_lookup(htable, key);
+			if (data && *data != *key)
+				w->ok = false;
+		}
+	}
+
+	return NULL;
+}
+
+static bool stress_htable(void)
+{
+	struct stress_alloc sa;
+	ac_htable_t *htable;
+	bool ok;
+
+	htable = ac_htable_new_with_allocator(ac_hash_func_u32, ac_cmp_u32,
+					      NULL, NULL,
+					      stress_alloc_init(&sa));
+	ac_htable_set_thread_safe(htable);
+	ok = stress_run_threads(htable_worker, htable);
+	ac_htable_destroy(htable);
+
+	return ok && sa.allocs == sa.frees;
+}
+
+/*
+ * btree: as for the htable, the walks check the tree is still in order.
+ */
+
+struct btree_walk {
+	u32 last;
+	bool ok;
+};
+
+static void btree_check_node(const void *nodep, VISIT which, void *data)
+{
+	struct btree_walk *bw = data;
+	u32 key = **(const u32 * const *)nodep;
+
+	if (which != postorder && which != leaf)
+		return;
+
+	if (key < bw->last)
+		bw->ok = false;
+	bw->last = key;
+}
+
+static void *btree_worker(void *arg)
+{
+	struct worker *w = arg;
+	ac_btree_t *tree = w->data;
+	u32 i;
+
+	for (i = 0; i < nr_iters; i++) {
+		u32 r = stress_rand(w);
+		u32 *key = &stress_keys[r % STRESS_NR_KEYS];
+		struct btree_walk bw = { .last = 0, .ok = true };
+		u32 *node;
+
+		switch ((r >> 16) % 8) {
+		case 0:
+		case 1:
+			ac_btree_add(tree, key);
+			break;
+		case 2:
+			ac_btree_remove(tree, key);
+			break;
+		case 3:
+			if (i % 256 != 0) {
+				/* The result is racy, but the read mustn't be */
+				ac_btree_is_empty(tree);
+				break;
+			}
+			ac_btree_foreach_data(tree, btree_check_node, &bw);
+			if (!bw.ok)
+				w->ok = false;
+			break;
+		default:
+			node = ac_btree_lookup(tree, key);
+			if (node && *node != *key)
+				w->ok = false;
+		}
+	}
+
+	return NULL;
+}
+
+static bool stress_btree(void)
+{
+	ac_btree_t *tree = ac_btree_new(stress_cmp_u32, NULL);
+	bool ok;
+
+	ac_btree_set_thread_safe(tree);
+	ok = stress_run_threads(btree_worker, tree);
+	ac_btree_destroy(tree);
+
+	return ok;
+}
+
+/*
+ * queue & circ_buf: even threads produce nr_iters items each, odd threads
+ * consume them until they've all been seen. The sum of the items popped
+ * must match what was pushed.
+ */
+
+struct fifo {
+	void *fifo;
+	bool copy;
+
+	u64 total;
+	u64 popped;
+	u64 sum;
+};
+
+static int nr_producers(void)
+{
+	return (nr_threads + 1) / 2;
+}
+
+static u64 fifo_expected_sum(void)
+{
+	u64 n = (u64)nr_producers() * nr_iters;
+
+	/* Items are 1..n */
+	return n * (n + 1) / 2;
+}
+
+static bool fifo_consumed(struct fifo *f, u64 item)
+{
+	__atomic_add_fetch(&f->sum, item, __ATOMIC_RELAXED);
+
+	return __atomic_add_fetch(&f->popped, 1, __ATOMIC_RELAXED) >= f->total;
+}
+
+static bool fifo_done(struct fifo *f)
+{
+	return __atomic_load_n(&f->popped, __ATOMIC_RELAXED) >= f->total;
+}
+
+static void *queue_worker(void *arg)
+{
+	struct worker *w = arg;
+	struct fifo *f = w->data;
+	u32 i;
+
+	if (w->idx % 2 == 0) {
+		u64 base = (u64)(w->idx / 2) * nr_iters;
+
+		for (i = 1; i <= nr_iters; i++) {
+			ac_queue_push(f->fifo, (void *)(uintptr_t)(base + i));
+			/* Races with the consumers' pops */
+			if (ac_queue_nr_items(f->fifo) > f->total)
+				w->ok = false;
+		}
+
+		return NULL;
+	}
+
+	while (!fifo_done(f)) {
+		void *item = ac_queue_pop(f->fifo);
+
+		if (!item) {
+			sched_yield();
+			continue;
+		}
+		if (fifo_consumed(f, (uintptr_t)item))
+			break;
+	}
+
+	return NULL;
+}
+
+static bool stress_queue(void)
+{
+	struct stress_alloc sa;
+	struct fifo f = {
+		.fifo = ac_queue_new_with_allocator(stress_alloc_init(&sa)),
+		.total = (u64)nr_producers() * nr_iters,
+	};
+	bool ok;
+
+	ac_queue_set_thread_safe(f.fifo);
+	ok = stress_run_threads(queue_worker, &f);
+	if (f.sum != fifo_expected_sum() || ac_queue_nr_items(f.fifo) != 0)
+		ok = false;
+	ac_queue_destroy(f.fifo, NULL);
+
+	return ok && sa.allocs == sa.frees;
+}
+
+static void *circ_buf_worker(void *arg)
+{
+	struct worker *w = arg;
+	struct fifo *f = w->data;
+	u32 i;
+
+	if (w->idx % 2 == 0) {
+		u64 base = (u64)(w->idx / 2) * nr_iters;
+
+		for (i = 1; i <= nr_iters; i++) {
+			u64 item = base + i;
+			int err;
+
+			do {
+				if (f->copy)
+					err = ac_circ_buf_pushm(f->fifo,
+								&item, 1);
+				else
+					err = ac_circ_buf_push(f->fifo,
+						(void *)(uintptr_t)item);
+				if (err)
+					sched_yield();
+			} while (err);
+			if (ac_circ_buf_count(f->fifo) >= STRESS_CIRC_BUF_SZ)
+				w->ok = false;
+		}
+
+		return NULL;
+	}
+
+	while (!fifo_done(f)) {
+		u64 item = 0;
+
+		if (f->copy) {
+			if (ac_circ_buf_popm(f->fifo, &item, 1) == -1)
+				item = 0;
+		} else {
+			item = (uintptr_t)ac_circ_buf_pop(f->fifo);
+		}
+
+		if (!item) {
+			sched_yield();
+			continue;
+		}
+		if (fifo_consumed(f, item))
+			break;
+	}
+
+	return NULL;
+}
+
+static bool stress_circ_buf_type(bool copy)
+{
+	struct fifo f = {
+		.fifo = ac_circ_buf_new(STRESS_CIRC_BUF_SZ, copy ? sizeof(u64) : 0),
+		.copy = copy,
+		.total = (u64)nr_producers() * nr_iters,
+	};
+	bool ok;
+
+	ac_circ_buf_set_thread_safe(f.fifo);
+	ok = stress_run_threads(circ_buf_worker, &f);
+	if (f.sum != fifo_expected_sum() || ac_circ_buf_count(f.fifo) != 0)
+		ok = false;
+	ac_circ_buf_destroy(f.fifo);
+
+	return ok;
+}
+
+static bool stress_circ_buf(void)
+{
+	return stress_circ_buf_type(false) && stress_circ_buf_type(true);
+}
+
+/*
+ * quark: every thread maps the same set of strings, they must all get
+ * the same id for a string and each string a different id.
+ */
+
+struct quark_stress {
+	ac_quark_t quark;
+	char strs[STRESS_NR_QUARKS][16];
+	int ids[STRESS_NR_QUARKS];
+};
+
+static void *quark_worker(void *arg)
+{
+	struct worker *w = arg;
+	struct quark_stress *qs = w->data;
+	u32 i;
+
+	for (i = 0; i < nr_iters; i++) {
+		u32 n = stress_rand(w) % STRESS_NR_QUARKS;
+		int id = ac_quark_from_string(&qs->quark, qs->strs[n]);
+		const char *str = ac_quark_to_string(&qs->quark, id);
+		int expected = -1;
+
+		if (!str || strcmp(str, qs->strs[n]) != 0)
+			w->ok = false;
+
+		if (!__atomic_compare_exchange_n(&qs->ids[n], &expected, id,
+						 false, __ATOMIC_RELAXED,
+						 __ATOMIC_RELAXED) &&
+		    expected != id)
+			w->ok = false;
+	}
+
+	return NULL;
+}
+
+static bool stress_quark(void)
+{
+	struct quark_stress *qs = malloc(sizeof(struct quark_stress));
+	bool seen[STRESS_NR_QUARKS] = { false };
+	struct stress_alloc sa;
+	bool ok;
+	int i;
+
+	ac_quark_init_with_allocator(&qs->quark, NULL, stress_alloc_init(&sa));
+	ac_quark_set_thread_safe(&qs->quark);
+	for (i = 0; i < STRESS_NR_QUARKS; i++) {
+		snprintf(qs->strs[i], sizeof(qs->strs[i]), "quark-%d", i);
+		qs->ids[i] = -1;
+	}
+
+	ok = stress_run_threads(quark_worker, qs);
+	for (i = 0; i < STRESS_NR_QUARKS; i++) {
+		int id = qs->ids[i];
+
+		if (id == -1)
+			continue;
+		if (id >= STRESS_NR_QUARKS || seen[id])
+			ok = false;
+		else
+			seen[id] = true;
+	}
+	ac_quark_destroy(&qs->quark);
+	free(qs);
+
+	return ok && sa.allocs == sa.frees;
+}
+
+static const struct stress stresses[] = {
+	{ "btree", stress_btree },
+	{ "circ_buf", stress_circ_buf },
+	{ "htable", stress_htable },
+	{ "quark", stress_quark },
+	{ "queue", stress_queue },
+};
+
+static void usage(void)
+{
+	printf("Usage: stress [-t threads] [-n iterations] [-h]\n\n");
+	printf("  -t  Number of threads, at least 2 (default %d)\n",
+	       STRESS_THREADS);
+	printf("  -n  Operations per thread (default %d)\n", STRESS_ITERS);
+	printf("  -h  This help\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = EXIT_SUCCESS;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:n:h")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'n':
+			nr_iters = atoi(optarg);
+			break;
+		case 'h':
+			usage();
+			exit(EXIT_SUCCESS);
+		default:
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (nr_threads < 2 || nr_iters < 1) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < STRESS_NR_KEYS; i++)
+		stress_keys[i] = i;
+
+	for (i = 0; i < AC_ARRAY_SIZE(stresses); i++) {
+		bool ok = stresses[i].run();
+
+		printf("%-16s %s\n", stresses[i].name, ok ? "ok" : "FAILED");
+		if (!ok)
+			ret = EXIT_FAILURE;
+	}
+
+	exit(ret);
+}
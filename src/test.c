@@ -7,18 +7,23 @@
  */
 
 #define _GNU_SOURCE			/* strdup(3), struct addrinfo */
+#define AC_INLINE_FAST_PATHS		/* Test the inline versions too */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <search.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "include/libac.h"
+#include "ac_cpu.h"		/* To test each level's SIMD kernels */
 
 struct tnode {
 	int key;
@@ -70,6 +75,235 @@ static int compare(const void *pa, const void *pb)
 		return 0;
 }
 
+struct alloc_stats {
+	unsigned long allocs;
+	unsigned long frees;
+	size_t in_use;
+	bool fail;
+};
+
+static void *count_alloc(size_t size, void *ctx)
+{
+	struct alloc_stats *stats = ctx;
+
+	if (stats->fail)
+		return NULL;
+
+	stats->allocs++;
+	stats->in_use += size;
+
+	return malloc(size);
+}
+
+static void *count_realloc(void *ptr, size_t old_size, size_t size,
+			   void *ctx)
+{
+	struct alloc_stats *stats = ctx;
+
+	stats->in_use += size - old_size;
+
+	return realloc(ptr, size);
+}
+
+static void count_free(void *ptr, size_t size, void *ctx)
+{
+	struct alloc_stats *stats = ctx;
+
+	stats->frees++;
+	stats->in_use -= size;
+
+	free(ptr);
+}
+
+static void alloc_test(void)
+{
+	struct alloc_stats stats = { 0 };
+	ac_allocator_t alloc = {
+		.alloc = count_alloc,
+		.realloc = count_realloc,
+		.free = count_free,
+		.ctx = &stats
+	};
+	ac_htable_t *htable;
+	ac_queue_t *queue;
+	ac_circ_buf_t *cbuf;
+	ac_btree_t *tree;
+	ac_jsonw_t *json;
+	ac_quark_t quark;
+	ac_slist_t *slist = NULL;
+	ac_list_t *list = NULL;
+	int i;
+
+	printf("*** %s\n", __func__);
+
+	htable = ac_htable_new_with_allocator(ac_hash_func_str,
+					      ac_cmp_str, NULL, NULL,
+					      &alloc);
+	ac_htable_insert(htable, "mercury", "venus");
+	ac_htable_insert(htable, "earth", "mars");
+	ac_htable_insert(htable, "earth", "jupiter");
+	ac_htable_remove(htable, "mercury");
+	printf("htable  : earth -> %s\n",
+	       (char *)ac_htable_lookup(htable, "earth"));
+	ac_htable_destroy(htable);
+
+	queue = ac_queue_new_with_allocator(&alloc);
+	for (i = 0; i < 8; i++)
+		ac_queue_push(queue, NULL);
+	ac_queue_pop(queue);
+	printf("queue   : %u items\n", ac_queue_nr_items(queue));
+	ac_queue_destroy(queue, NULL);
+
+	cbuf = ac_circ_buf_new_with_allocator(16, sizeof(int), &alloc);
+	ac_circ_buf_push(cbuf, &i);
+	printf("circ_buf: %u items\n", ac_circ_buf_count(cbuf));
+	ac_circ_buf_destroy(cbuf);
+
+	tree = ac_btree_new_with_allocator(ac_cmp_str, NULL, &alloc);
+	ac_btree_add(tree, "saturn");
+	printf("btree   : %s\n", (char *)ac_btree_lookup(tree, "saturn"));
+	ac_btree_destroy(tree);
+
+	ac_quark_init_with_allocator(&quark, NULL, &alloc);
+	ac_quark_from_string(&quark, "uranus");
+	ac_quark_from_string(&quark, "neptune");
+	printf("quark   : 1 -> %s\n", ac_quark_to_string(&quark, 1));
+	ac_quark_destroy(&quark);
+
+	json = ac_jsonw_init_with_allocator(&alloc);
+	ac_jsonw_indent_sz(json, 2);
+	for (i = 0; i < 256; i++)
+		ac_jsonw_add_str(json, "planet", "\"pluto\"");
+	ac_jsonw_end(json);
+	printf("jsonw   : %zu bytes\n", ac_jsonw_len(json));
+	ac_jsonw_free(json);
+
+	for (i = 0; i < 4; i++) {
+		ac_slist_add_with_allocator(&slist, NULL, &alloc);
+		ac_list_preadd_with_allocator(&list, NULL, &alloc);
+	}
+	ac_slist_remove_nth_with_allocator(&slist, 2, NULL, &alloc);
+	ac_list_remove_nth_with_allocator(&list, 0, NULL, &alloc);
+	printf("lists   : %ld/%ld items\n", ac_slist_len(slist),
+	       ac_list_len(list));
+	ac_slist_destroy_with_allocator(&slist, NULL, &alloc);
+	ac_list_destroy_with_allocator(&list, NULL, &alloc);
+
+	/* The containers carry on without a lock if one can't be allocated */
+	htable = ac_htable_new_with_allocator(ac_hash_func_str, ac_cmp_str,
+					      NULL, NULL, &alloc);
+	queue = ac_queue_new_with_allocator(&alloc);
+	cbuf = ac_circ_buf_new_with_allocator(16, sizeof(int), &alloc);
+	tree = ac_btree_new_with_allocator(ac_cmp_str, NULL, &alloc);
+	ac_quark_init_with_allocator(&quark, NULL, &alloc);
+	stats.fail = true;
+	i = 0;
+	errno = 0;
+	i += ac_htable_set_thread_safe(htable) == -1 && errno == ENOMEM;
+	errno = 0;
+	i += ac_queue_set_thread_safe(queue) == -1 && errno == ENOMEM;
+	errno = 0;
+	i += ac_circ_buf_set_thread_safe(cbuf) == -1 && errno == ENOMEM;
+	errno = 0;
+	i += ac_btree_set_thread_safe(tree) == -1 && errno == ENOMEM;
+	errno = 0;
+	i += ac_quark_set_thread_safe(&quark) == -1 && errno == ENOMEM;
+	stats.fail = false;
+	ac_queue_push(queue, NULL);
+	printf("locks   : %d/5 failed with ENOMEM, queue has %u item [%s]\n",
+	       i, ac_queue_nr_items(queue),
+	       i == 5 && ac_queue_nr_items(queue) == 1 ? "PASS" : "FAIL");
+	ac_htable_destroy(htable);
+	ac_queue_destroy(queue, NULL);
+	ac_circ_buf_destroy(cbuf);
+	ac_btree_destroy(tree);
+	ac_quark_destroy(&quark);
+
+	printf("%lu allocs, %lu frees, %zu bytes in use\n", stats.allocs,
+	       stats.frees, stats.in_use);
+
+	printf("*** %s\n\n", __func__);
+}
+
+static void arena_test(void)
+{
+	ac_arena_t *arena = ac_arena_new(4096);
+	ac_arena_mark_t mark;
+	ac_allocator_t alloc;
+	ac_slist_t *list = NULL;
+	ac_jsonw_t *json;
+	char **fields;
+	char **pp;
+	void *ptr;
+	size_t size;
+	int i;
+
+	printf("*** %s\n", __func__);
+
+	ac_arena_alloc(arena, 3);
+	ptr = ac_arena_alloc_aligned(arena, 128, 64);
+	printf("64 byte aligned allocation is %saligned\n",
+	       (uintptr_t)ptr % 64 ? "NOT " : "");
+	ptr = ac_arena_alloc(arena, 16384);
+	printf("Large allocation %s, arena size %zu\n",
+	       ptr ? "succeeded" : "failed", ac_arena_size(arena));
+
+	mark = ac_arena_mark(arena);
+	fields = ac_str_split_arena(arena, "field0,,field2,", ',', 0);
+	for (pp = fields; *pp != NULL; pp++)
+		printf("ac_str_split_arena: '%s'\n", *pp);
+	fields = ac_str_split_arena(arena, "field3", ',',
+				    AC_STR_SPLIT_STRICT);
+	if (!fields[0])
+		printf("ac_str_split_arena: No delimiters found "
+		       "(AC_STR_SPLIT_STRICT)\n");
+	ac_arena_rewind(arena, mark);
+	printf("Rewound to mark, %s\n",
+	       ac_arena_alloc(arena, 1) == (char *)ptr + 16384 ?
+	       "memory reused" : "memory NOT reused");
+
+	ac_arena_allocator(arena, &alloc);
+	for (i = 0; i < 100; i++)
+		ac_slist_preadd_with_allocator(&list, AC_LONG_TO_PTR(i),
+					       &alloc);
+	printf("List has %ld items\n", ac_slist_len(list));
+
+	json = ac_jsonw_init_arena(arena);
+	for (i = 0; i < 1000; i++)
+		ac_jsonw_add_int(json, "value", i);
+	ac_jsonw_end(json);
+	printf("JSON is %zu bytes\n", ac_jsonw_len(json));
+
+	size = ac_arena_size(arena);
+	ac_arena_reset(arena);
+	json = ac_jsonw_init_arena(arena);
+	for (i = 0; i < 1000; i++)
+		ac_jsonw_add_int(json, "value", i);
+	ac_jsonw_end(json);
+	printf("Arena %s after reset\n",
+	       ac_arena_size(arena) == size ? "didn't grow" : "grew");
+
+	/* Sizes that would overflow must fail, not alias earlier memory */
+	ac_arena_reset(arena);
+	ptr = ac_arena_alloc(arena, 16);
+	i = 0;
+	errno = 0;
+	i += !ac_arena_alloc(arena, SIZE_MAX - 8) && errno == ENOMEM;
+	errno = 0;
+	i += !ac_arena_alloc_aligned(arena, SIZE_MAX - 64, 4096) &&
+	     errno == ENOMEM;
+	errno = 0;
+	i += !alloc.realloc(ptr, 16, SIZE_MAX - 8, alloc.ctx) &&
+	     errno == ENOMEM;
+	printf("Huge allocations: %d/3 failed with ENOMEM [%s]\n", i,
+	       i == 3 && ac_arena_alloc(arena, 16) == (char *)ptr + 16 ?
+	       "PASS" : "FAIL");
+
+	ac_arena_destroy(arena);
+
+	printf("*** %s\n\n", __func__);
+}
+
 static void btree_test(void)
 {
 	ac_btree_t *tree;
@@ -78,6 +312,7 @@ static void btree_test(void)
 
 	printf("*** %s\n", __func__);
 	tree = ac_btree_new(compare, free_tnode);
+	ac_btree_set_thread_safe(tree);
 
 	printf("tree is %sempty\n", ac_btree_is_empty(tree) ? "" : "not ");
 
@@ -170,6 +405,7 @@ static void circ_buf_test(void)
 	printf("*** %s\n", __func__);
 
 	cbuf = ac_circ_buf_new(8, 0);
+	ac_circ_buf_set_thread_safe(cbuf);
 
 	buf[0] = 42;
 	buf[1] = 99;
@@ -329,11 +565,104 @@ static void fs_test(void)
 	printf("*** %s\n\n", __func__);
 }
 
+static const struct {
+	const char *name;
+	double lat;
+	double lon;
+} geo_places[] = {
+	{ "Aberdeen", 57.149651, -2.099075 },
+	{ "Edinburgh", 55.953251, -3.188267 },
+	{ "Fort William", 56.819817, -5.105218 },
+	{ "Glasgow", 55.864239, -4.251806 },
+	{ "Inverness", 57.477772, -4.224721 },
+	{ "London", 51.507351, -0.127758 },
+	{ "Manchester", 53.480759, -2.242631 },
+	{ "Perth", 56.395, -3.433 },
+	{ "Ullapool", 57.895, -5.160 },
+	{ NULL, 0.0, 0.0 }
+};
+
+static void geo_kdtree_print(size_t idx, double distance,
+			     void *user_data __always_unused)
+{
+	printf("\t%s (%.0f m)\n", geo_places[idx].name, distance);
+}
+
+/*
+ * Enough points for ac_geo_*_m() to use threads, the results should be
+ * the same as doing it all in one thread.
+ */
+static void geo_bng_m_test(void)
+{
+	const size_t nmemb = 4 * 4096 + 123;
+	ac_geo_t *st = calloc(nmemb, sizeof(ac_geo_t));
+	ac_geo_t *mt = calloc(nmemb, sizeof(ac_geo_t));
+	size_t i;
+
+	for (i = 0; i < nmemb; i++) {
+		st[i].ref = AC_GEO_EREF_WGS84;
+		st[i].easting = 100000 + (i % 500) * 1000;
+		st[i].northing = 50000 + (i / 500) * 1000;
+	}
+	memcpy(mt, st, nmemb * sizeof(ac_geo_t));
+
+	ac_geo_bng_to_lat_lon_m(st, nmemb, 1);
+	ac_geo_bng_to_lat_lon_m(mt, nmemb, 4);
+	printf("%zu BNG -> lat/lon threaded %s single threaded\n", nmemb,
+	       memcmp(st, mt, nmemb * sizeof(ac_geo_t)) == 0 ? "==" : "!=");
+
+	ac_geo_lat_lon_to_bng_m(st, nmemb, 1);
+	ac_geo_lat_lon_to_bng_m(mt, nmemb, 4);
+	printf("%zu lat/lon -> BNG threaded %s single threaded\n", nmemb,
+	       memcmp(st, mt, nmemb * sizeof(ac_geo_t)) == 0 ? "==" : "!=");
+
+	free(st);
+	free(mt);
+}
+
+static void geo_kdtree_test(const ac_geo_t *from)
+{
+	ac_geo_kdtree_t *tree;
+	ac_geo_t points[AC_ARRAY_SIZE(geo_places) - 1];
+	size_t idx[3];
+	double distance[3];
+	ssize_t found;
+	size_t i;
+
+	memset(points, 0, sizeof(points));
+	for (i = 0; geo_places[i].name; i++) {
+		points[i].lat = geo_places[i].lat;
+		points[i].lon = geo_places[i].lon;
+	}
+	tree = ac_geo_kdtree_new(points, i);
+
+	found = ac_geo_kdtree_nearest(tree, from, 3, idx, distance);
+	printf("Nearest %zd places to (%f°, %f°) :-\n", found, from->lat,
+	       from->lon);
+	for (i = 0; i < (size_t)found; i++)
+		printf("\t%s (%.0f m / haversine %.0f m)\n",
+		       geo_places[idx[i]].name, distance[i],
+		       ac_geo_haversine(from, &points[idx[i]]));
+
+	printf("Places within 150km of (%f°, %f°) :-\n", from->lat,
+	       from->lon);
+	found = ac_geo_kdtree_radius(tree, from, 150000.0, geo_kdtree_print,
+				     NULL);
+	printf("Found %zd\n", found);
+
+	ac_geo_kdtree_destroy(tree);
+}
+
 static void geo_test(void)
 {
 	ac_geo_t from;
 	ac_geo_t to;
+	ac_geo_t bng[2];
 	ac_geo_dms_t dms;
+	char geohash[AC_GEO_GEOHASH_MAX_LEN + 1];
+	char neighbours[8][AC_GEO_GEOHASH_MAX_LEN + 1];
+	u64 morton;
+	int i;
 
 	printf("*** %s\n", __func__);
 
@@ -365,6 +694,47 @@ static void geo_test(void)
 	printf("(%f°, %f°) -> (%.0f E, %.0f N)\n", from.lat, from.lon,
 			from.easting, from.northing);
 
+	memset(bng, 0, sizeof(bng));
+	bng[0].easting = 216677;
+	bng[0].northing = 771282;
+	bng[1].easting = 530034;
+	bng[1].northing = 180381;
+	ac_geo_bng_to_lat_lon_m(bng, 2, 2);
+	for (i = 0; i < 2; i++)
+		printf("[%d] -> (%f°, %f°)\n", i, bng[i].lat, bng[i].lon);
+	ac_geo_lat_lon_to_bng_m(bng, 2, 2);
+	for (i = 0; i < 2; i++)
+		printf("[%d] -> (%.0f E, %.0f N)\n", i, bng[i].easting,
+		       bng[i].northing);
+	geo_bng_m_test();
+
+	from.lat = 57.64911;
+	from.lon = 10.40744;
+	ac_geo_geohash_encode(&from, 11, geohash);
+	printf("(%f°, %f°) -> geohash %s\n", from.lat, from.lon, geohash);
+	ac_geo_geohash_decode(geohash, &to);
+	printf("geohash %s -> (%f°, %f°)\n", geohash, to.lat, to.lon);
+	ac_geo_geohash_encode(&from, 5, geohash);
+	ac_geo_geohash_neighbours(geohash, neighbours);
+	printf("geohash %s neighbours :", geohash);
+	for (i = 0; i < 8; i++)
+		printf(" %s", neighbours[i]);
+	printf("\n");
+	morton = ac_geo_morton_encode(&from);
+	ac_geo_morton_decode(morton, &to);
+	printf("(%f°, %f°) -> morton 0x%016" PRIx64 " -> (%f°, %f°)\n",
+	       from.lat, from.lon, morton, to.lat, to.lon);
+	from.lat = NAN;
+	from.lon = 200.0;
+	morton = ac_geo_morton_encode(&from);
+	printf("(%f°, %f°) -> morton 0x%016" PRIx64 "\n", from.lat, from.lon,
+	       morton);
+
+	from.ref = AC_GEO_EREF_WGS84;
+	from.lat = 57.138386;
+	from.lon = -4.668295;
+	geo_kdtree_test(&from);
+
 	printf("*** %s\n\n", __func__);
 }
 
@@ -374,6 +744,71 @@ static void htable_print_entry(void *key, void *data,
 	printf("%s -> %s\n", (char *)key, (char *)data);
 }
 
+struct hist_thread {
+	ac_histogram_t *global;
+	u64 start;
+};
+
+static void *histogram_thread(void *arg)
+{
+	struct hist_thread *ht = arg;
+	ac_histogram_t *hist = ac_histogram_new(1000000, 7);
+	u64 v;
+
+	/* Each thread records every 4th value of 1 - 100000 */
+	for (v = ht->start; v <= 100000; v += 4)
+		ac_histogram_record(hist, v);
+	ac_histogram_merge(ht->global, hist);
+	ac_histogram_destroy(hist);
+
+	return NULL;
+}
+
+static void histogram_test(void)
+{
+	ac_histogram_t *hist;
+	ac_jsonw_t *json;
+	pthread_t tids[4];
+	struct hist_thread hts[4];
+	u64 p99;
+	int i;
+
+	printf("*** %s\n", __func__);
+
+	hist = ac_histogram_new(1000000, 7);
+	for (i = 0; i < 4; i++) {
+		hts[i].global = hist;
+		hts[i].start = i + 1;
+		pthread_create(&tids[i], NULL, histogram_thread, &hts[i]);
+	}
+	for (i = 0; i < 4; i++)
+		pthread_join(tids[i], NULL);
+
+	p99 = ac_histogram_percentile(hist, 99.0);
+	printf("count %" PRIu64 ", min %" PRIu64 ", max %" PRIu64
+	       ", mean %.1f, p50 %" PRIu64 ", p99 %" PRIu64 " [%s]\n",
+	       ac_histogram_count(hist), ac_histogram_min(hist),
+	       ac_histogram_max(hist), ac_histogram_mean(hist),
+	       ac_histogram_percentile(hist, 50.0), p99,
+	       p99 >= 99000 && p99 <= 99000 + 99000 / 128 ? "PASS" : "FAIL");
+	ac_histogram_destroy(hist);
+
+	hist = ac_histogram_new(1000, 3);
+	for (i = 1; i <= 3; i++)
+		ac_histogram_record(hist, i);
+	ac_histogram_record_n(hist, 100, 5);
+	ac_histogram_record(hist, 5000);
+
+	json = ac_jsonw_init();
+	ac_histogram_to_json(hist, json, "latency");
+	ac_jsonw_end(json);
+	printf("%s\n", ac_jsonw_get(json));
+	ac_jsonw_free(json);
+	ac_histogram_destroy(hist);
+
+	printf("*** %s\n\n", __func__);
+}
+
 static void htable_test(void)
 {
 	ac_htable_t *htable;
@@ -383,6 +818,7 @@ static void htable_test(void)
 
 	printf("New hash table with static string keys/data\n");
 	htable = ac_htable_new(ac_hash_func_str, ac_cmp_str, NULL, NULL);
+	ac_htable_set_thread_safe(htable);
 	ac_htable_insert(htable, "::1", "localhost");
 	ac_htable_insert(htable, "fe80::/10", "link-local");
 	printf("There are %lu item(s) in the hash table\n", htable->count);
@@ -425,6 +861,107 @@ static void htable_test(void)
 	printf("*** %s\n\n", __func__);
 }
 
+/* What ac_jsonw_add_str() should produce, one byte at a time */
+static void json_escape_expected(char *dst, const char *str, size_t len)
+{
+	size_t i;
+
+	*dst++ = '"';
+	for (i = 0; i < len; i++) {
+		unsigned char c = str[i];
+
+		switch (c) {
+		case '"':
+			dst += sprintf(dst, "\\\"");
+			break;
+		case '\\':
+			dst += sprintf(dst, "\\\\");
+			break;
+		case '\b':
+			dst += sprintf(dst, "\\b");
+			break;
+		case '\f':
+			dst += sprintf(dst, "\\f");
+			break;
+		case '\n':
+			dst += sprintf(dst, "\\n");
+			break;
+		case '\r':
+			dst += sprintf(dst, "\\r");
+			break;
+		case '\t':
+			dst += sprintf(dst, "\\t");
+			break;
+		default:
+			if (c < 0x20)
+				dst += sprintf(dst, "\\u%04x", c);
+			else
+				*dst++ = c;
+		}
+	}
+	*dst++ = '"';
+	*dst = '\0';
+}
+
+/*
+ * Escape strings of up to more than twice the widest (64 byte) vector with
+ * a byte that does or doesn't need escaping in them, using each level of
+ * kernel the CPU supports. For lengths around a multiple of 16 the byte
+ * goes at every offset, covering the vector loops and the 16/32/64 byte
+ * boundaries, otherwise just the first and last, covering the tails.
+ */
+static void json_escape_test(void)
+{
+	static const char bytes[] = { '"', '\\', '\n', '\x01', '\x1f',
+				      ' ', '\x7f', '\x80', '\xff' };
+	enum cpu_level max = cpu_detect();
+	enum cpu_level level;
+	char str[160];
+	char expected[sizeof(str) * 6 + 3];
+
+	for (level = CPU_GENERIC; level <= max; level++) {
+		unsigned long nr = 0;
+		unsigned long bad = 0;
+		size_t len;
+
+		cpu_set_level(level);
+		for (len = 1; len < sizeof(str); len++) {
+			size_t step = len % 16 <= 1 || len % 16 == 15 ?
+				      1 : len - 1;
+			size_t off;
+			size_t b;
+
+			for (b = 0; b < sizeof(bytes); b++) {
+				ac_jsonw_t *json = ac_jsonw_init();
+
+				for (off = 0; off < len; off += step) {
+					size_t prev = ac_jsonw_len(json);
+					size_t i;
+
+					for (i = 0; i < len; i++)
+						str[i] = 'a' + i % 26;
+					str[off] = bytes[b];
+					str[len] = '\0';
+
+					/* Only look at what was just added */
+					json_escape_expected(expected, str,
+							     len);
+					ac_jsonw_add_str(json, NULL, str);
+					if (!strstr(ac_jsonw_get(json) + prev,
+						    expected))
+						bad++;
+					nr++;
+				}
+				ac_jsonw_free(json);
+			}
+		}
+		printf("JSON escaping (%s): %lu/%lu strings ok [%s]\n",
+		       cpu_level_name(level), nr - bad, nr,
+		       bad == 0 ? "PASS" : "FAIL");
+	}
+	cpu_set_level(max);
+}
+
 static void json_test(void)
 {
 	ac_jsonw_t *json;
@@ -493,6 +1030,8 @@ static void json_test(void)
 	printf("%s\n", ac_jsonw_get(json));
 	ac_jsonw_free(json);
 
+	json_escape_test();
+
 	printf("*** %s\n\n", __func__);
 }
 
@@ -531,6 +1070,72 @@ static void list_test(void)
 	printf("*** %s\n\n", __func__);
 }
 
+/* Check a bucketed shuffle of a large array is still a permutation */
+static void misc_shuffle_test(size_t nmemb, size_t size)
+{
+	u8 *list = malloc(nmemb * size);
+	bool *seen = calloc(nmemb, sizeof(bool));
+	size_t moved = 0;
+	size_t i;
+	bool ok = true;
+
+	for (i = 0; i < nmemb; i++) {
+		memset(list + i * size, 0, size);
+		memcpy(list + i * size, &i, AC_MIN(size, sizeof(i)));
+	}
+
+	ac_misc_shuffle(list, nmemb, size, AC_MISC_SHUFFLE_BUCKETED);
+
+	for (i = 0; i < nmemb; i++) {
+		size_t v = 0;
+
+		memcpy(&v, list + i * size, AC_MIN(size, sizeof(v)));
+		if (v >= nmemb || seen[v]) {
+			ok = false;
+			break;
+		}
+		seen[v] = true;
+		if (v != i)
+			moved++;
+	}
+
+	printf("Bucketed shuffle %zu x %2zu bytes : %s (%zu%% moved)\n", nmemb,
+	       size, ok ? "PASS" : "FAIL", moved * 100 / nmemb);
+
+	free(list);
+	free(seen);
+}
+
+static void passcrypt_done(int status, const char *hash, void *user_data)
+{
+	int *nr_ok = user_data;
+
+	/* hash requests pass a status of 0, successful verifications 1 */
+	if ((hash && status == 0) || (!hash && status == 1))
+		__atomic_fetch_add(nr_ok, 1, __ATOMIC_RELAXED);
+}
+
+static void misc_passcrypt_pool_test(const char *pass, const char *hash)
+{
+	ac_misc_passcrypt_pool_t *pool;
+	int nr_ok = 0;
+	int i;
+
+	pool = ac_misc_passcrypt_pool_new(2, 16);
+	for (i = 0; i < 4; i++) {
+		ac_misc_passcrypt_pool_hash(pool, pass, AC_HASH_ALGO_SHA256,
+					    passcrypt_done, &nr_ok);
+		ac_misc_passcrypt_pool_verify(pool, pass, hash, passcrypt_done,
+					      &nr_ok);
+		ac_misc_passcrypt_pool_verify(pool, "wrong", hash,
+					      passcrypt_done, &nr_ok);
+	}
+	ac_misc_passcrypt_pool_destroy(pool);
+
+	printf("passcrypt pool : %d/8 ok [%s]\n", nr_ok,
+	       nr_ok == 8 ? "PASS" : "FAIL");
+}
+
 static void misc_test(void)
 {
 	ac_misc_ppb_t ppb;
@@ -538,11 +1143,24 @@ static void misc_test(void)
 	int shuff_list[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 	int i;
 	u64 bytes2 = 7375982736;
+	const u64 ppb_vals[] = { 0, 999, 1023, 1048575, 14568264, 7375982736,
+				 UINT64_MAX };
+	char ppb_strs[AC_ARRAY_SIZE(ppb_vals)][AC_MISC_PPB_STR_LEN + 1];
+	char ppb_str[AC_MISC_PPB_STR_LEN + 1];
 	u64 luhn_ok = 1111222233334444;
 	u64 luhn_bad = 1111222233334445;
+	const char *luhn_strs[] = {
+		"1111222233334444", "1111222233334445", "79927398713",
+		"4539578763621486", "12345678901234567890123456789019",
+		"123456789012345678901234567890124", "1234x678", "0"
+	};
+	bool luhn_res[AC_ARRAY_SIZE(luhn_strs)];
 	ac_crypt_data_t data;
 	const char *pass = "asdfghjk";
+	char hash[128];
 	char uuid[AC_UUID4_LEN + 1];
+	char uuids[3][AC_UUID4_LEN + 1];
+	char uuid7[AC_UUID7_LEN + 1];
 
 	printf("*** %s\n", __func__);
 
@@ -561,20 +1179,45 @@ static void misc_test(void)
 		printf("%" PRIu64 " bytes : %.2f %s\n", bytes2,
 				ppb.value.v_float, ppb.prefix);
 
+	ac_misc_ppb_strm(ppb_vals, AC_ARRAY_SIZE(ppb_vals), AC_SI_UNITS_NO,
+			 ppb_strs[0]);
+	for (i = 0; i < (int)AC_ARRAY_SIZE(ppb_vals); i++)
+		printf("%" PRIu64 " bytes : %s / %s\n", ppb_vals[i],
+		       ppb_strs[i],
+		       ac_misc_ppb_str(ppb_vals[i], AC_SI_UNITS_YES, ppb_str));
+
 	printf("%s -> %s\n", pass, ac_misc_passcrypt(pass, AC_HASH_ALGO_MD5,
 				&data));
 	printf("%s -> %s\n", pass, ac_misc_passcrypt(pass, AC_HASH_ALGO_SHA256,
 				&data));
 	printf("%s -> %s\n", pass, ac_misc_passcrypt(pass, AC_HASH_ALGO_SHA512,
 				&data));
+	snprintf(hash, sizeof(hash), "%s",
+		 ac_misc_passcrypt(pass, AC_HASH_ALGO_SHA256, &data));
+	printf("%s verify [%s]\n", pass,
+	       ac_misc_passcrypt_verify(pass, hash, &data) ? "PASS" : "FAIL");
+	misc_passcrypt_pool_test(pass, hash);
 
 	printf("UUID 1 -> %s\n", ac_misc_gen_uuid4(uuid));
 	printf("UUID 2 -> %s\n", ac_misc_gen_uuid4(uuid));
-
+	ac_misc_gen_uuid4_many(uuids[0], AC_ARRAY_SIZE(uuids));
+	for (i = 0; i < (int)AC_ARRAY_SIZE(uuids); i++)
+		printf("UUID %d -> %s\n", i + 3, uuids[i]);
+	ac_misc_gen_uuid7(uuid);
+	ac_misc_gen_uuid7(uuid7);
+	printf("UUID7 1 -> %s\n", uuid);
+	printf("UUID7 2 -> %s [%s]\n", uuid7,
+	       strcmp(uuid, uuid7) < 0 ? "ORDERED" : "NOT ORDERED");
+
+	ac_misc_luhn_check_strm(luhn_strs, NULL, AC_ARRAY_SIZE(luhn_strs),
+				luhn_res);
 	printf("[%lu] luhn check [%s]\n", luhn_ok,
 	       ac_misc_luhn_check(luhn_ok) ? "PASS" : "FAIL");
 	printf("[%lu] luhn check [%s]\n", luhn_bad,
 	       ac_misc_luhn_check(luhn_bad) ? "PASS" : "FAIL");
+	for (i = 0; i < (int)AC_ARRAY_SIZE(luhn_strs); i++)
+		printf("[%s] luhn check [%s]\n", luhn_strs[i],
+		       luhn_res[i] ? "PASS" : "FAIL");
 
 	printf("Unshuffled list  : ");
 	for (i = 0; i < 10; i++)
@@ -586,6 +1229,10 @@ static void misc_test(void)
 	for (i = 0; i < 10; i++)
 		printf("%d ", shuff_list[i]);
 	printf("\b\n");
+	misc_shuffle_test(1 << 20, sizeof(u32));
+	misc_shuffle_test(1 << 19, sizeof(u64));
+	misc_shuffle_test(1 << 18, 16);
+	misc_shuffle_test(1 << 17, 24);
 
 	printf("AC_MIN(30, 10)            : %d\n", AC_MIN(30, 10));
 	printf("AC_MAX(0, -1)             : %d\n", AC_MAX(0, -1));
@@ -710,6 +1357,179 @@ static void net_test(void)
 	printf("*** %s\n\n", __func__);
 }
 
+#define POOL_THREAD_OBJS	1000
+
+struct pool_thread {
+	ac_pool_t *pool;
+	long id;
+	void *objs[POOL_THREAD_OBJS];
+	long bad;
+};
+
+static void *pool_thread(void *arg)
+{
+	struct pool_thread *pt = arg;
+	long i;
+	int n;
+
+	/* Churn, checking no object is handed out twice */
+	for (n = 0; n < 100; n++) {
+		for (i = 0; i < POOL_THREAD_OBJS; i++) {
+			long *obj = ac_pool_alloc(pt->pool);
+
+			obj[0] = pt->id;
+			obj[1] = i;
+			pt->objs[i] = obj;
+		}
+		for (i = 0; i < POOL_THREAD_OBJS; i++) {
+			long *obj = pt->objs[i];
+
+			if (obj[0] != pt->id || obj[1] != i)
+				pt->bad++;
+			if (n < 99)
+				ac_pool_free(pt->pool, obj);
+		}
+	}
+
+	/* Leave the last lot to be free'd by the main thread */
+	return NULL;
+}
+
+static void pool_test(void)
+{
+	ac_pool_t *pool = ac_pool_new(24, 4096);
+	struct pool_thread pts[4];
+	pthread_t tids[4];
+	ac_pool_stats_t stats;
+	ac_allocator_t alloc;
+	ac_slist_t *list = NULL;
+	long bad = 0;
+	int i;
+	int j;
+
+	printf("*** %s\n", __func__);
+
+	for (i = 0; i < 4; i++) {
+		pts[i].pool = pool;
+		pts[i].id = i;
+		pts[i].bad = 0;
+		pthread_create(&tids[i], NULL, pool_thread, &pts[i]);
+	}
+	for (i = 0; i < 4; i++) {
+		pthread_join(tids[i], NULL);
+		bad += pts[i].bad;
+	}
+
+	ac_pool_stats(pool, &stats);
+	printf("Object size %zu, %ld objects handed out twice, %" PRIu64
+	       " live\n", stats.obj_sz, bad, stats.live);
+
+	for (i = 0; i < 4; i++)
+		for (j = 0; j < POOL_THREAD_OBJS; j++)
+			ac_pool_free(pool, pts[i].objs[j]);
+
+	ac_pool_stats(pool, &stats);
+	printf("After freeing from the main thread %" PRIu64 " live, %"
+	       PRIu64 " allocs, %" PRIu64 " frees, free + live %s objects\n",
+	       stats.live, stats.allocs, stats.frees,
+	       stats.free + stats.live == stats.nr_objs ? "==" : "!=");
+
+	ac_pool_allocator(pool, &alloc);
+	for (i = 0; i < 100; i++)
+		ac_slist_add_with_allocator(&list, AC_LONG_TO_PTR(i), &alloc);
+	ac_pool_stats(pool, &stats);
+	printf("List of %ld items, %" PRIu64 " live\n", ac_slist_len(list),
+	       stats.live);
+	ac_slist_destroy_with_allocator(&list, NULL, &alloc);
+	ac_pool_stats(pool, &stats);
+	printf("List destroyed, %" PRIu64 " live\n", stats.live);
+
+	ac_pool_destroy(pool);
+
+	printf("*** %s\n\n", __func__);
+}
+
+struct perf_thread {
+	ac_perf_t *perf;
+	int region;
+	u64 sum;
+};
+
+static void *perf_thread(void *arg)
+{
+	struct perf_thread *pt = arg;
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		int j;
+
+		ac_perf_start(pt->perf, pt->region);
+		for (j = 0; j < 100; j++)
+			pt->sum += j * i;
+		ac_perf_stop(pt->perf, pt->region);
+	}
+
+	return NULL;
+}
+
+static void perf_test(void)
+{
+	ac_perf_t *perf = ac_perf_new();
+	struct perf_thread pts[2];
+	pthread_t tids[2];
+	ac_perf_stats_t stats;
+	ac_jsonw_t *json;
+	int region;
+	int i;
+
+	printf("*** %s\n", __func__);
+
+	printf("Performance counters %savailable\n",
+	       ac_perf_available() ? "" : "not ");
+
+	region = ac_perf_region(perf, "loop");
+	printf("Region 'loop' %d, 'other' %d, 'loop' %d\n", region,
+	       ac_perf_region(perf, "other"), ac_perf_region(perf, "loop"));
+
+	for (i = 0; i < 2; i++) {
+		pts[i].perf = perf;
+		pts[i].region = region;
+		pts[i].sum = 0;
+		pthread_create(&tids[i], NULL, perf_thread, &pts[i]);
+	}
+	for (i = 0; i < 2; i++)
+		pthread_join(tids[i], NULL);
+
+	/* A stop without a start is ignored, as are invalid regions */
+	ac_perf_stop(perf, region);
+	ac_perf_start(perf, -1);
+	ac_perf_stop(perf, -1);
+	ac_perf_start(perf, 1 << 30);
+	ac_perf_stop(perf, 1 << 30);
+	ac_perf_start(perf, region);
+	ac_perf_stop(perf, region);
+
+	ac_perf_stats(perf, region, &stats);
+	printf("loop: %" PRIu64 " calls, counted %s, ns %s\n", stats.calls,
+	       stats.counted == 0 || stats.counted == stats.calls ?
+	       "OK" : "BAD", stats.ns > 0 ? "> 0" : "== 0");
+	if (stats.counted)
+		printf("loop: %.1f instructions/call\n",
+		       (double)stats.counters[AC_PERF_INSTRUCTIONS] /
+		       stats.counted);
+	printf("Stats for region 5 %d\n", ac_perf_stats(perf, 5, &stats));
+
+	json = ac_jsonw_init();
+	ac_perf_to_json(perf, json, "perf");
+	ac_jsonw_end(json);
+	printf("JSON is %zu bytes\n", ac_jsonw_len(json));
+	ac_jsonw_free(json);
+
+	ac_perf_destroy(perf);
+
+	printf("*** %s\n\n", __func__);
+}
+
 static void quark_test(void)
 {
 	ac_quark_t quark;
@@ -717,6 +1537,7 @@ static void quark_test(void)
 	printf("*** %s\n", __func__);
 
 	ac_quark_init(&quark, NULL);
+	ac_quark_set_thread_safe(&quark);
 
 	printf("Hello -> %d\n", ac_quark_from_string(&quark, "Hello"));
 	printf("World -> %d\n", ac_quark_from_string(&quark, "World"));
@@ -734,6 +1555,119 @@ struct queue_data {
 	int item;
 };
 
+static void ratelimit_test(void)
+{
+	ac_ratelimit_tb_t tb;
+	ac_ratelimit_gcra_t gcra;
+	ac_ratelimit_sw_t sw;
+	ac_ratelimit_keyed_t *kl;
+	const u64 now = 1000 * AC_TIME_NS_SEC;
+	u64 retry = 0;
+	int allowed;
+	int i;
+
+	printf("*** %s\n", __func__);
+
+	/* 10 per second, bursts of 5 */
+	ac_ratelimit_tb_init(&tb, 10, AC_TIME_NS_SEC, 5);
+	for (allowed = 0, i = 0; i < 10; i++)
+		allowed += ac_ratelimit_tb_allow(&tb, 1, now);
+	printf("Token bucket burst      : %d/10 allowed\n", allowed);
+	printf("Token bucket after 0.3s : %u tokens\n",
+	       ac_ratelimit_tb_tokens(&tb, now + 300 * AC_TIME_NS_MSEC));
+
+	ac_ratelimit_gcra_init(&gcra, 10, AC_TIME_NS_SEC, 5);
+	for (allowed = 0, i = 0; i < 10; i++)
+		allowed += ac_ratelimit_gcra_allow(&gcra, 1, now, &retry);
+	printf("GCRA burst              : %d/10 allowed, retry in %" PRIu64
+	       "ms\n", allowed, retry / AC_TIME_NS_MSEC);
+
+	/* 100 per second */
+	ac_ratelimit_sw_init(&sw, 100, AC_TIME_NS_SEC);
+	for (allowed = 0, i = 0; i < 150; i++)
+		allowed += ac_ratelimit_sw_allow(&sw, 1, now);
+	printf("Sliding window          : %d/150 allowed\n", allowed);
+	/* Half way into the next window, half the last window still counts */
+	for (allowed = 0, i = 0; i < 150; i++)
+		allowed += ac_ratelimit_sw_allow(&sw, 1, now + AC_TIME_NS_SEC +
+						 AC_TIME_NS_SEC / 2);
+	printf("Sliding window +1.5s    : %d/150 allowed\n", allowed);
+
+	kl = ac_ratelimit_keyed_new(1024, 1, AC_TIME_NS_SEC, 2);
+	for (allowed = 0, i = 0; i < 3; i++) {
+		allowed += ac_ratelimit_keyed_allow(kl, "10.0.0.1", 8, 1, now,
+						    NULL);
+		allowed += ac_ratelimit_keyed_allow(kl, "10.0.0.2", 8, 1, now,
+						    NULL);
+	}
+	printf("Keyed (2 keys)          : %d/6 allowed\n", allowed);
+	ac_ratelimit_keyed_destroy(kl);
+
+	printf("*** %s\n\n", __func__);
+}
+
+static void rng_test(void)
+{
+	ac_rng_t rng;
+	u64 buf[5];
+	int pfd[2];
+	int i;
+
+	printf("*** %s\n", __func__);
+
+	ac_rng_seed(&rng, AC_RNG_XOSHIRO256SS, 42);
+	printf("xoshiro256** (seed 42) :");
+	for (i = 0; i < 3; i++)
+		printf(" %016" PRIx64, ac_rng_u64(&rng));
+	printf("\n");
+
+	ac_rng_seed(&rng, AC_RNG_PCG32, 42);
+	printf("pcg32 (seed 42)        :");
+	for (i = 0; i < 3; i++)
+		printf(" %08" PRIx32, ac_rng_u32(&rng));
+	printf("\n");
+
+	ac_rng_init(&rng, AC_RNG_XOSHIRO256SS);
+	printf("Dice rolls             :");
+	for (i = 0; i < 10; i++)
+		printf(" %" PRIu64, ac_rng_bounded(&rng, 6) + 1);
+	printf("\n");
+
+	printf("Per-thread double      : %f\n", ac_rng_double(NULL));
+
+	/* A forked child must not carry on with the parent's stream */
+	if (pipe(pfd) == 0) {
+		u64 child_val = 0;
+		pid_t pid = fork();
+
+		if (pid == 0) {
+			u64 val = ac_rng_u64(NULL);
+
+			if (write(pfd[1], &val, sizeof(val)) != sizeof(val))
+				_exit(EXIT_FAILURE);
+			_exit(EXIT_SUCCESS);
+		}
+		close(pfd[1]);
+		if (read(pfd[0], &child_val, sizeof(child_val)) !=
+		    sizeof(child_val))
+			child_val = 0;
+		close(pfd[0]);
+		waitpid(pid, NULL, 0);
+		printf("Per-thread after fork  : parent & child %s\n",
+		       child_val && child_val != ac_rng_u64(NULL) ?
+		       "differ" : "are the SAME");
+	}
+
+	ac_rng_seed(&rng, AC_RNG_XOSHIRO256SS, 42);
+	ac_rng_fill(&rng, buf, sizeof(buf));
+	printf("Fill                   :");
+	for (i = 0; i < 5; i++)
+		printf(" %016" PRIx64, buf[i]);
+	printf("\n");
+
+	printf("*** %s\n\n", __func__);
+}
+
 static void print_queue_item(void *item, void *data __always_unused)
 {
 	struct queue_data *qd = item;
@@ -757,6 +1691,7 @@ static void queue_test(void)
 
 	printf("*** %s\n", __func__);
 
+	ac_queue_set_thread_safe(queue);
 	printf("The queue is %sempty\n", ac_queue_nr_items(queue) == 0 ? "" :
 	       "not ");
 
@@ -997,6 +1932,22 @@ static void time_test(void)
 	int h;
 	int m;
 	int s;
+	u64 ns;
+	u64 cycles;
+	double et;
+	ac_time_period_t period;
+	char tstamp[AC_TIME_RFC3339_LEN + 1];
+	const struct timespec rfc3339_ts[] = {
+		{ 0, 0 }, { 951782400, 123456789 }, { 1648816496, 789000000 },
+		{ 253402300799, 999999999 }
+	};
+	const char *rfc3339_strs[] = {
+		"1985-04-12T23:20:50.52Z", "1996-12-19T16:39:57-08:00",
+		"1990-12-31t23:59:60z", "2022-02-29T00:00:00Z",
+		"2022-04-01T12:34:56.Z", "2022-04-01 12:34:56+01:00",
+		"2022-04-01T12:34:56", NULL
+	};
+	struct timespec start;
 	struct timespec delta;
 	const struct {
 		struct timespec start;
@@ -1014,8 +1965,6 @@ static void time_test(void)
 	printf("*** %s\n", __func__);
 
 	for (i = 0; times[i].start.tv_sec != 0; i++) {
-		double et;
-
 		et = ac_time_tspec_diff(&delta, &times[i].end, &times[i].start);
 		printf("Time difference is %f seconds\n", et);
 	}
@@ -1026,6 +1975,69 @@ static void time_test(void)
 	printf("Sleeping for 125ms...\n");
 	ac_time_nsleep(125 * AC_TIME_NS_MSEC);
 
+	ns = ac_time_clock_ns();
+	cycles = ac_time_clock_cycles();
+	ac_time_nsleep(5 * AC_TIME_NS_MSEC);
+	cycles = ac_time_cycles_to_ns(ac_time_clock_cycles() - cycles);
+	ns = ac_time_clock_ns() - ns;
+	printf("Clock source %s, slept for ~5ms [%s]\n",
+	       ac_time_clock_is_tsc() ? "TSC" : "CLOCK_MONOTONIC",
+	       ns >= 5 * AC_TIME_NS_MSEC && cycles >= 5 * AC_TIME_NS_MSEC &&
+	       ns < 1 * AC_TIME_NS_SEC ? "PASS" : "FAIL");
+
+	ac_time_coarse_start(1000);
+	ac_time_coarse_tspec(&start);
+	ac_time_nsleep(20 * AC_TIME_NS_MSEC);
+	et = ac_time_coarse_elapsed(&delta, &start);
+	ac_time_coarse_stop();
+	printf("Coarse clock elapsed ~20ms [%s]\n",
+	       et >= 0.015 && et < 1.0 ? "PASS" : "FAIL");
+
+	ac_time_coarse_start(1000000);
+	ac_time_nsleep(5 * AC_TIME_NS_MSEC);
+	ns = ac_time_clock_ns();
+	ac_time_coarse_stop();
+	ns = ac_time_clock_ns() - ns;
+	printf("Coarse clock 1s ticker stopped promptly [%s]\n",
+	       ns < 100 * AC_TIME_NS_MSEC &&
+	       ac_time_coarse_start(1000) == 0 ? "PASS" : "FAIL");
+	ac_time_coarse_stop();
+
+	ns = ac_time_clock_ns();
+	ac_time_nsleep_precise(20 * AC_TIME_NS_USEC);
+	ns = ac_time_clock_ns() - ns;
+	printf("Precise sleep for 20us [%s]\n",
+	       ns >= 20 * AC_TIME_NS_USEC && ns < AC_TIME_NS_SEC ?
+	       "PASS" : "FAIL");
+
+	ac_time_period_init(&period, 50 * AC_TIME_NS_USEC);
+	ns = ac_time_clock_ns();
+	for (i = 0; i < 100; i++)
+		ac_time_period_wait(&period);
+	ns = ac_time_clock_ns() - ns;
+	printf("100 x 50us periods [%s]\n",
+	       ns >= 4900 * AC_TIME_NS_USEC && ns < AC_TIME_NS_SEC ?
+	       "PASS" : "FAIL");
+
+	for (i = 0; i < (int)AC_ARRAY_SIZE(rfc3339_ts); i++) {
+		ac_time_fmt_rfc3339(tstamp, &rfc3339_ts[i], i * 3);
+		ac_time_parse_rfc3339(tstamp, strlen(tstamp), &start);
+		printf("%10ld.%09ld -> %-30s [%s]\n", rfc3339_ts[i].tv_sec,
+		       rfc3339_ts[i].tv_nsec, tstamp,
+		       start.tv_sec == rfc3339_ts[i].tv_sec ? "PASS" : "FAIL");
+	}
+	for (i = 0; rfc3339_strs[i]; i++) {
+		int err = ac_time_parse_rfc3339(rfc3339_strs[i],
+						strlen(rfc3339_strs[i]),
+						&start);
+
+		if (err)
+			printf("%-35s -> invalid\n", rfc3339_strs[i]);
+		else
+			printf("%-35s -> %ld.%09ld\n", rfc3339_strs[i],
+			       start.tv_sec, start.tv_nsec);
+	}
+
 	printf("*** %s\n\n", __func__);
 }
 
@@ -1035,18 +2047,25 @@ int main(void)
 			LIBAC_MAJOR_VERSION, LIBAC_MINOR_VERSION,
 			LIBAC_MICRO_VERSION);
 
+	alloc_test();
+	arena_test();
 	btree_test();
 	byte_test();
 	circ_buf_test();
 	fs_test();
 	geo_test();
+	histogram_test();
 	htable_test();
 	json_test();
 	list_test();
 	misc_test();
 	net_test();
+	perf_test();
+	pool_test();
 	quark_test();
 	queue_test();
+	ratelimit_test();
+	rng_test();
 	slist_test();
 	str_test();
 	time_test();